@@ -0,0 +1,244 @@
+// Spark Interval Timer benchmark
+//
+// Please refer to the github README file for more details:
+// https://github.com/pkourany/SparkIntervalTimer/blob/master/README.md
+//
+// Measures with the DWT cycle counter what the IntervalTimer control
+// paths cost (begin, beginNs, resetPeriod_SIT, interrupt_SIT, fireOnce,
+// end), the same paths of an IntervalTimerT, an IntervalClock now64()
+// read, and what an update interrupt costs at several callback loads:
+// the latency from the update event to the callback, and the CPU time
+// taken from the main loop per interrupt, beyond the callback itself.
+// IntervalTimerT results carry a "_T" suffix.
+//
+// Results are printed over USB serial as one JSON object per line, so
+// runs can be saved and compared.  The benchmark runs 3 seconds after
+// reset and again whenever a character is received.
+#include "SparkIntervalTimer.h"
+#include "SparkIntervalTimerT.h"
+#include "SparkIntervalClock.h"
+
+SYSTEM_MODE(MANUAL);		// no WiFi or Cloud interrupts while measuring
+
+const int RUNS = 32;							// repetitions of each control path
+const uint32_t LOADS[] = { 0, 100, 1000 };		// callback busy time in CPU cycles
+
+void nop(void);
+void loadedT(void);
+
+IntervalTimer benchTimer;
+IntervalTimerT<TIMER4, nop> benchTimerT;
+IntervalTimerT<TIMER4, loadedT> loadTimerT;
+IntervalClock<> benchClock;
+TIM_TypeDef* benchTIM;
+volatile uint32_t loadCycles;
+volatile uint32_t hits;
+
+// min / mean / max of a series of samples
+struct Series {
+	uint32_t n, min, max;
+	uint64_t sum;
+	Series() : n(0), min(UINT32_MAX), max(0), sum(0) {}
+	void add(uint32_t v) {
+		n++; sum += v;
+		if (v < min) min = v;
+		if (v > max) max = v;
+	}
+};
+
+Series latency;
+
+static inline uint32_t cycles(void) {
+	return DWT->CYCCNT;
+}
+
+void report(const char* bench, uint32_t load, const Series& s) {
+	Serial.printlnf("{\"platform\":%d,\"bench\":\"%s\",\"load\":%lu,\"unit\":\"cycles\",\"n\":%lu,\"min\":%lu,\"mean\":%lu,\"max\":%lu}",
+		PLATFORM_ID, bench, load, s.n, s.n ? s.min : 0, s.n ? (uint32_t)(s.sum / s.n) : 0, s.max);
+}
+
+void nop(void) {}
+
+// Reads the counter first: with PSC = 0 it holds the timer clocks since
+// the update event, then burns loadCycles
+void loaded(void) {
+	uint32_t ticks = benchTIM->CNT;
+	hits++;
+	latency.add(ticks * (SystemCoreClock / SYSCORECLOCK));
+	uint32_t start = cycles();
+	while (cycles() - start < loadCycles) ;
+}
+
+// As loaded(), for IntervalTimerT: its counter runs at 1MHz, too
+// coarse for latency, so only the overhead is measured
+void loadedT(void) {
+	hits++;
+	uint32_t start = cycles();
+	while (cycles() - start < loadCycles) ;
+}
+
+// Iterations of an empty loop in window cycles, the CPU left to loop()
+__attribute__((noinline)) uint32_t spin(uint32_t window) {
+	uint32_t n = 0;
+	uint32_t start = cycles();
+	while (cycles() - start < window)
+		n++;
+	return n;
+}
+
+void benchControl(void) {
+	Series sBegin, sReset, sDisable, sEnable, sEnd, sBeginNs, sFire, sNow;
+
+	for (int i = 0; i < RUNS; i++) {
+		uint32_t t0 = cycles();
+		benchTimer.begin(nop, 1000, uSec);
+		uint32_t t1 = cycles();
+		benchTimer.resetPeriod_SIT(500, uSec);
+		uint32_t t2 = cycles();
+		benchTimer.interrupt_SIT(INT_DISABLE);
+		uint32_t t3 = cycles();
+		benchTimer.interrupt_SIT(INT_ENABLE);
+		uint32_t t4 = cycles();
+		benchTimer.end();
+		uint32_t t5 = cycles();
+		benchTimer.beginNs(nop, 12345678);
+		uint32_t t6 = cycles();
+		benchTimer.end();
+
+		sBegin.add(t1 - t0);
+		sReset.add(t2 - t1);
+		sDisable.add(t3 - t2);
+		sEnable.add(t4 - t3);
+		sEnd.add(t5 - t4);
+		sBeginNs.add(t6 - t5);
+	}
+
+	benchTimer.fireOnce(nop, 60000);		// allocation happens here, re-arms below
+	for (int i = 0; i < RUNS; i++) {
+		uint32_t t0 = cycles();
+		benchTimer.fireOnce(nop, 60000);
+		sFire.add(cycles() - t0);
+	}
+	benchTimer.end();
+
+	benchClock.begin();
+	for (int i = 0; i < RUNS; i++) {
+		uint32_t t0 = cycles();
+		volatile uint64_t stamp = benchClock.now64();
+		sNow.add(cycles() - t0);
+		(void)stamp;
+	}
+	benchClock.end();
+
+	report("begin", 0, sBegin);
+	report("resetPeriod_SIT", 0, sReset);
+	report("interrupt_SIT_disable", 0, sDisable);
+	report("interrupt_SIT_enable", 0, sEnable);
+	report("end", 0, sEnd);
+	report("beginNs", 0, sBeginNs);
+	report("fireOnce_rearm", 0, sFire);
+	report("now64", 0, sNow);
+}
+
+void benchControlT(void) {
+	Series sBegin, sReset, sDisable, sEnable, sEnd;
+
+	for (int i = 0; i < RUNS; i++) {
+		uint32_t t0 = cycles();
+		benchTimerT.begin(1000, uSec);
+		uint32_t t1 = cycles();
+		benchTimerT.resetPeriod_SIT(500, uSec);
+		uint32_t t2 = cycles();
+		benchTimerT.interrupt_SIT(INT_DISABLE);
+		uint32_t t3 = cycles();
+		benchTimerT.interrupt_SIT(INT_ENABLE);
+		uint32_t t4 = cycles();
+		benchTimerT.end();
+		uint32_t t5 = cycles();
+
+		sBegin.add(t1 - t0);
+		sReset.add(t2 - t1);
+		sDisable.add(t3 - t2);
+		sEnable.add(t4 - t3);
+		sEnd.add(t5 - t4);
+	}
+
+	report("begin_T", 0, sBegin);
+	report("resetPeriod_SIT_T", 0, sReset);
+	report("interrupt_SIT_disable_T", 0, sDisable);
+	report("interrupt_SIT_enable_T", 0, sEnable);
+	report("end_T", 0, sEnd);
+}
+
+// For each load, runs a 50us timer (PSC = 0) for a 100ms window and
+// compares the loop iterations left against a window without it
+void benchDispatch(void) {
+	const uint32_t window = SystemCoreClock / 10;
+	uint32_t idle = spin(window);
+
+	for (uint32_t i = 0; i < sizeof(LOADS) / sizeof(LOADS[0]); i++) {
+		loadCycles = LOADS[i];
+		if (!benchTimer.beginNs(loaded, 50000))
+			return;
+		benchTIM = benchTimer.timer_SIT();
+		delay(1);
+
+		noInterrupts();
+		latency = Series();
+		hits = 0;
+		interrupts();
+		uint32_t busy = spin(window);
+		uint32_t n = hits;
+		benchTimer.end();
+
+		// cycles lost by loop() per interrupt, less the callback's own load
+		Series cost;
+		if (n > 0) {
+			uint64_t lost = (uint64_t)(idle - busy) * window / idle;
+			uint32_t per = (uint32_t)(lost / n);
+			cost.add(per > LOADS[i] ? per - LOADS[i] : 0);
+		}
+		report("dispatch_latency", LOADS[i], latency);
+		report("dispatch_overhead", LOADS[i], cost);
+
+		// the same with IntervalTimerT's fixed handler at 50us
+		if (!loadTimerT.begin(50, uSec))
+			return;
+		delay(1);
+
+		noInterrupts();
+		hits = 0;
+		interrupts();
+		busy = spin(window);
+		n = hits;
+		loadTimerT.end();
+
+		Series costT;
+		if (n > 0) {
+			uint64_t lost = (uint64_t)(idle - busy) * window / idle;
+			uint32_t per = (uint32_t)(lost / n);
+			costT.add(per > LOADS[i] ? per - LOADS[i] : 0);
+		}
+		report("dispatch_overhead_T", LOADS[i], costT);
+	}
+}
+
+void setup(void) {
+	Serial.begin(115200);
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;		// start the DWT cycle counter
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void loop(void) {
+	static bool first = true;
+
+	if ((first && millis() > 3000) || Serial.available()) {
+		while (Serial.available())
+			Serial.read();
+		first = false;
+		benchControl();
+		benchControlT();
+		benchDispatch();
+	}
+}
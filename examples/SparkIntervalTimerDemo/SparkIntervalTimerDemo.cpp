@@ -26,12 +26,7 @@ IntervalTimer myTimer5;
 
 // Pre-declare ISR callback functions
 void blinkLED(void);
-void blinkLED2(void);
-void blinkLED3(void);
-#if (PLATFORM_ID == 6)		// Extras for Photon
-void blinkLED4(void);
-void blinkLED5(void);
-#endif
+void blinkPin(void* pin);		// shared by the other timers, pin passed as context
 
 const uint8_t ledPin = D7;		// LED for first Interval Timer
 const uint8_t ledPin2 = D3;		// LED for second Interval Timer
@@ -56,19 +51,20 @@ void setup(void) {
 
   // Manually allocate blinkLED2 to hardware timer TIMER4 to run every 250ms using hmSec timescale (500 * 0.5ms period)
   // TIMER4 is common to both Core and Photon.
-  myTimer2.begin(blinkLED2, 500, hmSec, TIMER4);
+  // The pin to blink is passed to the shared blinkPin callback as its context pointer.
+  myTimer2.begin(blinkPin, (void*)&ledPin2, 500, hmSec, TIMER4);
   
   // Auto allocate blinkLED3 to run every 1000ms using hmSec timescale (2000 * 0.5ms period)
   // On Core allocated timer will be first free = TIMER3.  On Photon, it will be TIMER5.
-  myTimer3.begin(blinkLED3, 2000, hmSec);
+  myTimer3.begin(blinkPin, (void*)&ledPin3, 2000, hmSec);
   
 #if (PLATFORM_ID == 6)
   // Auto allocate blinkLED4 to run every 65ms using uSec timescale (65000 * 1us period)
   // On Photon (only) allocated timer will be next free = TIMER6.
-  myTimer4.begin(blinkLED4, 65000, uSec);
+  myTimer4.begin(blinkPin, (void*)&ledPin4, 65000, uSec);
   
   // Manually allocate blinkLED5 to hardware timer TIMER7 blinkLED to run every 5000ms (10000 * .5ms period)
-  myTimer5.begin(blinkLED5, 10000, hmSec, TIMER7);
+  myTimer5.begin(blinkPin, (void*)&ledPin5, 10000, hmSec, TIMER7);
 #endif
 }
 
@@ -89,27 +85,11 @@ void blinkLED(void) {
     blinkCount++;		// increase when LED turns changes
 }
 
-// Callback for Timer 2
-void blinkLED2(void) {
-	digitalWrite(ledPin2,!digitalRead(ledPin2));
-}
-
-// Callback for Timer 3
-void blinkLED3(void) {
-	digitalWrite(ledPin3,!digitalRead(ledPin3));
-}
-
- #if (PLATFORM_ID == 6)		// Extras for the Photon
-// Callback for Timer 4
-void blinkLED4(void) {
-	digitalWrite(ledPin4,!digitalRead(ledPin4));
-}
-
-// Callback for Timer 5
-void blinkLED5(void) {
-	digitalWrite(ledPin5,!digitalRead(ledPin5));
+// Callback for all other Timers, context points at the pin to blink
+void blinkPin(void* pin) {
+	uint8_t p = *(const uint8_t*)pin;
+	digitalWrite(p,!digitalRead(p));
 }
-#endif
 
 
 void loop(void) {
@@ -0,0 +1,601 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+// ------------------------------------------------------------
+// Host stand-in for the Particle firmware headers, used by the
+// simulation build in this directory.  It declares only what the
+// library uses.  Timers, NVIC and system interrupts are modelled
+// by SparkIntervalSim.cpp; ADC, DMA and GPIO are plain register
+// blocks that are configured but never move data.
+//
+// PLATFORM_ID selects the device: 6 (Photon, default) or 0 (Core).
+// ------------------------------------------------------------
+
+#ifndef __SIT_SIM_PARTICLE_H__
+#define __SIT_SIM_PARTICLE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef PLATFORM_ID
+#define PLATFORM_ID		6
+#endif
+#if PLATFORM_ID == 0
+#define STM32F10X_MD
+#elif PLATFORM_ID == 6
+#define STM32F2XX
+#else
+#error "*** simulation supports PLATFORM_ID 0 (Core) and 6 (Photon) ***"
+#endif
+
+#define SYSTEM_MODE(mode)
+
+typedef enum {RESET = 0, SET = !RESET} FlagStatus, ITStatus;
+typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
+
+
+// ------------------------------------------------------------
+// Registers whose writes act immediately in hardware.  SR bits
+// are cleared by writing 0 (rc_w0), EGR triggers events and
+// setting CEN in CR1 may start slave timers; the simulator needs
+// to see these at the moment of the write.
+// ------------------------------------------------------------
+struct SIM_ControlReg {
+	volatile uint32_t value;
+	operator uint32_t() const { return value; }
+	SIM_ControlReg& operator=(uint32_t v);
+	SIM_ControlReg& operator&=(uint32_t v) { return *this = value & v; }
+	SIM_ControlReg& operator|=(uint32_t v) { return *this = value | v; }
+};
+
+struct SIM_StatusReg {
+	volatile uint32_t value;
+	operator uint32_t() const { return value; }
+	SIM_StatusReg& operator=(uint32_t v) { value &= v; return *this; }
+	SIM_StatusReg& operator&=(uint32_t v) { value &= v; return *this; }
+	SIM_StatusReg& operator|=(uint32_t) { return *this; }
+};
+
+struct SIM_EventReg {
+	operator uint32_t() const { return 0; }
+	SIM_EventReg& operator=(uint32_t v);
+};
+
+
+// ------------------------------------------------------------
+// Timers
+// ------------------------------------------------------------
+typedef struct {
+	SIM_ControlReg CR1;
+	volatile uint32_t CR2, SMCR, DIER;
+	SIM_StatusReg SR;
+	SIM_EventReg EGR;
+	volatile uint32_t CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR;
+	volatile uint32_t CCR1, CCR2, CCR3, CCR4, BDTR, DCR, DMAR, OR;
+} TIM_TypeDef;
+
+#define SIM_NUM_TIM		15			// TIM1..TIM14, index 0 unused
+extern TIM_TypeDef SIM_TIM[SIM_NUM_TIM];
+#define TIM1	(&SIM_TIM[1])
+#define TIM2	(&SIM_TIM[2])
+#define TIM3	(&SIM_TIM[3])
+#define TIM4	(&SIM_TIM[4])
+#define TIM5	(&SIM_TIM[5])
+#define TIM6	(&SIM_TIM[6])
+#define TIM7	(&SIM_TIM[7])
+#define TIM8	(&SIM_TIM[8])
+#define TIM9	(&SIM_TIM[9])
+#define TIM10	(&SIM_TIM[10])
+#define TIM11	(&SIM_TIM[11])
+#define TIM12	(&SIM_TIM[12])
+#define TIM13	(&SIM_TIM[13])
+#define TIM14	(&SIM_TIM[14])
+
+#define TIM_CR1_CEN		((uint16_t)0x0001)
+#define TIM_CR1_UDIS	((uint16_t)0x0002)
+#define TIM_CR1_URS		((uint16_t)0x0004)
+#define TIM_CR1_OPM		((uint16_t)0x0008)
+#define TIM_CR1_ARPE	((uint16_t)0x0080)
+#define TIM_CR2_MMS		((uint16_t)0x0070)
+#define TIM_SMCR_SMS	((uint16_t)0x0007)
+#define TIM_SMCR_TS		((uint16_t)0x0070)
+#define TIM_SR_UIF		((uint16_t)0x0001)
+#define TIM_SR_CC1IF	((uint16_t)0x0002)
+#define TIM_SR_CC2IF	((uint16_t)0x0004)
+#define TIM_SR_CC3IF	((uint16_t)0x0008)
+#define TIM_SR_CC4IF	((uint16_t)0x0010)
+#define TIM_SR_TIF		((uint16_t)0x0040)
+#define TIM_DIER_UIE	((uint16_t)0x0001)
+#define TIM_EGR_UG		((uint16_t)0x0001)
+#define TIM_BDTR_MOE	((uint16_t)0x8000)
+
+#define TIM_IT_Update	((uint16_t)0x0001)
+#define TIM_IT_CC1		((uint16_t)0x0002)
+#define TIM_IT_CC2		((uint16_t)0x0004)
+#define TIM_IT_CC3		((uint16_t)0x0008)
+#define TIM_IT_CC4		((uint16_t)0x0010)
+#define TIM_IT_Trigger	((uint16_t)0x0040)
+#define TIM_DMA_Update	((uint16_t)0x0100)
+#define TIM_DMA_CC1		((uint16_t)0x0200)
+#define TIM_DMA_CC2		((uint16_t)0x0400)
+
+#define TIM_PSCReloadMode_Immediate	((uint16_t)0x0001)
+#define TIM_CounterMode_Up			((uint16_t)0x0000)
+#define TIM_CKD_DIV1				((uint16_t)0x0000)
+#define TIM_TRGOSource_Reset		((uint16_t)0x0000)
+#define TIM_TRGOSource_Enable		((uint16_t)0x0010)
+#define TIM_TRGOSource_Update		((uint16_t)0x0020)
+#define TIM_TS_ITR0					((uint16_t)0x0000)
+#define TIM_TS_ITR1					((uint16_t)0x0010)
+#define TIM_TS_ITR2					((uint16_t)0x0020)
+#define TIM_TS_ITR3					((uint16_t)0x0030)
+#define TIM_TS_TI1FP1				((uint16_t)0x0050)
+#define TIM_TS_TI2FP2				((uint16_t)0x0060)
+#define TIM_SlaveMode_Reset			((uint16_t)0x0004)
+#define TIM_SlaveMode_Gated			((uint16_t)0x0005)
+#define TIM_SlaveMode_Trigger		((uint16_t)0x0006)
+#define TIM_SlaveMode_External1		((uint16_t)0x0007)
+#define TIM_OCMode_Timing			((uint16_t)0x0000)
+#define TIM_OCMode_Toggle			((uint16_t)0x0030)
+#define TIM_OCMode_PWM1				((uint16_t)0x0060)
+#define TIM_OutputState_Disable		((uint16_t)0x0000)
+#define TIM_OutputState_Enable		((uint16_t)0x0001)
+#define TIM_OCPolarity_High			((uint16_t)0x0000)
+#define TIM_Channel_1				((uint16_t)0x0000)
+#define TIM_Channel_2				((uint16_t)0x0004)
+#define TIM_Channel_3				((uint16_t)0x0008)
+#define TIM_Channel_4				((uint16_t)0x000C)
+#define TIM_ICPolarity_Rising		((uint16_t)0x0000)
+#define TIM_ICPolarity_Falling		((uint16_t)0x0002)
+#define TIM_ICSelection_DirectTI	((uint16_t)0x0001)
+#define TIM_ICSelection_IndirectTI	((uint16_t)0x0002)
+#define TIM_ICPSC_DIV1				((uint16_t)0x0000)
+#define TIM_DMABase_CCR1			((uint16_t)0x000D)
+#define TIM_DMABurstLength_2Transfers	((uint16_t)0x0100)
+
+typedef struct {
+	uint16_t TIM_Prescaler;
+	uint16_t TIM_CounterMode;
+	uint32_t TIM_Period;
+	uint16_t TIM_ClockDivision;
+	uint8_t TIM_RepetitionCounter;
+} TIM_TimeBaseInitTypeDef;
+
+typedef struct {
+	uint16_t TIM_OCMode;
+	uint16_t TIM_OutputState;
+	uint16_t TIM_OutputNState;
+	uint32_t TIM_Pulse;
+	uint16_t TIM_OCPolarity;
+	uint16_t TIM_OCNPolarity;
+	uint16_t TIM_OCIdleState;
+	uint16_t TIM_OCNIdleState;
+} TIM_OCInitTypeDef;
+
+typedef struct {
+	uint16_t TIM_Channel;
+	uint16_t TIM_ICPolarity;
+	uint16_t TIM_ICSelection;
+	uint16_t TIM_ICPrescaler;
+	uint16_t TIM_ICFilter;
+} TIM_ICInitTypeDef;
+
+void TIM_TimeBaseInit(TIM_TypeDef* TIMx, TIM_TimeBaseInitTypeDef* init);
+void TIM_DeInit(TIM_TypeDef* TIMx);
+void TIM_Cmd(TIM_TypeDef* TIMx, FunctionalState state);
+void TIM_ITConfig(TIM_TypeDef* TIMx, uint16_t it, FunctionalState state);
+ITStatus TIM_GetITStatus(TIM_TypeDef* TIMx, uint16_t it);
+void TIM_ClearITPendingBit(TIM_TypeDef* TIMx, uint16_t it);
+void TIM_DMACmd(TIM_TypeDef* TIMx, uint16_t source, FunctionalState state);
+void TIM_SelectOutputTrigger(TIM_TypeDef* TIMx, uint16_t source);
+void TIM_SelectInputTrigger(TIM_TypeDef* TIMx, uint16_t source);
+void TIM_SelectSlaveMode(TIM_TypeDef* TIMx, uint16_t mode);
+void TIM_ITRxExternalClockConfig(TIM_TypeDef* TIMx, uint16_t source);
+void TIM_OCStructInit(TIM_OCInitTypeDef* init);
+void TIM_OC1Init(TIM_TypeDef* TIMx, TIM_OCInitTypeDef* init);
+void TIM_OC2Init(TIM_TypeDef* TIMx, TIM_OCInitTypeDef* init);
+void TIM_OC3Init(TIM_TypeDef* TIMx, TIM_OCInitTypeDef* init);
+void TIM_OC4Init(TIM_TypeDef* TIMx, TIM_OCInitTypeDef* init);
+void TIM_PWMIConfig(TIM_TypeDef* TIMx, TIM_ICInitTypeDef* init);
+void TIM_CtrlPWMOutputs(TIM_TypeDef* TIMx, FunctionalState state);
+void TIM_DMAConfig(TIM_TypeDef* TIMx, uint16_t base, uint16_t length);
+
+
+// ------------------------------------------------------------
+// NVIC and core registers
+// ------------------------------------------------------------
+typedef enum {
+	CAN1_SCE_IRQn = 22,
+	TIM1_BRK_TIM9_IRQn = 24,
+	TIM1_UP_TIM10_IRQn = 25,
+	TIM1_TRG_COM_TIM11_IRQn = 26,
+	TIM1_CC_IRQn = 27,
+	TIM2_IRQn = 28,
+	TIM3_IRQn = 29,
+	TIM4_IRQn = 30,
+	TIM8_BRK_TIM12_IRQn = 43,
+	TIM8_UP_TIM13_IRQn = 44,
+	TIM8_TRG_COM_TIM14_IRQn = 45,
+	TIM8_CC_IRQn = 46,
+	FSMC_IRQn = 48,
+	TIM5_IRQn = 50,
+	TIM6_DAC_IRQn = 54,
+	TIM7_IRQn = 55,
+	SIM_NUM_IRQn = 96
+} IRQn_Type;
+
+typedef struct {
+	uint8_t NVIC_IRQChannel;
+	uint8_t NVIC_IRQChannelPreemptionPriority;
+	uint8_t NVIC_IRQChannelSubPriority;
+	FunctionalState NVIC_IRQChannelCmd;
+} NVIC_InitTypeDef;
+
+void NVIC_Init(NVIC_InitTypeDef* init);
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+uint32_t NVIC_GetPriority(IRQn_Type irq);
+uint32_t NVIC_GetPriorityGrouping(void);
+uint32_t NVIC_EncodePriority(uint32_t group, uint32_t preempt, uint32_t sub);
+void NVIC_SetPendingIRQ(IRQn_Type irq);
+void NVIC_ClearPendingIRQ(IRQn_Type irq);
+
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq(void);
+void __enable_irq(void);
+#define __DMB()		__sync_synchronize()
+
+typedef struct { volatile uint32_t CTRL, CYCCNT; } DWT_Type;
+typedef struct { volatile uint32_t DHCSR, DCRSR, DCRDR, DEMCR; } CoreDebug_Type;
+extern DWT_Type SIM_DWT;
+extern CoreDebug_Type SIM_CoreDebug;
+#define DWT			(&SIM_DWT)
+#define CoreDebug	(&SIM_CoreDebug)
+#define CoreDebug_DEMCR_TRCENA_Msk	(1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk		(1UL)
+
+
+// ------------------------------------------------------------
+// RCC
+// ------------------------------------------------------------
+typedef struct {
+	volatile uint32_t CR, CFGR, CIR, APB2RSTR, APB1RSTR, AHBENR, APB2ENR, APB1ENR;
+} RCC_TypeDef;
+extern RCC_TypeDef SIM_RCC;
+#define RCC		(&SIM_RCC)
+
+#define RCC_APB1Periph_TIM2		((uint32_t)0x00000001)
+#define RCC_APB1Periph_TIM3		((uint32_t)0x00000002)
+#define RCC_APB1Periph_TIM4		((uint32_t)0x00000004)
+#define RCC_APB1Periph_TIM5		((uint32_t)0x00000008)
+#define RCC_APB1Periph_TIM6		((uint32_t)0x00000010)
+#define RCC_APB1Periph_TIM7		((uint32_t)0x00000020)
+#define RCC_APB2Periph_ADC1		((uint32_t)0x00000200)
+#if !defined(STM32F10X_MD)
+#define RCC_APB1Periph_TIM12	((uint32_t)0x00000040)
+#define RCC_APB1Periph_TIM13	((uint32_t)0x00000080)
+#define RCC_APB1Periph_TIM14	((uint32_t)0x00000100)
+#define RCC_APB2Periph_TIM1		((uint32_t)0x00000001)
+#define RCC_APB2Periph_TIM8		((uint32_t)0x00000002)
+#define RCC_APB2Periph_TIM9		((uint32_t)0x00010000)
+#define RCC_APB2Periph_TIM10	((uint32_t)0x00020000)
+#define RCC_APB2Periph_TIM11	((uint32_t)0x00040000)
+#endif
+#define RCC_AHBPeriph_DMA1		((uint32_t)0x00000001)
+#define RCC_AHB1Periph_DMA1		((uint32_t)0x00200000)
+#define RCC_AHB1Periph_DMA2		((uint32_t)0x00400000)
+#define RCC_PCLK2_Div6			((uint32_t)0x00008000)
+
+void RCC_APB1PeriphClockCmd(uint32_t periph, FunctionalState state);
+void RCC_APB2PeriphClockCmd(uint32_t periph, FunctionalState state);
+void RCC_AHBPeriphClockCmd(uint32_t periph, FunctionalState state);
+void RCC_AHB1PeriphClockCmd(uint32_t periph, FunctionalState state);
+void RCC_ADCCLKConfig(uint32_t prescaler);
+
+
+// ------------------------------------------------------------
+// GPIO and pins
+// ------------------------------------------------------------
+#if defined(STM32F10X_MD)
+typedef struct { volatile uint32_t CRL, CRH, IDR, ODR, BSRR, BRR, LCKR; } GPIO_TypeDef;
+#else
+typedef struct { volatile uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR; volatile uint16_t BSRRL, BSRRH; volatile uint32_t LCKR, AFR[2]; } GPIO_TypeDef;
+#define GPIO_AF_TIM1	((uint8_t)0x01)
+#define GPIO_AF_TIM3	((uint8_t)0x02)
+#define GPIO_AF_TIM4	((uint8_t)0x02)
+#define GPIO_AF_TIM5	((uint8_t)0x02)
+#define GPIO_AF_TIM8	((uint8_t)0x03)
+#define GPIO_AF_TIM9	((uint8_t)0x03)
+#define GPIO_AF_TIM10	((uint8_t)0x03)
+#define GPIO_AF_TIM11	((uint8_t)0x03)
+#define GPIO_AF_TIM12	((uint8_t)0x09)
+#define GPIO_AF_TIM13	((uint8_t)0x09)
+#define GPIO_AF_TIM14	((uint8_t)0x09)
+#endif
+
+#define NONE	((uint8_t)0xFF)
+typedef enum { INPUT, OUTPUT, INPUT_PULLUP, INPUT_PULLDOWN, AF_OUTPUT_PUSHPULL, AN_INPUT } PinMode;
+typedef struct {
+	GPIO_TypeDef* gpio_peripheral;
+	uint16_t gpio_pin;
+	uint8_t adc_channel;
+	TIM_TypeDef* timer_peripheral;
+	uint16_t timer_ch;
+	PinMode pin_mode;
+} STM32_Pin_Info;
+STM32_Pin_Info* HAL_Pin_Map(void);
+
+enum { D0, D1, D2, D3, D4, D5, D6, D7, A0 = 10, A1, A2, A3, A4, A5, A6, A7, RX, TX, SIM_NUM_PINS };
+#define TOTAL_PINS	SIM_NUM_PINS
+enum { LOW = 0, HIGH = 1 };
+
+void pinMode(uint16_t pin, PinMode mode);
+void analogWrite(uint16_t pin, uint16_t value);
+void digitalWrite(uint16_t pin, uint8_t value);
+int32_t digitalRead(uint16_t pin);
+
+
+// ------------------------------------------------------------
+// ADC and DMA (configuration only)
+// ------------------------------------------------------------
+typedef struct {
+	volatile uint32_t SR, CR1, CR2, SMPR1, SMPR2, JOFR[4], HTR, LTR, SQR1, SQR2, SQR3, JSQR, JDR[4], DR;
+} ADC_TypeDef;
+extern ADC_TypeDef SIM_ADC1;
+#define ADC1	(&SIM_ADC1)
+
+typedef struct {
+	uint32_t ADC_Mode;
+	uint32_t ADC_Resolution;
+	FunctionalState ADC_ScanConvMode;
+	FunctionalState ADC_ContinuousConvMode;
+	uint32_t ADC_ExternalTrigConvEdge;
+	uint32_t ADC_ExternalTrigConv;
+	uint32_t ADC_DataAlign;
+	uint8_t ADC_NbrOfChannel;
+	uint8_t ADC_NbrOfConversion;
+} ADC_InitTypeDef;
+
+typedef struct {
+	uint32_t ADC_Mode;
+	uint32_t ADC_Prescaler;
+	uint32_t ADC_DMAAccessMode;
+	uint32_t ADC_TwoSamplingDelay;
+} ADC_CommonInitTypeDef;
+
+#define ADC_Mode_Independent				((uint32_t)0x00000000)
+#define ADC_DataAlign_Right					((uint32_t)0x00000000)
+#define ADC_Resolution_12b					((uint32_t)0x00000000)
+#define ADC_ExternalTrigConvEdge_Rising		((uint32_t)0x10000000)
+#define ADC_Prescaler_Div2					((uint32_t)0x00000000)
+#define ADC_DMAAccessMode_Disabled			((uint32_t)0x00000000)
+#define ADC_TwoSamplingDelay_5Cycles		((uint32_t)0x00000000)
+#define ADC_SampleTime_7Cycles5				((uint8_t)0x02)
+#define ADC_SampleTime_15Cycles				((uint8_t)0x01)
+#if defined(STM32F10X_MD)
+#define ADC_ExternalTrigConv_T2_CC2			((uint32_t)0x00060000)
+#define ADC_ExternalTrigConv_T3_TRGO		((uint32_t)0x00080000)
+#define ADC_ExternalTrigConv_T4_CC4			((uint32_t)0x000A0000)
+#else
+#define ADC_ExternalTrigConv_T3_TRGO		((uint32_t)0x08000000)
+#define ADC_ExternalTrigConv_T4_CC4			((uint32_t)0x09000000)
+#define ADC_ExternalTrigConv_T5_CC1			((uint32_t)0x0A000000)
+#define ADC_ExternalTrigConv_T1_CC1			((uint32_t)0x00000000)
+#define ADC_ExternalTrigConv_T8_TRGO		((uint32_t)0x0E000000)
+#endif
+
+void ADC_Init(ADC_TypeDef* ADCx, ADC_InitTypeDef* init);
+void ADC_RegularChannelConfig(ADC_TypeDef* ADCx, uint8_t channel, uint8_t rank, uint8_t sampleTime);
+void ADC_DMACmd(ADC_TypeDef* ADCx, FunctionalState state);
+void ADC_Cmd(ADC_TypeDef* ADCx, FunctionalState state);
+#if defined(STM32F10X_MD)
+void ADC_DeInit(ADC_TypeDef* ADCx);
+void ADC_ResetCalibration(ADC_TypeDef* ADCx);
+FlagStatus ADC_GetResetCalibrationStatus(ADC_TypeDef* ADCx);
+void ADC_StartCalibration(ADC_TypeDef* ADCx);
+FlagStatus ADC_GetCalibrationStatus(ADC_TypeDef* ADCx);
+void ADC_ExternalTrigConvCmd(ADC_TypeDef* ADCx, FunctionalState state);
+#else
+void ADC_DeInit(void);
+void ADC_CommonInit(ADC_CommonInitTypeDef* init);
+void ADC_DMARequestAfterLastTransferCmd(ADC_TypeDef* ADCx, FunctionalState state);
+#endif
+
+#define DMA_PeripheralInc_Disable			((uint32_t)0x00000000)
+#define DMA_M2M_Disable						((uint32_t)0x00000000)
+#define DMA_Priority_High					((uint32_t)0x00002000)
+#define DMA_Priority_VeryHigh				((uint32_t)0x00003000)
+
+#if defined(STM32F10X_MD)
+typedef struct { volatile uint32_t CCR, CNDTR, CPAR, CMAR; } DMA_Channel_TypeDef;
+typedef struct { volatile uint32_t ISR, IFCR; } DMA_TypeDef;
+extern DMA_Channel_TypeDef SIM_DMA1_Channel[8];
+extern DMA_TypeDef SIM_DMA1;
+#define DMA1			(&SIM_DMA1)
+#define DMA1_Channel1	(&SIM_DMA1_Channel[1])
+#define DMA1_Channel2	(&SIM_DMA1_Channel[2])
+#define DMA1_Channel3	(&SIM_DMA1_Channel[3])
+#define DMA1_Channel4	(&SIM_DMA1_Channel[4])
+#define DMA1_Channel5	(&SIM_DMA1_Channel[5])
+#define DMA1_Channel6	(&SIM_DMA1_Channel[6])
+#define DMA1_Channel7	(&SIM_DMA1_Channel[7])
+
+typedef struct {
+	uint32_t DMA_PeripheralBaseAddr;
+	uint32_t DMA_MemoryBaseAddr;
+	uint32_t DMA_DIR;
+	uint32_t DMA_BufferSize;
+	uint32_t DMA_PeripheralInc;
+	uint32_t DMA_MemoryInc;
+	uint32_t DMA_PeripheralDataSize;
+	uint32_t DMA_MemoryDataSize;
+	uint32_t DMA_Mode;
+	uint32_t DMA_Priority;
+	uint32_t DMA_M2M;
+} DMA_InitTypeDef;
+
+#define DMA_DIR_PeripheralDST				((uint32_t)0x00000010)
+#define DMA_DIR_PeripheralSRC				((uint32_t)0x00000000)
+#define DMA_MemoryInc_Enable				((uint32_t)0x00000080)
+#define DMA_PeripheralDataSize_HalfWord		((uint32_t)0x00000100)
+#define DMA_PeripheralDataSize_Word			((uint32_t)0x00000200)
+#define DMA_MemoryDataSize_HalfWord			((uint32_t)0x00000400)
+#define DMA_MemoryDataSize_Word				((uint32_t)0x00000800)
+#define DMA_Mode_Circular					((uint32_t)0x00000020)
+#define DMA_ISR_GIF1						((uint32_t)0x00000001)
+#define DMA_ISR_TCIF1						((uint32_t)0x00000002)
+#define DMA_ISR_HTIF1						((uint32_t)0x00000004)
+#define DMA1_FLAG_GL1						((uint32_t)0x00000001)
+
+void DMA_DeInit(DMA_Channel_TypeDef* channel);
+void DMA_Init(DMA_Channel_TypeDef* channel, DMA_InitTypeDef* init);
+void DMA_Cmd(DMA_Channel_TypeDef* channel, FunctionalState state);
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef* channel);
+void DMA_ClearFlag(uint32_t flags);
+#else
+typedef struct { volatile uint32_t CR, NDTR, PAR, M0AR, M1AR, FCR; } DMA_Stream_TypeDef;
+typedef struct { volatile uint32_t LISR, HISR, LIFCR, HIFCR; } DMA_TypeDef;
+extern DMA_Stream_TypeDef SIM_DMA1_Stream[8];
+extern DMA_Stream_TypeDef SIM_DMA2_Stream[8];
+extern DMA_TypeDef SIM_DMA1;
+extern DMA_TypeDef SIM_DMA2;
+#define DMA1			(&SIM_DMA1)
+#define DMA1_Stream0	(&SIM_DMA1_Stream[0])
+#define DMA1_Stream1	(&SIM_DMA1_Stream[1])
+#define DMA1_Stream2	(&SIM_DMA1_Stream[2])
+#define DMA1_Stream3	(&SIM_DMA1_Stream[3])
+#define DMA1_Stream4	(&SIM_DMA1_Stream[4])
+#define DMA1_Stream5	(&SIM_DMA1_Stream[5])
+#define DMA1_Stream6	(&SIM_DMA1_Stream[6])
+#define DMA1_Stream7	(&SIM_DMA1_Stream[7])
+#define DMA2			(&SIM_DMA2)
+#define DMA2_Stream0	(&SIM_DMA2_Stream[0])
+#define DMA2_Stream1	(&SIM_DMA2_Stream[1])
+#define DMA2_Stream2	(&SIM_DMA2_Stream[2])
+#define DMA2_Stream3	(&SIM_DMA2_Stream[3])
+#define DMA2_Stream4	(&SIM_DMA2_Stream[4])
+#define DMA2_Stream5	(&SIM_DMA2_Stream[5])
+#define DMA2_Stream6	(&SIM_DMA2_Stream[6])
+#define DMA2_Stream7	(&SIM_DMA2_Stream[7])
+
+typedef struct {
+	uint32_t DMA_Channel;
+	uint32_t DMA_PeripheralBaseAddr;
+	uint32_t DMA_Memory0BaseAddr;
+	uint32_t DMA_DIR;
+	uint32_t DMA_BufferSize;
+	uint32_t DMA_PeripheralInc;
+	uint32_t DMA_MemoryInc;
+	uint32_t DMA_PeripheralDataSize;
+	uint32_t DMA_MemoryDataSize;
+	uint32_t DMA_Mode;
+	uint32_t DMA_Priority;
+	uint32_t DMA_FIFOMode;
+	uint32_t DMA_FIFOThreshold;
+	uint32_t DMA_MemoryBurst;
+	uint32_t DMA_PeripheralBurst;
+} DMA_InitTypeDef;
+
+#define DMA_Channel_0						((uint32_t)0x00000000)
+#define DMA_Channel_2						((uint32_t)0x04000000)
+#define DMA_Channel_5						((uint32_t)0x0A000000)
+#define DMA_Channel_6						((uint32_t)0x0C000000)
+#define DMA_Channel_7						((uint32_t)0x0E000000)
+#define DMA_DIR_PeripheralToMemory			((uint32_t)0x00000000)
+#define DMA_DIR_MemoryToPeripheral			((uint32_t)0x00000040)
+#define DMA_MemoryInc_Enable				((uint32_t)0x00000400)
+#define DMA_PeripheralDataSize_HalfWord		((uint32_t)0x00000800)
+#define DMA_PeripheralDataSize_Word			((uint32_t)0x00001000)
+#define DMA_MemoryDataSize_HalfWord			((uint32_t)0x00002000)
+#define DMA_MemoryDataSize_Word				((uint32_t)0x00004000)
+#define DMA_Mode_Circular					((uint32_t)0x00000100)
+#define DMA_FIFOMode_Disable				((uint32_t)0x00000000)
+#define DMA_FIFOThreshold_HalfFull			((uint32_t)0x00000001)
+#define DMA_MemoryBurst_Single				((uint32_t)0x00000000)
+#define DMA_PeripheralBurst_Single			((uint32_t)0x00000000)
+#define DMA_FLAG_FEIF0						((uint32_t)0x10800001)
+#define DMA_FLAG_DMEIF0						((uint32_t)0x10800004)
+#define DMA_FLAG_TEIF0						((uint32_t)0x10000008)
+#define DMA_FLAG_HTIF0						((uint32_t)0x10000010)
+#define DMA_FLAG_TCIF0						((uint32_t)0x10000020)
+#define DMA_LISR_HTIF0						((uint32_t)0x00000010)
+#define DMA_LISR_TCIF0						((uint32_t)0x00000020)
+
+void DMA_DeInit(DMA_Stream_TypeDef* stream);
+void DMA_Init(DMA_Stream_TypeDef* stream, DMA_InitTypeDef* init);
+void DMA_Cmd(DMA_Stream_TypeDef* stream, FunctionalState state);
+uint16_t DMA_GetCurrDataCounter(DMA_Stream_TypeDef* stream);
+void DMA_ClearFlag(DMA_Stream_TypeDef* stream, uint32_t flags);
+#endif
+
+
+// ------------------------------------------------------------
+// System interrupts and time
+// ------------------------------------------------------------
+#define SIM_SYSINT_TIM(n)	\
+	SysInterrupt_TIM##n##_Update, SysInterrupt_TIM##n##_Trigger,	\
+	SysInterrupt_TIM##n##_Compare1, SysInterrupt_TIM##n##_Compare2,	\
+	SysInterrupt_TIM##n##_Compare3, SysInterrupt_TIM##n##_Compare4
+
+typedef enum {
+	SIM_SYSINT_TIM(1), SIM_SYSINT_TIM(2), SIM_SYSINT_TIM(3), SIM_SYSINT_TIM(4),
+	SIM_SYSINT_TIM(5), SIM_SYSINT_TIM(6), SIM_SYSINT_TIM(7), SIM_SYSINT_TIM(8),
+	SIM_SYSINT_TIM(9), SIM_SYSINT_TIM(10), SIM_SYSINT_TIM(11), SIM_SYSINT_TIM(12),
+	SIM_SYSINT_TIM(13), SIM_SYSINT_TIM(14),
+	SIM_NUM_SYSINT
+} hal_irq_t;
+
+#define SIM_SYSINT_PER_TIM	6
+
+bool attachSystemInterrupt(hal_irq_t irq, void (*handler)(void));
+bool detachSystemInterrupt(hal_irq_t irq);
+bool attachInterruptDirect(IRQn_Type irq, void (*handler)(void), bool enable = true);
+bool detachInterruptDirect(IRQn_Type irq, bool disable = true);
+
+extern uint32_t SystemCoreClock;
+
+// USB serial, written to stdout and never receiving
+class SIM_Serial {
+  public:
+	void begin(uint32_t) {}
+	int available(void) { return 0; }
+	int read(void) { return -1; }
+	size_t print(const char* s);
+	size_t println(const char* s);
+	size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+	size_t printlnf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+	size_t write(const uint8_t* buffer, size_t size);
+};
+extern SIM_Serial Serial;
+
+uint32_t micros(void);
+uint32_t millis(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void noInterrupts(void);
+void interrupts(void);
+
+#include "SparkIntervalSim.h"
+
+#endif
@@ -0,0 +1,301 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+// ------------------------------------------------------------
+// Host test of the SIT allocator.  Sixteen threads claim and
+// release slots at random while the main thread allocates
+// through begin(); a slot must never have two owners at once,
+// and all are free at the end.  Then, single threaded: specific
+// and pool allocation around claimed slots, and the move
+// constructor and assignment (take_SIT) handing a running SIT
+// over, the fractional mode callback included.  Last, the DMA
+// channel and stream reservations of the DMA drivers.  Prints
+// each failure, exits 1 if any.
+// ------------------------------------------------------------
+
+#include "SparkIntervalTimer.h"
+#include "SparkIntervalCapture.h"
+#include "SparkIntervalPattern.h"
+#include "SparkSampledADC.h"
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+const uint8_t POOL = 3;
+#else
+const uint8_t POOL = 13;
+#endif
+const int THREADS = 16;
+const int ROUNDS = 100000;		// claims tried per thread
+
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char* what, int line)
+{
+	if (!ok) {
+		printf("SparkIntervalAllocTest.cpp:%d: failed: %s\n", line, what);
+		failures++;
+	}
+}
+
+static uint8_t usedCount(void)
+{
+	uint8_t n = 0;
+	for (uint8_t id = 0; id < POOL; id++)
+		n += IntervalTimer::used_SIT(id);
+	return n;
+}
+
+volatile uint32_t hits, fracHits;
+void count(void) { hits++; }
+void fracCount(void) { fracHits++; }
+
+// ------------------------------------------------------------
+// Concurrent claims: owners counts the holders of each slot
+// ------------------------------------------------------------
+std::atomic<int> owners[POOL];
+std::atomic<long> claims(0), clashes(0);
+std::atomic<bool> go(false);
+std::atomic<int> finished(0);
+
+static void claimer(int seed)
+{
+	uint32_t r = seed * 2654435761u + 1;
+	while (!go)
+		std::this_thread::yield();
+	for (int i = 0; i < ROUNDS; i++) {
+		r = r * 1664525 + 1013904223;
+		uint8_t id = (r >> 16) % POOL;
+		if (!IntervalTimer::claim_SIT(id))
+			continue;
+		if (owners[id].fetch_add(1) != 0)
+			clashes++;
+		claims++;
+		owners[id].fetch_sub(1);
+		IntervalTimer::release_SIT(id);
+	}
+	finished++;
+}
+
+static void testConcurrent(void)
+{
+	std::vector<std::thread> threads;
+	for (int t = 0; t < THREADS; t++)
+		threads.emplace_back(claimer, t);
+
+	// the pool allocator races the claimers for the same slots
+	// while they run, and for a while on its own
+	IntervalTimer timer;
+	long begun = 0;
+	go = true;
+	for (int i = 0; i < ROUNDS / 10 || finished < THREADS; i++) {
+		if (!timer.begin(count, 1000, uSec))
+			continue;
+		int8_t id = timer.isAllocated_SIT();
+		if (owners[id].fetch_add(1) != 0)
+			clashes++;
+		begun++;
+		owners[id].fetch_sub(1);
+		timer.end();
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	CHECK(claims > 0);
+	CHECK(begun > 0);
+	CHECK(clashes == 0);
+	CHECK(usedCount() == 0);
+}
+
+// ------------------------------------------------------------
+// allocate_SIT: specific ids, the pool, and claimed slots
+// ------------------------------------------------------------
+static void testAllocate(void)
+{
+	// a claimed slot is refused by id and passed over by the pool
+	CHECK(IntervalTimer::claim_SIT(0));
+	CHECK(!IntervalTimer::claim_SIT(0));
+	IntervalTimer a;
+	CHECK(!a.begin(count, 1000, uSec, (TIMid)0));
+	CHECK(a.isAllocated_SIT() == -1);
+	CHECK(a.begin(count, 1000, uSec));
+	CHECK(a.isAllocated_SIT() == 1);
+	IntervalTimer::release_SIT(0);
+	CHECK(!IntervalTimer::used_SIT(0));
+	CHECK(IntervalTimer::used_SIT(1));
+
+	// the pool runs out, then a freed slot is reused
+	std::vector<IntervalTimer> pool(POOL);
+	uint8_t started = 0;
+	for (uint8_t i = 0; i < POOL; i++)
+		started += pool[i].begin(count, 1000, uSec);
+	CHECK(started == POOL - 1);
+	CHECK(usedCount() == POOL);
+	a.end();
+	CHECK(!IntervalTimer::used_SIT(1));
+	CHECK(pool[POOL - 1].begin(count, 1000, uSec));
+	CHECK(pool[POOL - 1].isAllocated_SIT() == 1);
+
+	// ids outside the pool
+	CHECK(!IntervalTimer::claim_SIT(POOL));
+	IntervalTimer::release_SIT(POOL);
+	CHECK(!IntervalTimer::used_SIT(POOL));
+	pool.clear();
+	CHECK(usedCount() == 0);
+}
+
+// ------------------------------------------------------------
+// take_SIT, through the move constructor and assignment
+// ------------------------------------------------------------
+static void testMove(void)
+{
+	IntervalTimer a, b;
+	CHECK(a.begin(count, 100, uSec));
+	CHECK(b.begin(count, 100, uSec));
+	int8_t ida = a.isAllocated_SIT();
+	int8_t idb = b.isAllocated_SIT();
+	CHECK(ida >= 0 && idb >= 0 && ida != idb);
+
+	// moved into a vector, and moved again when it grows
+	std::vector<IntervalTimer> v;
+	v.push_back(std::move(a));
+	CHECK(a.isAllocated_SIT() == -1);
+	CHECK(v[0].isAllocated_SIT() == ida);
+	v.emplace_back();
+	CHECK(v[1].beginFrequency(fracCount, 1000));
+	int8_t idf = v[1].isAllocated_SIT();
+	v.reserve(16);
+	CHECK(v[0].isAllocated_SIT() == ida);
+	CHECK(v[1].isAllocated_SIT() == idf);
+	CHECK(usedCount() == 3);
+
+	// the moved SITs keep running, the fractional one bound to its new object
+	hits = fracHits = 0;
+	SIT_Sim::advanceUs(100000);
+	CHECK(hits >= 1978 && hits <= 1982);		// two SITs of 101us
+	CHECK(fracHits == 100);
+
+	IntervalTimer c(std::move(v[1]));
+	CHECK(v[1].isAllocated_SIT() == -1);
+	CHECK(c.isAllocated_SIT() == idf);
+	fracHits = 0;
+	SIT_Sim::advanceUs(100000);
+	CHECK(fracHits == 100);
+	SIT_FractionalStats stats;
+	CHECK(c.fractionalStats(stats));
+
+	// assignment ends the target's SIT and takes the source's
+	v[0] = std::move(b);
+	CHECK(b.isAllocated_SIT() == -1);
+	CHECK(v[0].isAllocated_SIT() == idb);
+	CHECK(!IntervalTimer::used_SIT(ida));
+
+	// destroying moved-from objects frees nothing
+	v.clear();
+	CHECK(!IntervalTimer::used_SIT(idb));
+	CHECK(IntervalTimer::used_SIT(idf));
+	c.end();
+	CHECK(usedCount() == 0);
+}
+
+// ------------------------------------------------------------
+// DMA reservations: drivers needing the same channel or stream
+// on different timers exclude each other
+// ------------------------------------------------------------
+static void testDMA(void)
+{
+	uint32_t captureBuf[8], patternBuf[4] = { 0 };
+	uint16_t adcBuf[4];
+	const uint16_t adcPins[] = { A0 };
+	GPIO_TypeDef* port = HAL_Pin_Map()[D7].gpio_peripheral;
+	IntervalCapture capture;
+	IntervalPattern pattern;
+	SampledADC adc, adc2;
+
+	// ADC1's DMA allows one SampledADC
+	CHECK(adc.begin(adcPins, 1, adcBuf, 4, 100, uSec, TIMER3));
+	CHECK(!adc2.begin(adcPins, 1, adcBuf, 4, 100, uSec));
+	CHECK(IntervalTimer::usedDMA_SIT(PLATFORM_ID == 0 ? 1 : 2, PLATFORM_ID == 0 ? 1 : 0));
+
+#if PLATFORM_ID == 0
+	// TIMER4 CH1 captures on DMA1 channel 1, the ADC's
+	CHECK(!capture.begin(D1, captureBuf, 8, 100));
+	CHECK(!IntervalTimer::used_SIT(TIMER4));
+	adc.end();
+	CHECK(capture.begin(D1, captureBuf, 8, 100));
+	capture.end();
+
+	// TIMER2 CH2 captures on DMA1 channel 7, TIMER4's pattern channel
+	CHECK(pattern.begin(port, patternBuf, 4, 100, uSec, TIMER4));
+	CHECK(!capture.begin(A1, captureBuf, 8, 100));
+	CHECK(!IntervalTimer::used_SIT(TIMER2));
+	pattern.end();
+	CHECK(capture.begin(A1, captureBuf, 8, 100));
+	CHECK(!pattern.begin(port, patternBuf, 4, 100, uSec, TIMER4));
+	CHECK(pattern.begin(port, patternBuf, 4, 100, uSec));		// AUTO passes TIMER4 over
+	CHECK(pattern.isActive() && !IntervalTimer::used_SIT(TIMER4));
+	pattern.end();
+	capture.end();
+#else
+	adc.end();
+
+	// a stream reserved by other code: TIMER3 CH1 captures on DMA1 stream 4
+	CHECK(IntervalTimer::claimDMA_SIT(1, 4));
+	CHECK(!capture.begin(D3, captureBuf, 8, 100));
+	CHECK(!IntervalTimer::used_SIT(TIMER3));
+	IntervalTimer::releaseDMA_SIT(1, 4);
+	CHECK(capture.begin(D3, captureBuf, 8, 100));
+	CHECK(IntervalTimer::usedDMA_SIT(1, 4));
+	capture.end();
+
+	// TIMER8's pattern stream, DMA2 stream 1
+	CHECK(IntervalTimer::claimDMA_SIT(2, 1));
+	CHECK(!pattern.begin(port, patternBuf, 4, 100, uSec, TIMER8));
+	CHECK(pattern.begin(port, patternBuf, 4, 100, uSec));		// AUTO takes TIMER1
+	CHECK(pattern.isActive() && IntervalTimer::used_SIT(TIMER1));
+	pattern.end();
+	IntervalTimer::releaseDMA_SIT(2, 1);
+#endif
+
+	// out of range
+	CHECK(!IntervalTimer::claimDMA_SIT(0, 1));
+	CHECK(!IntervalTimer::claimDMA_SIT(3, 1));
+	CHECK(!IntervalTimer::claimDMA_SIT(1, 8));
+	for (uint8_t n = 0; n < 8; n++)
+		CHECK(!IntervalTimer::usedDMA_SIT(1, n) && !IntervalTimer::usedDMA_SIT(2, n));
+	CHECK(usedCount() == 0);
+}
+
+int main(void)
+{
+	testConcurrent();
+	testAllocate();
+	testMove();
+	testDMA();
+
+	printf("SparkIntervalAllocTest: %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,178 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+// ------------------------------------------------------------
+// Host benchmark of the library's control and dispatch paths
+// against the simulated registers.  Host times say nothing about
+// the device, but they move when the code does, so comparing runs
+// catches regressions.  Prints one JSON object per line with the
+// nanoseconds per operation over BATCHES batches.  Benches
+// ending in "_T" repeat an IntervalTimer one with IntervalTimerT.
+// ------------------------------------------------------------
+
+#include "SparkIntervalTimer.h"
+#include "SparkIntervalTimerT.h"
+#include "SparkIntervalScheduler.h"
+#include "SparkIntervalClock.h"
+#include "SparkIntervalCompare.h"
+#include <stdio.h>
+#include <chrono>
+
+const int BATCHES = 20;
+const int OPS = 20000;			// operations per batch
+
+IntervalTimer timer;
+IntervalScheduler scheduler;
+IntervalClock<> clock64;
+volatile uint64_t stamp;
+VirtualTimer virtuals[16] = {
+	scheduler, scheduler, scheduler, scheduler, scheduler, scheduler, scheduler, scheduler,
+	scheduler, scheduler, scheduler, scheduler, scheduler, scheduler, scheduler, scheduler
+};
+volatile uint32_t hits;
+IntervalCompare compare;
+CompareTimer channels[4] = { compare, compare, compare, compare };
+
+void count(void) { hits++; }
+
+IntervalTimerT<TIMER4, count> timerT;
+
+struct Member {
+	uint32_t n;
+	void tick() { n++; }
+};
+Member member;
+
+// runs op OPS times per batch and reports ns per op
+template <typename F>
+void bench(const char* name, F op) {
+	double min = 1e30, max = 0, sum = 0;
+	for (int b = 0; b < BATCHES; b++) {
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		for (int i = 0; i < OPS; i++)
+			op(i);
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / OPS;
+		sum += ns;
+		if (ns < min) min = ns;
+		if (ns > max) max = ns;
+	}
+	printf("{\"platform\":%d,\"bench\":\"%s\",\"unit\":\"ns\",\"n\":%d,\"min\":%.1f,\"mean\":%.1f,\"max\":%.1f}\n",
+		PLATFORM_ID, name, BATCHES * OPS, min, sum / BATCHES, max);
+}
+
+// sets the update flag and runs TIMER3's handler, as the NVIC would
+void dispatchTIM3(void) {
+	TIM3->SR.value |= TIM_SR_UIF;
+	Wiring_TIM3_Interrupt_Handler_override();
+}
+
+// the same for the IntervalTimerT on TIMER4, whose handler is its own
+void dispatchTIM4T(void) {
+	TIM4->SR.value |= TIM_SR_UIF;
+	timerT.isr();
+}
+
+int main(void) {
+	bench("begin_end", [](int) {
+		timer.begin(count, 1000, uSec);
+		timer.end();
+	});
+	bench("beginNs_end", [](int i) {
+		timer.beginNs(count, 1000000 + i);
+		timer.end();
+	});
+
+	timer.begin(count, 1000, uSec, TIMER3);
+	bench("resetPeriod_SIT", [](int i) {
+		timer.resetPeriod_SIT((i & 1) ? 500 : 1000, uSec);
+	});
+	bench("interrupt_SIT", [](int) {
+		timer.interrupt_SIT(INT_DISABLE);
+		timer.interrupt_SIT(INT_ENABLE);
+	});
+	bench("dispatch_plain", [](int) {
+		dispatchTIM3();
+	});
+	timer.begin(SIT_Delegate(&member, &Member::tick), 1000, uSec, TIMER3);
+	bench("dispatch_member", [](int) {
+		dispatchTIM3();
+	});
+	timer.deferred_SIT(true);
+	bench("dispatch_deferred", [](int) {
+		dispatchTIM3();
+	});
+	timer.deferred_SIT(false);
+	timer.end();
+
+	bench("begin_end_T", [](int) {
+		timerT.begin(1000, uSec);
+		timerT.end();
+	});
+	timerT.begin(1000, uSec);
+	bench("resetPeriod_SIT_T", [](int i) {
+		timerT.resetPeriod_SIT((i & 1) ? 500 : 1000, uSec);
+	});
+	bench("interrupt_SIT_T", [](int) {
+		timerT.interrupt_SIT(INT_DISABLE);
+		timerT.interrupt_SIT(INT_ENABLE);
+	});
+	bench("dispatch_plain_T", [](int) {
+		dispatchTIM4T();
+	});
+	timerT.end();
+
+	// all four channels of TIMER3 due in one interrupt
+	compare.begin(TIMER3);
+	for (int c = 0; c < 4; c++)
+		channels[c].begin(count, 1000, uSec);
+	bench("dispatch_compare4", [](int) {
+		TIM3->SR.value |= TIM_SR_CC1IF | TIM_SR_CC2IF | TIM_SR_CC3IF | TIM_SR_CC4IF;
+		IntervalCompare::dispatch_SIT(TIMER3);
+	});
+	compare.end();
+
+	bench("fireOnce_rearm", [](int i) {
+		timer.fireOnce(count, 100 + (i & 63));
+	});
+	timer.end();
+
+	clock64.begin();
+	bench("now64", [](int) {
+		stamp = clock64.now64();
+	});
+	clock64.end();
+
+	// simulated interrupts per host second, including the model
+	timer.begin(count, 10, uSec);
+	bench("sim_interrupt", [](int) {
+		SIT_Sim::advance(SIT_Sim::nextUpdate());
+	});
+	timer.end();
+
+	scheduler.begin();
+	for (int v = 0; v < 16; v++)
+		virtuals[v].begin(count, 100 + 37 * v, uSec);
+	bench("scheduler_interrupt", [](int) {
+		SIT_Sim::advance(SIT_Sim::nextUpdate());
+	});
+	scheduler.end();
+	return 0;
+}
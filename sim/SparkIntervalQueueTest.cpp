@@ -0,0 +1,228 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+// ------------------------------------------------------------
+// Host test of SIT_Queue.  Single threaded first: all N slots
+// usable, a full queue refusing and counting pushes, peek and
+// drain splitting at the end of the buffer.  Then a producer
+// thread standing in for the IntervalTimer callback and a
+// consumer thread standing in for loop(): once with a producer
+// that retries, where every value must arrive once and in
+// order through pop, peek/consume and drain, and once under
+// pressure, where the producer never waits and the consumer
+// stalls, so pushes fail.  There what arrives must be exactly
+// the accepted values, in order, and overflows() must count
+// every refusal.  make test also runs it built with
+// ThreadSanitizer.  Prints each failure, exits 1 if any.
+// ------------------------------------------------------------
+
+#include "SparkIntervalQueue.h"
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+const uint32_t ITEMS = 200000;		// values sent per threaded run
+
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char* what, int line)
+{
+	if (!ok) {
+		printf("SparkIntervalQueueTest.cpp:%d: failed: %s\n", line, what);
+		failures++;
+	}
+}
+
+// a torn or stale slot shows as check != ~seq
+struct Sample {
+	uint32_t seq;
+	uint32_t check;
+};
+
+static Sample sample(uint32_t seq)
+{
+	Sample s = { seq, ~seq };
+	return s;
+}
+
+// ------------------------------------------------------------
+// Capacity, overflow counting and wrap-around, one thread
+// ------------------------------------------------------------
+static void testSingle(void)
+{
+	SIT_Queue<uint32_t, 8> q;
+	uint32_t v;
+	const uint32_t* data;
+
+	CHECK(q.capacity() == 8 && q.available() == 0 && !q.pop(v));
+	for (uint32_t i = 0; i < 8; i++)
+		CHECK(q.push(i));
+	CHECK(!q.push(8) && !q.push(9));
+	CHECK(q.available() == 8 && q.overflows() == 2);
+
+	// take 5, refill 5: the unread 5..12 now wrap past the end
+	for (uint32_t i = 0; i < 5; i++)
+		CHECK(q.pop(v) && v == i);
+	for (uint32_t i = 8; i < 13; i++)
+		CHECK(q.push(i));
+	CHECK(q.available() == 8);
+	CHECK(q.peek(data) == 3 && data[0] == 5 && data[2] == 7);
+	q.consume(2);
+	CHECK(q.peek(data) == 1 && data[0] == 7);
+
+	uint32_t expect = 7, batches = 0;
+	bool inOrder = true;
+	uint32_t n = q.drain([&](const uint32_t* items, uint32_t count) {
+		batches++;
+		for (uint32_t i = 0; i < count; i++)
+			inOrder = inOrder && items[i] == expect++;
+	});
+	CHECK(n == 6 && batches == 2 && inOrder && expect == 13);
+	CHECK(q.available() == 0 && q.peek(data) == 0 && q.overflows() == 2);
+}
+
+// ------------------------------------------------------------
+// Producer retrying until each value is taken: nothing lost,
+// nothing reordered; the consumer rotates between pop,
+// peek/consume and drain
+// ------------------------------------------------------------
+static void testOrdered(void)
+{
+	SIT_Queue<Sample, 64> q;
+	std::atomic<bool> go(false);
+	uint32_t refused = 0;
+
+	std::thread producer([&]() {
+		while (!go)
+			std::this_thread::yield();
+		for (uint32_t i = 0; i < ITEMS; i++) {
+			while (!q.push(sample(i))) {
+				refused++;
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	uint32_t expect = 0, bad = 0;
+	auto take = [&](const Sample& s) {
+		if (s.seq != expect || s.check != ~expect)
+			bad++;
+		expect++;
+	};
+	go = true;
+	for (uint32_t round = 0; expect < ITEMS && bad == 0; round++) {
+		Sample s;
+		const Sample* data;
+		uint32_t count;
+
+		switch (round % 3) {
+		case 0:
+			if (q.pop(s))
+				take(s);
+			break;
+		case 1:
+			count = q.peek(data);
+			for (uint32_t i = 0; i < count; i++)
+				take(data[i]);
+			q.consume(count);
+			break;
+		default:
+			q.drain([&](const Sample* items, uint32_t n) {
+				for (uint32_t i = 0; i < n; i++)
+					take(items[i]);
+			});
+		}
+		if (round % 64 == 0)
+			std::this_thread::yield();
+	}
+	producer.join();
+
+	CHECK(bad == 0);
+	CHECK(expect == ITEMS);
+	CHECK(q.available() == 0);
+	CHECK(q.overflows() == refused);
+}
+
+// ------------------------------------------------------------
+// Producer never waiting, consumer stalling now and then: what
+// arrives is exactly the accepted values in order, and every
+// refusal is counted
+// ------------------------------------------------------------
+static void testPressure(void)
+{
+	SIT_Queue<Sample, 16> q;
+	std::vector<bool> accepted(ITEMS);
+	std::atomic<bool> go(false), done(false);
+
+	std::thread producer([&]() {
+		while (!go)
+			std::this_thread::yield();
+		for (uint32_t i = 0; i < ITEMS; i++) {
+			accepted[i] = q.push(sample(i));
+			if (i % 8 == 0)
+				std::this_thread::yield();
+		}
+		done = true;
+	});
+
+	std::vector<uint32_t> received;
+	uint32_t bad = 0;
+	go = true;
+	for (uint32_t round = 0; ; round++) {
+		bool finished = done;
+		Sample s;
+		while (q.pop(s)) {
+			if (s.check != ~s.seq || (!received.empty() && s.seq <= received.back()))
+				bad++;
+			received.push_back(s.seq);
+		}
+		if (finished)
+			break;
+		if (round % 64 == 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		else
+			std::this_thread::yield();
+	}
+	producer.join();
+
+	std::vector<uint32_t> expect;
+	for (uint32_t i = 0; i < ITEMS; i++)
+		if (accepted[i])
+			expect.push_back(i);
+	CHECK(bad == 0);
+	CHECK(received == expect);
+	CHECK(q.overflows() > 0);
+	CHECK(received.size() + q.overflows() == ITEMS);
+}
+
+int main(void)
+{
+	testSingle();
+	testOrdered();
+	testPressure();
+
+	printf("SparkIntervalQueueTest: %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,293 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+// ------------------------------------------------------------
+// Host test of IntervalScheduler and VirtualTimer, driven in
+// virtual time.  Every expiry is stamped with the scheduler's
+// own clock and the simulator's, and both must be exact: one-
+// shots in any order, periodic re-arm in phase, a callback
+// overrunning several periods (the missed ones are skipped,
+// the phase kept and the clock not lost, also past the 16 bit
+// counter span), cancels and re-arms from inside callbacks and
+// deadlines beyond one counter span.  Prints each failure,
+// exits 1 if any.
+// ------------------------------------------------------------
+
+#include "SparkIntervalScheduler.h"
+#include "SparkIntervalSim.h"
+#include <stdio.h>
+
+const uint32_t SPAN = 65536;		// the scheduler SIT's longest interval, us
+const int MAX_CALLS = 64;
+
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char* what, int line)
+{
+	if (!ok) {
+		printf("SparkIntervalSchedulerTest.cpp:%d: failed: %s\n", line, what);
+		failures++;
+	}
+}
+
+// ------------------------------------------------------------
+// Expiry log: which callback ran, on the scheduler's clock and
+// in simulated microseconds since the scheduler began
+// ------------------------------------------------------------
+struct Call {
+	char who;
+	uint32_t at;
+	uint32_t real;
+};
+
+static IntervalScheduler* sched;
+static uint32_t start;
+static Call calls[MAX_CALLS];
+static int ncalls;
+
+static uint32_t simMicros(void)
+{
+	return (uint32_t)(SIT_Sim::nanos() / 1000) - start;
+}
+
+static void begin(IntervalScheduler& s)
+{
+	sched = &s;
+	ncalls = 0;
+	CHECK(s.begin());
+	start = (uint32_t)(SIT_Sim::nanos() / 1000);
+}
+
+static void log(char who)
+{
+	if (ncalls < MAX_CALLS) {
+		calls[ncalls].who = who;
+		calls[ncalls].at = sched->now();
+		calls[ncalls].real = simMicros();
+	}
+	ncalls++;
+}
+
+// the log must read exactly who[i] at at[i] on both clocks
+static void expect(const char* who, const uint32_t* at, int n, int line)
+{
+	bool ok = ncalls == n;
+	for (int i = 0; ok && i < n; i++)
+		ok = calls[i].who == who[i] && calls[i].at == at[i] && calls[i].real == at[i];
+	if (!ok) {
+		printf("SparkIntervalSchedulerTest.cpp:%d: failed: expected", line);
+		for (int i = 0; i < n; i++)
+			printf(" %c@%u", who[i], at[i]);
+		printf(", got");
+		for (int i = 0; i < ncalls && i < MAX_CALLS; i++)
+			printf(" %c@%u/%u", calls[i].who, calls[i].at, calls[i].real);
+		printf("\n");
+		failures++;
+	}
+}
+
+#define EXPECT(who, ...) do { \
+		const uint32_t at[] = { __VA_ARGS__ }; \
+		expect(who, at, sizeof(at) / sizeof(at[0]), __LINE__); \
+	} while (0)
+
+// ------------------------------------------------------------
+// One-shots started out of order expire in deadline order at
+// their exact times, including two due together, then leave
+// the queue
+// ------------------------------------------------------------
+void logA(void) { log('A'); }
+void logB(void) { log('B'); }
+void logC(void) { log('C'); }
+void logD(void) { log('D'); }
+
+static void testOneShot(void)
+{
+	IntervalScheduler s;
+	VirtualTimer a(s), b(s), c(s), d(s);
+
+	begin(s);
+	CHECK(a.beginOnce(logA, 5000, uSec));
+	CHECK(b.beginOnce(logB, 120, uSec));
+	CHECK(c.beginOnce(logC, 3, hmSec));			// 1500us
+	CHECK(s.pending() == 3);
+	SIT_Sim::advanceUs(1000);
+	CHECK(d.beginOnce(logD, 500, uSec));		// due with c
+	SIT_Sim::advanceUs(9000);
+	CHECK(ncalls == 4 && calls[1].at == 1500 && calls[2].at == 1500);
+	if (calls[1].who == 'D') {
+		Call t = calls[1];
+		calls[1] = calls[2];
+		calls[2] = t;
+	}
+	EXPECT("BCDA", 120, 1500, 1500, 5000);
+	CHECK(!a.isActive() && !b.isActive() && !c.isActive() && !d.isActive());
+	CHECK(s.pending() == 0);
+	CHECK(s.now() == 10000 && simMicros() == 10000);
+}
+
+// ------------------------------------------------------------
+// Periodic re-arm: expiries stay on the grid of the start time
+// and resetPeriod_SIT restarts the interval from the call
+// ------------------------------------------------------------
+static void testPeriodic(void)
+{
+	IntervalScheduler s;
+	VirtualTimer a(s), b(s);
+
+	begin(s);
+	CHECK(a.begin(logA, 1000, uSec));
+	SIT_Sim::advanceUs(300);
+	CHECK(b.begin(logB, 1500, uSec));
+	SIT_Sim::advanceUs(3600);
+	EXPECT("ABAAB", 1000, 1800, 2000, 3000, 3300);
+	SIT_Sim::advanceUs(500);		// a next due at 5000, b at 4800
+	a.resetPeriod_SIT(250, uSec);
+	b.end();
+	SIT_Sim::advanceUs(600);
+	EXPECT("ABAABAAA", 1000, 1800, 2000, 3000, 3300, 4000, 4650, 4900);
+}
+
+// ------------------------------------------------------------
+// A callback overrunning the next expiries: the late expiry is
+// served as soon as the callback returns (after the shortest
+// programmable distance, 10us), the periods missed meanwhile
+// are skipped and the rest stay in phase.  The scheduler clock
+// must not lose the time, also when the callback runs past the
+// counter span.
+// ------------------------------------------------------------
+static uint32_t stall;
+
+void stallA(void)
+{
+	log('A');
+	if (ncalls == 3)
+		delayMicroseconds(stall);
+}
+
+static void testOverrun(void)
+{
+	IntervalScheduler s;
+	VirtualTimer a(s);
+
+	begin(s);
+	stall = 3500;
+	CHECK(a.begin(stallA, 1000, uSec));
+	SIT_Sim::advanceUs(9000);
+	EXPECT("AAAAAAA", 1000, 2000, 3000, 6510, 7000, 8000, 9000);
+	CHECK(s.now() == 9000);
+	a.end();
+
+	begin(s);
+	stall = SPAN + 30000;			// the update is pending on return
+	CHECK(a.begin(stallA, 1000, uSec));
+	SIT_Sim::advanceUs(102000);
+	EXPECT("AAAAAAAA", 1000, 2000, 3000, 98536, 99000, 100000, 101000, 102000);
+	CHECK(s.now() == 102000 && simMicros() == 102000);
+}
+
+// ------------------------------------------------------------
+// Cancels and re-arms from callbacks: A ends B (due at the next
+// tick) and, on its third call, itself; C re-arms itself as a
+// one-shot with a longer delay each time
+// ------------------------------------------------------------
+static VirtualTimer* ta;
+static VirtualTimer* tb;
+static VirtualTimer* tc;
+
+void cancelA(void)
+{
+	log('A');
+	tb->end();
+	if (ncalls == 3)
+		ta->end();
+}
+
+static uint32_t rearms;
+
+void rearmC(void)
+{
+	log('C');
+	if (++rearms < 3)
+		tc->beginOnce(rearmC, rearms * 1000, uSec);
+}
+
+static void testCancel(void)
+{
+	IntervalScheduler s;
+	VirtualTimer a(s), b(s), c(s);
+
+	ta = &a;
+	tb = &b;
+	tc = &c;
+	begin(s);
+	CHECK(a.begin(cancelA, 2000, uSec));
+	CHECK(b.begin(logB, 1500, uSec));
+	SIT_Sim::advanceUs(10000);
+	EXPECT("BAA", 1500, 2000, 4000);
+	CHECK(!a.isActive() && !b.isActive() && s.pending() == 0);
+
+	begin(s);
+	rearms = 0;
+	CHECK(c.beginOnce(rearmC, 500, uSec));
+	SIT_Sim::advanceUs(10000);
+	EXPECT("CCC", 500, 1500, 3500);
+	CHECK(!c.isActive() && s.pending() == 0);
+}
+
+// ------------------------------------------------------------
+// Deadlines past one counter span are reached through idle
+// wake-ups, without drift, alongside short ones; so is the
+// scheduler clock over a long idle stretch
+// ------------------------------------------------------------
+static void testLong(void)
+{
+	IntervalScheduler s;
+	VirtualTimer a(s), b(s), c(s);
+
+	begin(s);
+	CHECK(a.beginOnce(logA, 3 * SPAN + 123, uSec));
+	CHECK(b.begin(logB, 100000, uSec));
+	CHECK(c.begin(logC, 2 * SPAN + 5, hmSec));	// 65.5s: not before the end
+	SIT_Sim::advanceUs(299000);
+	EXPECT("BAB", 100000, 196731, 200000);
+	b.end();
+	SIT_Sim::advanceUs(10001000);
+	CHECK(s.now() == 10300000 && simMicros() == 10300000);
+	CHECK(ncalls == 3 && c.isActive());
+	SIT_Sim::advanceUs(55238500);
+	CHECK(ncalls == 4 && calls[3].who == 'C');
+	CHECK(calls[3].at == 65538500 && calls[3].real == 65538500);
+}
+
+int main(void)
+{
+	testOneShot();
+	testPeriodic();
+	testOverrun();
+	testCancel();
+	testLong();
+
+	printf("SparkIntervalSchedulerTest: %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,908 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include "Particle.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+TIM_TypeDef SIM_TIM[SIM_NUM_TIM];
+RCC_TypeDef SIM_RCC;
+DWT_Type SIM_DWT;
+CoreDebug_Type SIM_CoreDebug;
+ADC_TypeDef SIM_ADC1;
+#if defined(STM32F10X_MD)
+DMA_Channel_TypeDef SIM_DMA1_Channel[8];
+DMA_TypeDef SIM_DMA1;
+#else
+DMA_Stream_TypeDef SIM_DMA1_Stream[8];
+DMA_Stream_TypeDef SIM_DMA2_Stream[8];
+DMA_TypeDef SIM_DMA1;
+DMA_TypeDef SIM_DMA2;
+#endif
+
+// Per timer: counter width, IRQ lines (update, capture/compare) and
+// timer clocks per simulated clock
+struct SimTimerInfo {
+	uint32_t max;
+	IRQn_Type updateIrq;
+	IRQn_Type ccIrq;
+	uint32_t mul;
+};
+
+#if defined(STM32F10X_MD)		//Core: all counters are 16 bit, all timers at 72MHz
+static const SimTimerInfo simInfo[SIM_NUM_TIM] = {
+	{ 0, SIM_NUM_IRQn, SIM_NUM_IRQn, 1 },
+	{ 0xFFFF, TIM1_UP_TIM10_IRQn, TIM1_CC_IRQn, 1 },
+	{ 0xFFFF, TIM2_IRQn, TIM2_IRQn, 1 },
+	{ 0xFFFF, TIM3_IRQn, TIM3_IRQn, 1 },
+	{ 0xFFFF, TIM4_IRQn, TIM4_IRQn, 1 },
+};
+#else							//Photon: TIM2 and TIM5 are 32 bit, APB2 timers run at twice the APB1 clock
+static const SimTimerInfo simInfo[SIM_NUM_TIM] = {
+	{ 0, SIM_NUM_IRQn, SIM_NUM_IRQn, 1 },
+	{ 0xFFFF, TIM1_UP_TIM10_IRQn, TIM1_CC_IRQn, 2 },
+	{ 0xFFFFFFFF, TIM2_IRQn, TIM2_IRQn, 1 },
+	{ 0xFFFF, TIM3_IRQn, TIM3_IRQn, 1 },
+	{ 0xFFFF, TIM4_IRQn, TIM4_IRQn, 1 },
+	{ 0xFFFFFFFF, TIM5_IRQn, TIM5_IRQn, 1 },
+	{ 0xFFFF, TIM6_DAC_IRQn, TIM6_DAC_IRQn, 1 },
+	{ 0xFFFF, TIM7_IRQn, TIM7_IRQn, 1 },
+	{ 0xFFFF, TIM8_UP_TIM13_IRQn, TIM8_CC_IRQn, 2 },
+	{ 0xFFFF, TIM1_BRK_TIM9_IRQn, TIM1_BRK_TIM9_IRQn, 2 },
+	{ 0xFFFF, TIM1_UP_TIM10_IRQn, TIM1_UP_TIM10_IRQn, 2 },
+	{ 0xFFFF, TIM1_TRG_COM_TIM11_IRQn, TIM1_TRG_COM_TIM11_IRQn, 2 },
+	{ 0xFFFF, TIM8_BRK_TIM12_IRQn, TIM8_BRK_TIM12_IRQn, 1 },
+	{ 0xFFFF, TIM8_UP_TIM13_IRQn, TIM8_UP_TIM13_IRQn, 1 },
+	{ 0xFFFF, TIM8_TRG_COM_TIM14_IRQn, TIM8_TRG_COM_TIM14_IRQn, 1 },
+};
+#endif
+
+// Internal trigger inputs: the timer driving ITR0..3 of each timer,
+// 0 where the input is unconnected or the timer has no slave mode
+#if defined(STM32F10X_MD)		//Core
+static const uint8_t simITR[SIM_NUM_TIM][4] = {
+	{ 0, 0, 0, 0 },
+	{ 0, 2, 3, 4 },			// TIM1: TIM5 is not modelled on the Core
+	{ 1, 0, 3, 4 },			// TIM2: ITR1 is TIM8
+	{ 1, 2, 0, 4 },			// TIM3: ITR2 is TIM5
+	{ 1, 2, 3, 0 },			// TIM4: ITR3 is TIM8
+};
+#else
+static const uint8_t simITR[SIM_NUM_TIM][4] = {
+	{ 0, 0, 0, 0 },
+	{ 5, 2, 3, 4 },			// TIM1
+	{ 1, 8, 3, 4 },			// TIM2
+	{ 1, 2, 5, 4 },			// TIM3
+	{ 1, 2, 3, 8 },			// TIM4
+	{ 2, 3, 4, 8 },			// TIM5
+	{ 0, 0, 0, 0 },			// TIM6 and TIM7 are basic timers
+	{ 0, 0, 0, 0 },
+	{ 1, 2, 4, 5 },			// TIM8
+	{ 2, 3, 10, 11 },		// TIM9
+	{ 0, 0, 0, 0 },
+	{ 0, 0, 0, 0 },
+	{ 4, 5, 13, 14 },		// TIM12
+	{ 0, 0, 0, 0 },
+	{ 0, 0, 0, 0 },
+};
+#endif
+
+// Model state behind the registers
+struct SimTimer {
+	uint32_t psc;			// active (shadow) prescaler
+	uint32_t arr;			// shadow ARR, used when ARPE is set
+	uint32_t sub;			// prescaler count within the current tick
+	uint64_t updates;
+	uint64_t interrupts;
+};
+
+static SimTimer simTimer[SIM_NUM_TIM];
+static uint64_t simNow;
+static void (*simHandler[SIM_NUM_SYSINT])(void);
+static void (*simDirect[SIM_NUM_IRQn])(void);
+static bool irqEnabled[SIM_NUM_IRQn];
+static bool irqPending[SIM_NUM_IRQn];
+static uint8_t irqPriority[SIM_NUM_IRQn];
+static uint32_t activePriority = 256;		// priority of the running handler, 256 = thread
+static uint32_t primask;
+static uint8_t pinLevel[SIM_NUM_PINS];
+static uint32_t pinToggles[SIM_NUM_PINS];
+static STM32_Pin_Info pinMap[SIM_NUM_PINS];
+static GPIO_TypeDef simGPIOA, simGPIOB;
+
+// Status flags and the system interrupt each one raises
+static const uint32_t simFlag[SIM_SYSINT_PER_TIM] = {
+	TIM_SR_UIF, TIM_SR_TIF, TIM_SR_CC1IF, TIM_SR_CC2IF, TIM_SR_CC3IF, TIM_SR_CC4IF
+};
+
+
+// ------------------------------------------------------------
+// Timer model
+// ------------------------------------------------------------
+static bool simValid(uint8_t n) {
+	return n > 0 && n < SIM_NUM_TIM && simInfo[n].max != 0;
+}
+
+static uint8_t simIndex(const TIM_TypeDef* TIMx) {
+	return (uint8_t)(TIMx - SIM_TIM);
+}
+
+static uint32_t simARR(uint8_t n) {
+	if (!(SIM_TIM[n].CR1 & TIM_CR1_ARPE))
+		simTimer[n].arr = SIM_TIM[n].ARR & simInfo[n].max;
+	return simTimer[n].arr;
+}
+
+static bool simRunning(uint8_t n) {
+	return simValid(n) && (SIM_TIM[n].CR1 & TIM_CR1_CEN);
+}
+
+// the timer selected as trigger input in slave mode, or 0
+static uint8_t simMaster(uint8_t n) {
+	uint32_t ts = (SIM_TIM[n].SMCR & TIM_SMCR_TS) >> 4;
+	if (!(SIM_TIM[n].SMCR & TIM_SMCR_SMS) || ts > 3)
+		return 0;
+	return simITR[n][ts];
+}
+
+static bool simSlaveMode(uint8_t n, uint32_t mode) {
+	return (SIM_TIM[n].SMCR & TIM_SMCR_SMS) == mode;
+}
+
+// running on the timer clock rather than counting another timer's TRGO
+static bool simClocked(uint8_t n) {
+	return simRunning(n) && !simSlaveMode(n, TIM_SlaveMode_External1);
+}
+
+// timer clocks until the counter next rolls over from ARR to 0
+static uint64_t simTimerToUpdate(uint8_t n) {
+	uint64_t tick = (uint64_t)simTimer[n].psc + 1;
+	uint64_t cnt = SIM_TIM[n].CNT & simInfo[n].max;
+	uint64_t arr = simARR(n);
+	uint64_t counts = (cnt <= arr) ? arr - cnt + 1 : ((uint64_t)simInfo[n].max - cnt + 1) + arr + 1;
+	return counts * tick - simTimer[n].sub;
+}
+
+// simulated clocks until the update, rounded up
+static uint64_t simToUpdate(uint8_t n) {
+	return (simTimerToUpdate(n) + simInfo[n].mul - 1) / simInfo[n].mul;
+}
+
+#define SIM_CC_FLAGS	(TIM_SR_CC1IF | TIM_SR_CC2IF | TIM_SR_CC3IF | TIM_SR_CC4IF)
+
+// timer clocks until channel c next matches its compare, or 0 if
+// it is not modelled: only output channels with their interrupt
+// enabled are, and a CCR beyond ARR never matches
+static uint64_t simTimerToCompare(uint8_t n, uint8_t c) {
+	uint32_t ccmr = ((c < 2) ? SIM_TIM[n].CCMR1 : SIM_TIM[n].CCMR2) >> (8 * (c & 1));
+	if (!(SIM_TIM[n].DIER & (TIM_SR_CC1IF << c)) || (ccmr & 3))
+		return 0;
+	uint64_t tick = (uint64_t)simTimer[n].psc + 1;
+	uint64_t cnt = SIM_TIM[n].CNT & simInfo[n].max;
+	uint64_t arr = simARR(n);
+	uint64_t ccr = (&SIM_TIM[n].CCR1)[c] & simInfo[n].max;
+	if (ccr > arr)
+		return 0;
+	uint64_t counts = (ccr > cnt) ? ccr - cnt
+		: ((cnt <= arr) ? arr - cnt + 1 : (uint64_t)simInfo[n].max - cnt + 1) + ccr;
+	return counts * tick - simTimer[n].sub;
+}
+
+// simulated clocks until the next compare match, UINT64_MAX if none
+static uint64_t simToCompare(uint8_t n) {
+	uint64_t next = UINT64_MAX;
+	if (!(SIM_TIM[n].DIER & SIM_CC_FLAGS))
+		return next;
+	for (uint8_t c = 0; c < 4; c++) {
+		uint64_t clocks = simTimerToCompare(n, c);
+		uint64_t d = (clocks + simInfo[n].mul - 1) / simInfo[n].mul;
+		if (clocks && d < next)
+			next = d;
+	}
+	return next;
+}
+
+// CC flags of the channels matching within the next step clocks
+static uint32_t simMatches(uint8_t n, uint64_t step) {
+	uint32_t flags = 0;
+	if (!(SIM_TIM[n].DIER & SIM_CC_FLAGS))
+		return flags;
+	for (uint8_t c = 0; c < 4; c++) {
+		uint64_t clocks = simTimerToCompare(n, c);
+		if (clocks && (clocks + simInfo[n].mul - 1) / simInfo[n].mul <= step)
+			flags |= TIM_SR_CC1IF << c;
+	}
+	return flags;
+}
+
+// reinitialise counter and prescaler and load the shadow registers
+static void simReload(uint8_t n) {
+	SIM_TIM[n].CNT = 0;
+	simTimer[n].sub = 0;
+	simTimer[n].psc = SIM_TIM[n].PSC & 0xFFFF;
+	simTimer[n].arr = SIM_TIM[n].ARR & simInfo[n].max;
+}
+
+static void simTrgoUpdate(uint8_t m);
+
+// pins on channels in output compare toggle mode flip once per
+// counter period; where in the period is not modelled.  TIM1 and
+// TIM8 outputs are gated by MOE.
+static void simCompare(uint8_t n) {
+	if ((n == 1 || n == 8) && !(SIM_TIM[n].BDTR & TIM_BDTR_MOE))
+		return;
+	for (uint16_t pin = 0; pin < SIM_NUM_PINS; pin++) {
+		if (pinMap[pin].timer_peripheral != &SIM_TIM[n] || pinMap[pin].pin_mode != AF_OUTPUT_PUSHPULL)
+			continue;
+		uint8_t c = pinMap[pin].timer_ch >> 2;
+		uint32_t ccmr = ((c < 2) ? SIM_TIM[n].CCMR1 : SIM_TIM[n].CCMR2) >> (8 * (c & 1));
+		if ((ccmr & 0x73) == TIM_OCMode_Toggle && (SIM_TIM[n].CCER & (1u << (4 * c)))) {
+			pinLevel[pin] ^= 1;
+			pinToggles[pin]++;
+		}
+	}
+}
+
+static void simOverflow(uint8_t n) {
+	if (SIM_TIM[n].CR1 & TIM_CR1_UDIS) {
+		SIM_TIM[n].CNT = 0;
+		simTimer[n].sub = 0;
+		return;
+	}
+	simReload(n);
+	SIM_TIM[n].SR.value |= TIM_SR_UIF;
+	simTimer[n].updates++;
+	if (SIM_TIM[n].CR1 & TIM_CR1_OPM)
+		SIM_TIM[n].CR1 &= ~TIM_CR1_CEN;
+	if (SIM_TIM[n].CCER)
+		simCompare(n);
+	simTrgoUpdate(n);
+}
+
+// one TRGO pulse into a timer in external clock mode 1
+static void simTick(uint8_t n) {
+	if (++simTimer[n].sub <= simTimer[n].psc)
+		return;
+	simTimer[n].sub = 0;
+	if ((SIM_TIM[n].CNT & simInfo[n].max) == simARR(n))
+		simOverflow(n);
+	else
+		SIM_TIM[n].CNT = (SIM_TIM[n].CNT + 1) & simInfo[n].max;
+}
+
+// an update event on m clocks the slaves counting its TRGO = update
+static void simTrgoUpdate(uint8_t m) {
+	if ((SIM_TIM[m].CR2 & TIM_CR2_MMS) != TIM_TRGOSource_Update)
+		return;
+	for (uint8_t n = 1; n < SIM_NUM_TIM; n++) {
+		if (simRunning(n) && simSlaveMode(n, TIM_SlaveMode_External1) && simMaster(n) == m)
+			simTick(n);
+	}
+}
+
+// enabling m starts the slaves waiting in trigger mode on its
+// TRGO = enable; a slave started here may in turn start its own
+void SIT_Sim::control(TIM_TypeDef* TIMx, uint32_t before) {
+	uint8_t m = simIndex(TIMx);
+	if (!simValid(m) || (before & TIM_CR1_CEN) || !(TIMx->CR1 & TIM_CR1_CEN)
+			|| (TIMx->CR2 & TIM_CR2_MMS) != TIM_TRGOSource_Enable)
+		return;
+	for (uint8_t n = 1; n < SIM_NUM_TIM; n++) {
+		if (simValid(n) && simSlaveMode(n, TIM_SlaveMode_Trigger) && simMaster(n) == m)
+			SIM_TIM[n].CR1 |= TIM_CR1_CEN;
+	}
+}
+
+// moves a running timer forward by timer clocks, which must not pass its update
+static void simCount(uint8_t n, uint64_t clocks) {
+	uint64_t tick = (uint64_t)simTimer[n].psc + 1;
+	uint64_t total = simTimer[n].sub + clocks;
+	simTimer[n].sub = (uint32_t)(total % tick);
+	SIM_TIM[n].CNT = (uint32_t)((SIM_TIM[n].CNT + total / tick) & simInfo[n].max);
+}
+
+void SIT_Sim::generate(TIM_TypeDef* TIMx, uint32_t events) {
+	uint8_t n = simIndex(TIMx);
+	if (!simValid(n) || !(events & TIM_EGR_UG))
+		return;
+	simReload(n);
+	if (!(TIMx->CR1 & (TIM_CR1_URS | TIM_CR1_UDIS)))
+		TIMx->SR.value |= TIM_SR_UIF;
+	if (!(TIMx->CR1 & TIM_CR1_UDIS))
+		simTrgoUpdate(n);
+	service();
+}
+
+SIM_ControlReg& SIM_ControlReg::operator=(uint32_t v) {
+	uint32_t before = value;
+	value = v;
+	SIT_Sim::control((TIM_TypeDef*)((char*)this - offsetof(TIM_TypeDef, CR1)), before);
+	return *this;
+}
+
+SIM_EventReg& SIM_EventReg::operator=(uint32_t v) {
+	SIT_Sim::generate((TIM_TypeDef*)((char*)this - offsetof(TIM_TypeDef, EGR)), v);
+	return *this;
+}
+
+
+// ------------------------------------------------------------
+// Interrupt model: an IRQ is active when it is pending or one of
+// its timers has an enabled flag set.  The most urgent active IRQ
+// that beats the running priority is taken, and its handler may
+// in turn be preempted by anything more urgent it raises.
+// ------------------------------------------------------------
+static bool simActive(int irq) {
+	if (irqPending[irq])
+		return true;
+	for (uint8_t n = 1; n < SIM_NUM_TIM; n++) {
+		if (!simValid(n) || (simInfo[n].updateIrq != irq && simInfo[n].ccIrq != irq))
+			continue;
+		uint32_t flags = SIM_TIM[n].SR & SIM_TIM[n].DIER;
+		if (simInfo[n].updateIrq == irq && (flags & TIM_SR_UIF))
+			return true;
+		if (simInfo[n].ccIrq == irq && (flags & ~(uint32_t)TIM_SR_UIF))
+			return true;
+	}
+	return false;
+}
+
+// Vector table entries outside the timers, weak as in the startup
+// code so a program may claim a spare line by defining its handler
+extern "C" void CAN1_SCE_IRQHandler(void) __attribute__((weak));
+extern "C" void FSMC_IRQHandler(void) __attribute__((weak));
+
+static void simDispatch(int irq) {
+	irqPending[irq] = false;
+	void (*vector)(void) = simDirect[irq];
+	if (vector == NULL && irq == CAN1_SCE_IRQn)
+		vector = CAN1_SCE_IRQHandler;
+	if (vector == NULL && irq == FSMC_IRQn)
+		vector = FSMC_IRQHandler;
+	if (vector != NULL) {
+		vector();
+		return;
+	}
+	for (uint8_t n = 1; n < SIM_NUM_TIM; n++) {
+		if (!simValid(n) || (simInfo[n].updateIrq != irq && simInfo[n].ccIrq != irq))
+			continue;
+		simTimer[n].interrupts++;
+		for (int f = 0; f < SIM_SYSINT_PER_TIM; f++) {
+			bool line = (f == 0) ? simInfo[n].updateIrq == irq : simInfo[n].ccIrq == irq;
+			void (*handler)(void) = simHandler[(n - 1) * SIM_SYSINT_PER_TIM + f];
+			if (line && handler && (SIM_TIM[n].SR & SIM_TIM[n].DIER & simFlag[f]))
+				handler();
+		}
+	}
+}
+
+void SIT_Sim::service(void) {
+	// a handler that leaves its flag set would fire forever; give up
+	for (int guard = 0; guard < 1000 && !primask; guard++) {
+		int best = -1;
+		for (int irq = 0; irq < SIM_NUM_IRQn; irq++) {
+			if (irqEnabled[irq] && irqPriority[irq] < activePriority && simActive(irq)
+					&& (best < 0 || irqPriority[irq] < irqPriority[best]))
+				best = irq;
+		}
+		if (best < 0)
+			return;
+
+		uint32_t saved = activePriority;
+		activePriority = irqPriority[best];
+		SIM_DWT.CYCCNT = (uint32_t)(simNow * (SIM_CPU_CLOCK / 1000) / (SIM_TIMER_CLOCK / 1000));
+		simDispatch(best);
+		activePriority = saved;
+	}
+}
+
+
+// ------------------------------------------------------------
+// Virtual time.  reset() returns the peripherals and the clock
+// to power-on state but keeps attached system interrupts, which
+// the library registers from its constructors.
+// ------------------------------------------------------------
+void SIT_Sim::reset(void) {
+	memset(SIM_TIM, 0, sizeof(SIM_TIM));
+	memset(simTimer, 0, sizeof(simTimer));
+	memset(irqEnabled, 0, sizeof(irqEnabled));
+	memset(irqPending, 0, sizeof(irqPending));
+	memset(irqPriority, 0, sizeof(irqPriority));
+	memset(pinLevel, 0, sizeof(pinLevel));
+	memset(pinToggles, 0, sizeof(pinToggles));
+	simNow = 0;
+	activePriority = 256;
+	primask = 0;
+}
+
+uint64_t SIT_Sim::now(void) {
+	return simNow;
+}
+
+uint64_t SIT_Sim::nanos(void) {
+	return simNow / SIM_TIMER_CLOCK * 1000000000ULL + simNow % SIM_TIMER_CLOCK * 1000000000ULL / SIM_TIMER_CLOCK;
+}
+
+uint64_t SIT_Sim::nextUpdate(void) {
+	uint64_t next = UINT64_MAX;
+	for (uint8_t n = 1; n < SIM_NUM_TIM; n++) {
+		if (simClocked(n)) {
+			uint64_t d = simToUpdate(n);
+			if (d < next)
+				next = d;
+		}
+	}
+	return next;
+}
+
+void SIT_Sim::advance(uint64_t clocks) {
+	uint64_t target = simNow + clocks;
+
+	service();
+	for (;;) {
+		uint64_t step = nextUpdate();
+		for (uint8_t n = 1; n < SIM_NUM_TIM; n++) {
+			uint64_t d = simClocked(n) ? simToCompare(n) : UINT64_MAX;
+			if (d < step)
+				step = d;
+		}
+		if (step == UINT64_MAX || step > target - simNow)
+			step = target - simNow;
+
+		bool overflow[SIM_NUM_TIM] = { false };
+		uint64_t carry[SIM_NUM_TIM] = { 0 };		// timer clocks past the update within the step
+		uint32_t matched[SIM_NUM_TIM] = { 0 };		// compare flags raised within the step
+		for (uint8_t n = 1; n < SIM_NUM_TIM; n++) {
+			if (!simClocked(n))
+				continue;
+			matched[n] = simMatches(n, step);
+			if (simToUpdate(n) == step) {
+				overflow[n] = true;
+				carry[n] = step * simInfo[n].mul - simTimerToUpdate(n);
+			}
+			else
+				simCount(n, step * simInfo[n].mul);
+		}
+		simNow += step;
+		SIM_DWT.CYCCNT = (uint32_t)(simNow * (SIM_CPU_CLOCK / 1000) / (SIM_TIMER_CLOCK / 1000));
+		for (uint8_t n = 1; n < SIM_NUM_TIM; n++) {
+			SIM_TIM[n].SR.value |= matched[n];
+			if (!overflow[n])
+				continue;
+			simOverflow(n);
+			if (carry[n] && simClocked(n))
+				simCount(n, carry[n]);
+		}
+		service();
+		// a handler that delays moves time on itself, maybe past target
+		if (simNow >= target)
+			break;
+	}
+}
+
+void SIT_Sim::advanceNs(uint64_t ns) {
+	uint64_t end = nanos() + ns;
+	uint64_t clocks = end / 1000000000ULL * SIM_TIMER_CLOCK + (end % 1000000000ULL) * SIM_TIMER_CLOCK / 1000000000ULL;
+	if (clocks > simNow)
+		advance(clocks - simNow);
+}
+
+uint64_t SIT_Sim::updates(TIM_TypeDef* TIMx) {
+	return simTimer[simIndex(TIMx)].updates;
+}
+
+uint64_t SIT_Sim::interrupts(TIM_TypeDef* TIMx) {
+	return simTimer[simIndex(TIMx)].interrupts;
+}
+
+uint32_t SIT_Sim::toggles(uint16_t pin) {
+	return pin < SIM_NUM_PINS ? pinToggles[pin] : 0;
+}
+
+uint32_t micros(void) {
+	return (uint32_t)(SIT_Sim::nanos() / 1000);
+}
+
+uint32_t millis(void) {
+	return (uint32_t)(SIT_Sim::nanos() / 1000000);
+}
+
+uint32_t SystemCoreClock = SIM_CPU_CLOCK;
+SIM_Serial Serial;
+
+size_t SIM_Serial::print(const char* s) {
+	return fputs(s, stdout) >= 0 ? strlen(s) : 0;
+}
+
+size_t SIM_Serial::println(const char* s) {
+	return print(s) + print("\n");
+}
+
+size_t SIM_Serial::write(const uint8_t* buffer, size_t size) {
+	return fwrite(buffer, 1, size, stdout);
+}
+
+size_t SIM_Serial::printf(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int n = vprintf(format, args);
+	va_end(args);
+	return n > 0 ? n : 0;
+}
+
+size_t SIM_Serial::printlnf(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int n = vprintf(format, args);
+	va_end(args);
+	return (n > 0 ? n : 0) + print("\n");
+}
+
+void delay(uint32_t ms) {
+	SIT_Sim::advanceNs((uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(uint32_t us) {
+	SIT_Sim::advanceUs(us);
+}
+
+
+// ------------------------------------------------------------
+// StdPeriph timer functions
+// ------------------------------------------------------------
+void TIM_TimeBaseInit(TIM_TypeDef* TIMx, TIM_TimeBaseInitTypeDef* init) {
+	TIMx->CR1 &= ~(uint32_t)0x0370;		// DIR, CMS, CKD
+	TIMx->CR1 |= init->TIM_CounterMode | init->TIM_ClockDivision;
+	TIMx->ARR = init->TIM_Period;
+	TIMx->PSC = init->TIM_Prescaler;
+	TIMx->RCR = init->TIM_RepetitionCounter;
+	TIMx->EGR = TIM_PSCReloadMode_Immediate;
+}
+
+void TIM_DeInit(TIM_TypeDef* TIMx) {
+	uint8_t n = simIndex(TIMx);
+	uint64_t updates = simTimer[n].updates, interrupts = simTimer[n].interrupts;
+	memset((void*)TIMx, 0, sizeof(*TIMx));
+	memset(&simTimer[n], 0, sizeof(simTimer[n]));
+	simTimer[n].updates = updates;
+	simTimer[n].interrupts = interrupts;
+}
+
+void TIM_Cmd(TIM_TypeDef* TIMx, FunctionalState state) {
+	if (state) TIMx->CR1 |= TIM_CR1_CEN;
+	else TIMx->CR1 &= ~TIM_CR1_CEN;
+}
+
+void TIM_ITConfig(TIM_TypeDef* TIMx, uint16_t it, FunctionalState state) {
+	if (state) TIMx->DIER |= it;
+	else TIMx->DIER &= ~(uint32_t)it;
+	SIT_Sim::service();
+}
+
+ITStatus TIM_GetITStatus(TIM_TypeDef* TIMx, uint16_t it) {
+	return ((TIMx->SR & it) && (TIMx->DIER & it)) ? SET : RESET;
+}
+
+void TIM_ClearITPendingBit(TIM_TypeDef* TIMx, uint16_t it) {
+	TIMx->SR = (uint16_t)~it;
+}
+
+void TIM_DMACmd(TIM_TypeDef* TIMx, uint16_t source, FunctionalState state) {
+	if (state) TIMx->DIER |= source;
+	else TIMx->DIER &= ~(uint32_t)source;
+}
+
+void TIM_SelectOutputTrigger(TIM_TypeDef* TIMx, uint16_t source) {
+	TIMx->CR2 = (TIMx->CR2 & ~(uint32_t)TIM_CR2_MMS) | source;
+}
+
+void TIM_SelectInputTrigger(TIM_TypeDef* TIMx, uint16_t source) {
+	TIMx->SMCR = (TIMx->SMCR & ~(uint32_t)TIM_SMCR_TS) | source;
+}
+
+void TIM_SelectSlaveMode(TIM_TypeDef* TIMx, uint16_t mode) {
+	TIMx->SMCR = (TIMx->SMCR & ~(uint32_t)TIM_SMCR_SMS) | mode;
+}
+
+void TIM_ITRxExternalClockConfig(TIM_TypeDef* TIMx, uint16_t source) {
+	TIM_SelectInputTrigger(TIMx, source);
+	TIMx->SMCR |= TIM_SlaveMode_External1;
+}
+
+void TIM_OCStructInit(TIM_OCInitTypeDef* init) {
+	memset(init, 0, sizeof(*init));
+}
+
+void TIM_OC1Init(TIM_TypeDef* TIMx, TIM_OCInitTypeDef* init) {
+	TIMx->CCMR1 = (TIMx->CCMR1 & ~(uint32_t)0x00FF) | init->TIM_OCMode;
+	TIMx->CCER = (TIMx->CCER & ~(uint32_t)0x000F) | init->TIM_OutputState | (init->TIM_OCPolarity);
+	TIMx->CCR1 = init->TIM_Pulse;
+}
+
+void TIM_OC2Init(TIM_TypeDef* TIMx, TIM_OCInitTypeDef* init) {
+	TIMx->CCMR1 = (TIMx->CCMR1 & ~(uint32_t)0xFF00) | ((uint32_t)init->TIM_OCMode << 8);
+	TIMx->CCER = (TIMx->CCER & ~(uint32_t)0x00F0) | ((uint32_t)(init->TIM_OutputState | init->TIM_OCPolarity) << 4);
+	TIMx->CCR2 = init->TIM_Pulse;
+}
+
+void TIM_OC3Init(TIM_TypeDef* TIMx, TIM_OCInitTypeDef* init) {
+	TIMx->CCMR2 = (TIMx->CCMR2 & ~(uint32_t)0x00FF) | init->TIM_OCMode;
+	TIMx->CCER = (TIMx->CCER & ~(uint32_t)0x0F00) | ((uint32_t)(init->TIM_OutputState | init->TIM_OCPolarity) << 8);
+	TIMx->CCR3 = init->TIM_Pulse;
+}
+
+void TIM_OC4Init(TIM_TypeDef* TIMx, TIM_OCInitTypeDef* init) {
+	TIMx->CCMR2 = (TIMx->CCMR2 & ~(uint32_t)0xFF00) | ((uint32_t)init->TIM_OCMode << 8);
+	TIMx->CCER = (TIMx->CCER & ~(uint32_t)0xF000) | ((uint32_t)(init->TIM_OutputState | init->TIM_OCPolarity) << 12);
+	TIMx->CCR4 = init->TIM_Pulse;
+}
+
+// the given channel on its own input, the other one on the same
+// input with the opposite edge; filter and prescaler not modelled
+void TIM_PWMIConfig(TIM_TypeDef* TIMx, TIM_ICInitTypeDef* init) {
+	uint32_t other = (init->TIM_ICPolarity == TIM_ICPolarity_Rising) ? TIM_ICPolarity_Falling : TIM_ICPolarity_Rising;
+	uint32_t cc1s = TIM_ICSelection_DirectTI, cc1p = init->TIM_ICPolarity;
+	uint32_t cc2s = TIM_ICSelection_IndirectTI, cc2p = other;
+	if (init->TIM_Channel == TIM_Channel_2) {
+		cc1s = TIM_ICSelection_IndirectTI;
+		cc1p = other;
+		cc2s = TIM_ICSelection_DirectTI;
+		cc2p = init->TIM_ICPolarity;
+	}
+	TIMx->CCMR1 = cc1s | (cc2s << 8);
+	TIMx->CCER = (TIMx->CCER & ~(uint32_t)0x00FF) | 0x0001 | cc1p | ((0x0001 | cc2p) << 4);
+}
+
+void TIM_CtrlPWMOutputs(TIM_TypeDef* TIMx, FunctionalState state) {
+	if (state) TIMx->BDTR |= TIM_BDTR_MOE;
+	else TIMx->BDTR &= ~(uint32_t)TIM_BDTR_MOE;
+}
+
+void TIM_DMAConfig(TIM_TypeDef* TIMx, uint16_t base, uint16_t length) {
+	TIMx->DCR = base | length;
+}
+
+
+// ------------------------------------------------------------
+// NVIC, PRIMASK and system interrupts.  Priorities are kept as
+// the preemption level; the sim uses a single priority group.
+// ------------------------------------------------------------
+void NVIC_Init(NVIC_InitTypeDef* init) {
+	if (init->NVIC_IRQChannelCmd) {
+		irqPriority[init->NVIC_IRQChannel] = init->NVIC_IRQChannelPreemptionPriority;
+		NVIC_EnableIRQ((IRQn_Type)init->NVIC_IRQChannel);
+	}
+	else
+		NVIC_DisableIRQ((IRQn_Type)init->NVIC_IRQChannel);
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq) {
+	irqEnabled[irq] = true;
+	SIT_Sim::service();
+}
+
+void NVIC_DisableIRQ(IRQn_Type irq) {
+	irqEnabled[irq] = false;
+}
+
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority) {
+	irqPriority[irq] = (uint8_t)priority;
+	SIT_Sim::service();
+}
+
+uint32_t NVIC_GetPriority(IRQn_Type irq) {
+	return irqPriority[irq];
+}
+
+uint32_t NVIC_GetPriorityGrouping(void) {
+	return 3;		// all bits preempt
+}
+
+uint32_t NVIC_EncodePriority(uint32_t, uint32_t preempt, uint32_t) {
+	return preempt & 0x0F;
+}
+
+void NVIC_SetPendingIRQ(IRQn_Type irq) {
+	irqPending[irq] = true;
+	SIT_Sim::service();
+}
+
+void NVIC_ClearPendingIRQ(IRQn_Type irq) {
+	irqPending[irq] = false;
+}
+
+uint32_t __get_PRIMASK(void) {
+	return primask;
+}
+
+void __set_PRIMASK(uint32_t mask) {
+	primask = mask & 1;
+	SIT_Sim::service();
+}
+
+void __disable_irq(void) {
+	primask = 1;
+}
+
+void __enable_irq(void) {
+	__set_PRIMASK(0);
+}
+
+void noInterrupts(void) {
+	__disable_irq();
+}
+
+void interrupts(void) {
+	__enable_irq();
+}
+
+bool attachSystemInterrupt(hal_irq_t irq, void (*handler)(void)) {
+	simHandler[irq] = handler;
+	return true;
+}
+
+bool detachSystemInterrupt(hal_irq_t irq) {
+	simHandler[irq] = NULL;
+	return true;
+}
+
+bool attachInterruptDirect(IRQn_Type irq, void (*handler)(void), bool enable) {
+	simDirect[irq] = handler;
+	if (enable)
+		NVIC_EnableIRQ(irq);
+	return true;
+}
+
+bool detachInterruptDirect(IRQn_Type irq, bool disable) {
+	if (disable)
+		NVIC_DisableIRQ(irq);
+	simDirect[irq] = NULL;
+	return true;
+}
+
+
+// ------------------------------------------------------------
+// RCC, pins, ADC and DMA: state only
+// ------------------------------------------------------------
+void RCC_APB1PeriphClockCmd(uint32_t periph, FunctionalState state) {
+	if (state) SIM_RCC.APB1ENR |= periph; else SIM_RCC.APB1ENR &= ~periph;
+}
+void RCC_APB2PeriphClockCmd(uint32_t periph, FunctionalState state) {
+	if (state) SIM_RCC.APB2ENR |= periph; else SIM_RCC.APB2ENR &= ~periph;
+}
+void RCC_AHBPeriphClockCmd(uint32_t periph, FunctionalState state) {
+	if (state) SIM_RCC.AHBENR |= periph; else SIM_RCC.AHBENR &= ~periph;
+}
+void RCC_AHB1PeriphClockCmd(uint32_t periph, FunctionalState state) {
+	if (state) SIM_RCC.AHBENR |= periph; else SIM_RCC.AHBENR &= ~periph;
+}
+void RCC_ADCCLKConfig(uint32_t) {}
+
+// Timer channel behind each PWM capable pin
+struct SimPinTimer {
+	uint16_t pin;
+	TIM_TypeDef* TIMx;
+	uint16_t channel;
+};
+
+#if defined(STM32F10X_MD)		//Core
+static const SimPinTimer simPinTimer[] = {
+	{ D0, TIM4, TIM_Channel_2 }, { D1, TIM4, TIM_Channel_1 },
+	{ A0, TIM2, TIM_Channel_1 }, { A1, TIM2, TIM_Channel_2 },
+	{ A4, TIM3, TIM_Channel_1 }, { A5, TIM3, TIM_Channel_2 },
+	{ A6, TIM3, TIM_Channel_3 }, { A7, TIM3, TIM_Channel_4 },
+	{ RX, TIM2, TIM_Channel_4 }, { TX, TIM2, TIM_Channel_3 },
+};
+#else							//Photon
+static const SimPinTimer simPinTimer[] = {
+	{ D0, TIM4, TIM_Channel_2 }, { D1, TIM4, TIM_Channel_1 },
+	{ D2, TIM3, TIM_Channel_2 }, { D3, TIM3, TIM_Channel_1 },
+	{ A4, TIM3, TIM_Channel_1 }, { A5, TIM3, TIM_Channel_2 },
+	{ A7, TIM5, TIM_Channel_1 },
+	{ RX, TIM1, TIM_Channel_3 }, { TX, TIM1, TIM_Channel_2 },
+};
+#endif
+
+// D0-D7 on port B, A0-A7 on port A with ADC channels 0-7, RX and
+// TX on port A without ADC channels.  Built once so pin modes stick.
+STM32_Pin_Info* HAL_Pin_Map(void) {
+	static bool built = false;
+	if (built)
+		return pinMap;
+	built = true;
+	for (uint16_t pin = 0; pin < SIM_NUM_PINS; pin++) {
+		bool analog = pin >= A0;
+		pinMap[pin].gpio_peripheral = analog ? &simGPIOA : &simGPIOB;
+		pinMap[pin].gpio_pin = (uint16_t)(1 << (pin % 8));
+		pinMap[pin].adc_channel = (analog && pin <= A7) ? (uint8_t)(pin - A0) : NONE;
+		pinMap[pin].timer_peripheral = NULL;
+		pinMap[pin].pin_mode = INPUT;
+	}
+	for (size_t i = 0; i < sizeof(simPinTimer) / sizeof(simPinTimer[0]); i++) {
+		pinMap[simPinTimer[i].pin].timer_peripheral = simPinTimer[i].TIMx;
+		pinMap[simPinTimer[i].pin].timer_ch = simPinTimer[i].channel;
+	}
+	return pinMap;
+}
+
+void pinMode(uint16_t pin, PinMode mode) {
+	if (pin < SIM_NUM_PINS)
+		HAL_Pin_Map()[pin].pin_mode = mode;
+}
+
+// records the pin as a running PWM output; the duty cycle is not modelled
+void analogWrite(uint16_t pin, uint16_t) {
+	if (pin < SIM_NUM_PINS && HAL_Pin_Map()[pin].timer_peripheral != NULL)
+		pinMap[pin].pin_mode = AF_OUTPUT_PUSHPULL;
+}
+
+void digitalWrite(uint16_t pin, uint8_t value) {
+	if (pin >= SIM_NUM_PINS)
+		return;
+	if ((value != 0) != (pinLevel[pin] != 0))
+		pinToggles[pin]++;
+	pinLevel[pin] = value != 0;
+}
+
+int32_t digitalRead(uint16_t pin) {
+	return pin < SIM_NUM_PINS ? pinLevel[pin] : 0;
+}
+
+void ADC_Init(ADC_TypeDef* ADCx, ADC_InitTypeDef* init) { ADCx->CR2 = init->ADC_ExternalTrigConv; }
+void ADC_RegularChannelConfig(ADC_TypeDef*, uint8_t, uint8_t, uint8_t) {}
+void ADC_DMACmd(ADC_TypeDef*, FunctionalState) {}
+void ADC_Cmd(ADC_TypeDef*, FunctionalState) {}
+#if defined(STM32F10X_MD)
+void ADC_DeInit(ADC_TypeDef* ADCx) { memset((void*)ADCx, 0, sizeof(*ADCx)); }
+void ADC_ResetCalibration(ADC_TypeDef*) {}
+FlagStatus ADC_GetResetCalibrationStatus(ADC_TypeDef*) { return RESET; }
+void ADC_StartCalibration(ADC_TypeDef*) {}
+FlagStatus ADC_GetCalibrationStatus(ADC_TypeDef*) { return RESET; }
+void ADC_ExternalTrigConvCmd(ADC_TypeDef*, FunctionalState) {}
+
+void DMA_DeInit(DMA_Channel_TypeDef* channel) { memset((void*)channel, 0, sizeof(*channel)); }
+void DMA_Init(DMA_Channel_TypeDef* channel, DMA_InitTypeDef* init) {
+	channel->CNDTR = init->DMA_BufferSize;
+	channel->CPAR = init->DMA_PeripheralBaseAddr;
+	channel->CMAR = init->DMA_MemoryBaseAddr;
+}
+void DMA_Cmd(DMA_Channel_TypeDef* channel, FunctionalState state) {
+	if (state) channel->CCR |= 1; else channel->CCR &= ~1u;
+}
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef* channel) { return (uint16_t)channel->CNDTR; }
+void DMA_ClearFlag(uint32_t flags) { SIM_DMA1.ISR &= ~flags; }
+#else
+void ADC_DeInit(void) { memset((void*)&SIM_ADC1, 0, sizeof(SIM_ADC1)); }
+void ADC_CommonInit(ADC_CommonInitTypeDef*) {}
+void ADC_DMARequestAfterLastTransferCmd(ADC_TypeDef*, FunctionalState) {}
+
+void DMA_DeInit(DMA_Stream_TypeDef* stream) { memset((void*)stream, 0, sizeof(*stream)); }
+void DMA_Init(DMA_Stream_TypeDef* stream, DMA_InitTypeDef* init) {
+	stream->NDTR = init->DMA_BufferSize;
+	stream->PAR = init->DMA_PeripheralBaseAddr;
+	stream->M0AR = init->DMA_Memory0BaseAddr;
+}
+void DMA_Cmd(DMA_Stream_TypeDef* stream, FunctionalState state) {
+	if (state) stream->CR |= 1; else stream->CR &= ~1u;
+}
+uint16_t DMA_GetCurrDataCounter(DMA_Stream_TypeDef* stream) { return (uint16_t)stream->NDTR; }
+void DMA_ClearFlag(DMA_Stream_TypeDef*, uint32_t flags) { SIM_DMA2.LIFCR = flags; }
+#endif
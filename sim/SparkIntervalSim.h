@@ -0,0 +1,78 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __SIT_SIM_H__
+#define __SIT_SIM_H__
+
+#include <stdint.h>
+
+#if defined(STM32F10X_MD)
+#define SIM_TIMER_CLOCK		72000000UL		// APB1 timer clock
+#define SIM_CPU_CLOCK		72000000UL
+#else
+#define SIM_TIMER_CLOCK		60000000UL
+#define SIM_CPU_CLOCK		120000000UL
+#endif
+
+// ------------------------------------------------------------
+// Discrete-event model of the timers and NVIC behind the host
+// build.  Virtual time only moves in advance() (and delay()), in
+// units of the timer input clock, jumping straight from one
+// update event to the next; code runs in zero virtual time.
+//
+// Each counting timer is modelled register by register: PSC and
+// (with ARPE) ARR are shadowed and loaded at update events, UG
+// reloads immediately, URS, UDIS and OPM are honoured, and a
+// counter above ARR runs to its full width before wrapping.
+// Timers are linked through TRGO and the ITR inputs: a slave in
+// trigger mode starts when its master is enabled (MMS = enable)
+// and one in external clock mode 1 counts its master's update
+// events (MMS = update).  The few clocks of trigger
+// resynchronisation real slaves take are not modelled.  Output
+// compare channels with their interrupt enabled set CCxIF when
+// the counter reaches CCRx, as a further event (counters clocked
+// by another timer raise none).  At each update or compare the
+// timer's IRQ is taken if DIER and the NVIC allow it; handlers
+// run to completion, and an IRQ raised from code is taken at once
+// if its priority beats the one running.
+// ------------------------------------------------------------
+class SIT_Sim {
+  public:
+	static void reset(void);
+
+	static uint64_t now(void);						// timer clocks since reset
+	static uint64_t nanos(void);
+	static void advance(uint64_t clocks);
+	static void advanceNs(uint64_t ns);
+	static void advanceUs(uint32_t us) { advanceNs((uint64_t)us * 1000); }
+	static uint64_t nextUpdate(void);				// clocks to the next update event
+
+	static uint64_t updates(TIM_TypeDef* TIMx);		// update events since reset
+	static uint64_t interrupts(TIM_TypeDef* TIMx);	// IRQs taken for this timer
+	static uint32_t toggles(uint16_t pin);			// level changes by digitalWrite or toggle mode
+
+	// hooks used by the register and StdPeriph models
+	static void generate(TIM_TypeDef* TIMx, uint32_t events);
+	static void control(TIM_TypeDef* TIMx, uint32_t before);
+	static void service(void);
+};
+
+#endif
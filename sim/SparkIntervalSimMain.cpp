@@ -0,0 +1,58 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+// ------------------------------------------------------------
+// Runs a Particle sketch against the simulator: setup() once,
+// then loop() once per simulated millisecond.  The simulated run
+// time in seconds is the first argument (default 10).  Prints
+// the update events, interrupts and pin toggles seen.
+// ------------------------------------------------------------
+
+#include "Particle.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+void setup(void);
+void loop(void);
+
+int main(int argc, char** argv) {
+	double seconds = (argc > 1) ? atof(argv[1]) : 10.0;
+	uint64_t end = (uint64_t)(seconds * 1e9);
+
+	setup();
+	while (SIT_Sim::nanos() < end) {
+		loop();
+		SIT_Sim::advanceUs(1000);
+	}
+
+	printf("simulated %.3f s\n", SIT_Sim::nanos() / 1e9);
+	for (int n = 1; n < SIM_NUM_TIM; n++) {
+		if (SIT_Sim::updates(&SIM_TIM[n]) || SIT_Sim::interrupts(&SIM_TIM[n]))
+			printf("TIM%-2d  %10llu updates %10llu interrupts\n", n,
+				(unsigned long long)SIT_Sim::updates(&SIM_TIM[n]),
+				(unsigned long long)SIT_Sim::interrupts(&SIM_TIM[n]));
+	}
+	for (int pin = 0; pin < SIM_NUM_PINS; pin++) {
+		if (SIT_Sim::toggles(pin))
+			printf("pin %-2d %10lu toggles\n", pin, (unsigned long)SIT_Sim::toggles(pin));
+	}
+	return 0;
+}
@@ -0,0 +1,148 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+// ------------------------------------------------------------
+// Host test of the PSC/ARR solver, against 16 bit and 32 bit
+// reload limits.  Fixed cases are static_asserts, so they are
+// also proof the solver runs at compile time: exact fits, with
+// and without a search past the smallest divider, periods that
+// need rounding, the largest period each counter can make and
+// targets with no solution.  Then, at run time, properties of
+// a sweep of targets: the registers are in range and produce
+// the stated clocks, and the error is within half a divider.
+// Prints each failure, exits 1 if any.
+// ------------------------------------------------------------
+
+#include "SparkIntervalSolver.h"
+#include <stdio.h>
+
+const uint32_t MAX16 = UINT16_MAX;
+const uint32_t MAX32 = UINT32_MAX;
+const uint64_t SPAN16 = (uint64_t)MAX16 + 1;
+const uint64_t SPAN32 = (uint64_t)MAX32 + 1;
+
+static constexpr bool solves(uint64_t clocks, uint32_t maxReload,
+	uint32_t prescaler, uint32_t reload, uint64_t achieved)
+{
+	return SIT_Solver::solve(clocks, maxReload).prescaler == prescaler
+		&& SIT_Solver::solve(clocks, maxReload).reload == reload
+		&& SIT_Solver::solve(clocks, maxReload).clocks == achieved;
+}
+
+// exact fits: in the counter at divider 1, and 1s at 120MHz, which
+// on a 16 bit counter first fits at divider 1832 but only divides
+// exactly at 1875
+static_assert(solves(1000, MAX16, 0, 999, 1000), "1000 clocks, 16 bit");
+static_assert(solves(SPAN16, MAX16, 0, MAX16, SPAN16), "full 16 bit count");
+static_assert(solves(120000000, MAX16, 1874, 63999, 120000000), "1s at 120MHz, 16 bit");
+static_assert(solves(120000000, MAX32, 0, 119999999, 120000000), "1s at 120MHz, 32 bit");
+
+// rounding: 65537 is prime, so a 16 bit counter is one clock out
+// and the tie goes to the smallest divider; 1000003 is prime too
+static_assert(solves(65537, MAX16, 1, 32768, 65538), "65537 clocks, 16 bit");
+static_assert(solves(65537, MAX32, 0, 65536, 65537), "65537 clocks, 32 bit");
+static_assert(solves(1000003, MAX16, 52, 18867, 1000004), "1000003 clocks, 16 bit");
+
+// the largest periods, reached exactly and by rounding up to them
+static_assert(solves(SPAN16 * SIT_Solver::MAX_DIVIDER, MAX16, 65535, MAX16, SPAN16 * 65536), "largest, 16 bit");
+static_assert(solves(SPAN16 * SIT_Solver::MAX_DIVIDER - 1, MAX16, 65535, MAX16, SPAN16 * 65536), "largest - 1, 16 bit");
+static_assert(solves(SPAN32 * SIT_Solver::MAX_DIVIDER, MAX32, 65535, MAX32, SPAN32 * 65536), "largest, 32 bit");
+static_assert(solves(SPAN32 * SIT_Solver::MAX_DIVIDER - 1, MAX32, 65535, MAX32, SPAN32 * 65536), "largest - 1, 32 bit");
+
+// no solution: a zero period, or past the largest
+static_assert(!SIT_Solver::solve(0, MAX16).valid(), "0 clocks, 16 bit");
+static_assert(!SIT_Solver::solve(0, MAX32).valid(), "0 clocks, 32 bit");
+static_assert(!SIT_Solver::solve(SPAN16 * SIT_Solver::MAX_DIVIDER + 1, MAX16).valid(), "past largest, 16 bit");
+static_assert(!SIT_Solver::solve(SPAN32 * SIT_Solver::MAX_DIVIDER + 1, MAX32).valid(), "past largest, 32 bit");
+static_assert(!SIT_Solver::solveHz(0, 60000000, MAX16).valid(), "0Hz");
+
+// conversions round to the nearest clock
+static_assert(SIT_Solver::clocksFromNs(1500, 1000000) == 2, "1.5us at 1MHz");
+static_assert(SIT_Solver::clocksFromNs(1499, 1000000) == 1, "1.499us at 1MHz");
+static_assert(SIT_Solver::clocksFromNs(3600000000000ULL, 120000000) == 432000000000ULL, "1h at 120MHz");
+static_assert(SIT_Solver::clocksFromHz(3, 60000000) == 20000000, "3Hz at 60MHz");
+static_assert(SIT_Solver::solveNs(1000000, 60000000, MAX16).nanoseconds(60000000) == 1000000, "1ms at 60MHz");
+
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char* what, int line)
+{
+	if (!ok) {
+		printf("SparkIntervalSolverTest.cpp:%d: failed: %s\n", line, what);
+		failures++;
+	}
+}
+
+// ------------------------------------------------------------
+// One target: every valid answer must be realisable and within
+// half a divider, the rounding of the smallest usable divider
+// ------------------------------------------------------------
+static void testTarget(uint64_t clocks, uint32_t maxReload)
+{
+	SIT_Solution sol = SIT_Solver::solve(clocks, maxReload);
+	uint64_t span = (uint64_t)maxReload + 1;
+
+	if (clocks == 0 || clocks > span * SIT_Solver::MAX_DIVIDER) {
+		CHECK(!sol.valid());
+		return;
+	}
+	CHECK(sol.valid());
+	CHECK(sol.prescaler < SIT_Solver::MAX_DIVIDER);
+	CHECK(sol.reload <= maxReload);
+	CHECK(sol.clocks == ((uint64_t)sol.prescaler + 1) * ((uint64_t)sol.reload + 1));
+
+	uint64_t first = (clocks + span - 1) / span;
+	uint64_t error = sol.clocks > clocks ? sol.clocks - clocks : clocks - sol.clocks;
+	CHECK(error <= first / 2);
+	if (clocks <= span)
+		CHECK(error == 0 && sol.prescaler == 0);
+}
+
+static void testSweep(uint32_t maxReload)
+{
+	uint64_t span = (uint64_t)maxReload + 1;
+	uint64_t largest = span * SIT_Solver::MAX_DIVIDER;
+	uint64_t x = 88172645463325252ULL;
+
+	for (int i = 0; i < 20000; i++) {
+		// xorshift, spread over every bit length up to the largest period
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		uint64_t limit = largest >> (i % 48);
+		testTarget(x % (limit ? limit : 1) + 1, maxReload);
+	}
+	testTarget(span - 1, maxReload);
+	testTarget(span + 1, maxReload);
+	testTarget(largest, maxReload);
+	testTarget(largest + 1, maxReload);
+}
+
+int main(void)
+{
+	testSweep(MAX16);
+	testSweep(MAX32);
+
+	printf("SparkIntervalSolverTest: %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+// ------------------------------------------------------------
+// Host decoder for SIT trace dumps (SIT_Trace::dump, see
+// SparkIntervalTrace.h), to Chrome trace event JSON for
+// chrome://tracing or Perfetto: one track per SIT, update
+// interrupts and deferred callbacks as slices lasting the
+// callback, the other events as instants.  The command line
+// tool is SparkIntervalTraceDecodeMain.cpp.
+//
+// Stamps are unwrapped from each event to the next, so gaps of
+// more than 2^31 CPU cycles (about 18s on the Photon) between
+// consecutive events are not recovered.
+// ------------------------------------------------------------
+
+#include "SparkIntervalTraceDecode.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char* const EVENT_NAMES[] = {
+	"start", "stop", "period", "enable", "disable", "update", "deferred", "overrun"
+};
+
+// name of each event's value in the JSON args, NULL for none
+static const char* const VALUE_NAMES[] = {
+	"period_us", NULL, "period_us", NULL, "tripped", "cycles", "cycles", "updates"
+};
+
+// SIT ids to timers, as in the TIMid enum
+static const char* timerName(uint8_t platform, uint8_t id)
+{
+	static const char* const CORE[] = { "TIMER2", "TIMER3", "TIMER4" };
+	static const char* const PHOTON[] = { "TIMER3", "TIMER4", "TIMER5", "TIMER6", "TIMER7", "TIMER1",
+		"TIMER8", "TIMER9", "TIMER10", "TIMER11", "TIMER12", "TIMER13", "TIMER14" };
+
+	if (platform == 0)
+		return id < 3 ? CORE[id] : "?";
+	return id < 13 ? PHOTON[id] : "?";
+}
+
+// ------------------------------------------------------------
+// Decodes a whole dump into JSON.  Returns false and sets error
+// if the blob is not a trace dump or is cut short.
+// ------------------------------------------------------------
+bool decodeTrace(const std::vector<uint8_t>& blob, std::string& json, std::string& error)
+{
+	SIT_TraceHeader header;
+
+	if (blob.size() < sizeof(header)) {
+		error = "too short for a trace header";
+		return false;
+	}
+	memcpy(&header, blob.data(), sizeof(header));
+	if (memcmp(header.magic, "SITT", 4) != 0) {
+		error = "not a SIT trace (bad magic)";
+		return false;
+	}
+	if (header.version != SIT_TRACE_VERSION || header.eventSize != sizeof(SIT_TraceEvent)) {
+		error = "unsupported trace version or event size";
+		return false;
+	}
+	if (header.clock == 0) {
+		error = "trace clock is 0";
+		return false;
+	}
+	if (blob.size() < sizeof(header) + (uint64_t)header.count * sizeof(SIT_TraceEvent)) {
+		error = "trace cut short";
+		return false;
+	}
+
+	char line[256];
+	bool seen[16] = { false };
+	int64_t t = 0;
+	uint32_t previous = 0;
+	double usPerCycle = 1e6 / header.clock;
+
+	snprintf(line, sizeof(line), "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"platform\":%u,\"clock\":%u,\"events\":%u,\"lost\":%u},\"traceEvents\":[",
+		header.platform, header.clock, header.count, header.lost);
+	json = line;
+	for (uint32_t i = 0; i < header.count; i++) {
+		SIT_TraceEvent e;
+		memcpy(&e, blob.data() + sizeof(header) + i * sizeof(e), sizeof(e));
+		if (i > 0)
+			t += (int32_t)(e.stamp - previous);
+		previous = e.stamp;
+
+		uint8_t type = e.type();
+		uint8_t id = e.id();
+		if (!seen[id]) {
+			seen[id] = true;
+			snprintf(line, sizeof(line), "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"SIT %u (%s)\"}},",
+				id, id, timerName(header.platform, id));
+			json += line;
+		}
+
+		const char* name = type < sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0]) ? EVENT_NAMES[type] : "unknown";
+		const char* valueName = type < sizeof(VALUE_NAMES) / sizeof(VALUE_NAMES[0]) ? VALUE_NAMES[type] : "value";
+		int n;
+		if (type == SIT_TRACE_UPDATE || type == SIT_TRACE_DEFERRED)
+			n = snprintf(line, sizeof(line), "\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+				name, id, t * usPerCycle, e.value() * usPerCycle);
+		else
+			n = snprintf(line, sizeof(line), "\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%u,\"ts\":%.3f",
+				name, id, t * usPerCycle);
+		if (valueName != NULL)
+			snprintf(line + n, sizeof(line) - n, ",\"args\":{\"%s\":%u%s}},", valueName, e.value(),
+				e.value() == SIT_TRACE_MAX_VALUE ? ",\"saturated\":true" : "");
+		else
+			snprintf(line + n, sizeof(line) - n, "},");
+		json += line;
+	}
+	if (json[json.size() - 1] == ',')
+		json.erase(json.size() - 1);
+	json += "\n]}\n";
+	return true;
+}
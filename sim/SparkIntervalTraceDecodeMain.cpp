@@ -0,0 +1,55 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+// ------------------------------------------------------------
+// Command line trace decoder: reads a SIT trace dump from a
+// file or stdin and writes its JSON to stdout.
+//
+//   SparkIntervalTraceDecode trace.bin > trace.json
+// ------------------------------------------------------------
+
+#include "SparkIntervalTraceDecode.h"
+#include <stdio.h>
+
+int main(int argc, char** argv)
+{
+	FILE* in = stdin;
+	if (argc > 1 && (in = fopen(argv[1], "rb")) == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	std::vector<uint8_t> blob;
+	uint8_t buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+		blob.insert(blob.end(), buffer, buffer + n);
+	if (in != stdin)
+		fclose(in);
+
+	std::string json, error;
+	if (!decodeTrace(blob, json, error)) {
+		fprintf(stderr, "SparkIntervalTraceDecode: %s\n", error.c_str());
+		return 1;
+	}
+	fputs(json.c_str(), stdout);
+	return 0;
+}
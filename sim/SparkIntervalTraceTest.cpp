@@ -0,0 +1,219 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+// ------------------------------------------------------------
+// Host test of the trace ring and decoder.  Synthetic dumps
+// cover the decoder's edge cases: stamps wrapping at 2^32, out
+// of order stamps, saturated values, unknown event types and
+// rejected blobs.  A dump of a real ring, from a library built
+// with SIT_ENABLE_TRACE and a 16 event ring, checks overflow:
+// the oldest events are counted as lost and the rest come out
+// oldest first.  Prints each failure, exits 1 if any.
+// ------------------------------------------------------------
+
+#include "SparkIntervalTimer.h"
+#include "SparkIntervalTraceDecode.h"
+#include <stdio.h>
+#include <string.h>
+
+#if !SIT_ENABLE_TRACE || SIT_TRACE_EVENTS != 16
+#error "build with -DSIT_ENABLE_TRACE=1 -DSIT_TRACE_EVENTS=16 (see make test)"
+#endif
+
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char* what, int line)
+{
+	if (!ok) {
+		printf("SparkIntervalTraceTest.cpp:%d: failed: %s\n", line, what);
+		failures++;
+	}
+}
+
+static bool contains(const std::string& s, const char* what)
+{
+	return s.find(what) != std::string::npos;
+}
+
+// builds a dump of events {stamp, type, id, value}
+struct Blob {
+	std::vector<uint8_t> bytes;
+
+	Blob(uint8_t platform = 6, uint32_t clock = 120000000, uint32_t lost = 0) {
+		SIT_TraceHeader header = { { 'S', 'I', 'T', 'T' }, SIT_TRACE_VERSION, platform,
+			sizeof(SIT_TraceEvent), clock, 0, lost };
+		write((const uint8_t*)&header, sizeof(header));
+	}
+	SIT_TraceHeader& header() { return *(SIT_TraceHeader*)bytes.data(); }
+	Blob& event(uint32_t stamp, uint8_t type, uint8_t id, uint32_t value) {
+		SIT_TraceEvent e = { stamp, SIT_TraceEvent::pack(type, id, value) };
+		write((const uint8_t*)&e, sizeof(e));
+		header().count++;
+		return *this;
+	}
+	// the Out of SIT_Trace::dump
+	size_t write(const uint8_t* data, size_t n) {
+		bytes.insert(bytes.end(), data, data + n);
+		return n;
+	}
+};
+
+static std::string decode(const Blob& blob, bool expectOk = true)
+{
+	std::string json, error;
+	bool ok = decodeTrace(blob.bytes, json, error);
+	check(ok == expectOk, expectOk ? "decodes" : "is rejected", __LINE__);
+	return ok ? json : error;
+}
+
+// ------------------------------------------------------------
+// Synthetic dumps
+// ------------------------------------------------------------
+static void testWrap(void)
+{
+	// 512 cycles from 0xFFFFFF00 across 2^32, at 120MHz
+	std::string json = decode(Blob()
+		.event(0xFFFFFF00, SIT_TRACE_START, 2, 500)
+		.event(0x00000100, SIT_TRACE_UPDATE, 2, 120));
+	CHECK(contains(json, "\"ts\":0.000"));
+	CHECK(contains(json, "\"ph\":\"X\",\"pid\":0,\"tid\":2,\"ts\":4.267,\"dur\":1.000"));
+	CHECK(contains(json, "\"name\":\"SIT 2 (TIMER5)\""));
+}
+
+static void testOutOfOrder(void)
+{
+	// a nested ISR's event recorded after a later one steps back
+	std::string json = decode(Blob()
+		.event(1200, SIT_TRACE_UPDATE, 0, 10)
+		.event(1080, SIT_TRACE_UPDATE, 1, 10)
+		.event(1320, SIT_TRACE_UPDATE, 0, 10));
+	CHECK(contains(json, "\"tid\":0,\"ts\":0.000"));
+	CHECK(contains(json, "\"tid\":1,\"ts\":-1.000"));
+	CHECK(contains(json, "\"tid\":0,\"ts\":1.000"));
+}
+
+static void testSaturated(void)
+{
+	std::string json = decode(Blob()
+		.event(0, SIT_TRACE_UPDATE, 0, 0x12345678)		// packed to the maximum
+		.event(10, SIT_TRACE_UPDATE, 0, SIT_TRACE_MAX_VALUE - 1));
+	CHECK(contains(json, "\"cycles\":16777215,\"saturated\":true"));
+	CHECK(contains(json, "\"cycles\":16777214}"));
+}
+
+static void testUnknownType(void)
+{
+	std::string json = decode(Blob(0, 72000000).event(0, 9, 1, 3));
+	CHECK(contains(json, "\"name\":\"unknown\",\"ph\":\"i\""));
+	CHECK(contains(json, "\"args\":{\"value\":3}"));
+	CHECK(contains(json, "\"name\":\"SIT 1 (TIMER3)\""));
+}
+
+static void testEmpty(void)
+{
+	std::string json = decode(Blob(6, 120000000, 5));
+	CHECK(contains(json, "\"events\":0,\"lost\":5}"));
+	CHECK(contains(json, "\"traceEvents\":[\n]}"));
+}
+
+static void testRejected(void)
+{
+	Blob magic;
+	magic.header().magic[3] = 'X';
+	CHECK(contains(decode(magic, false), "bad magic"));
+
+	Blob version;
+	version.header().version = SIT_TRACE_VERSION + 1;
+	CHECK(contains(decode(version, false), "version"));
+
+	Blob clock(6, 0);
+	CHECK(contains(decode(clock, false), "clock"));
+
+	Blob header;
+	header.bytes.resize(sizeof(SIT_TraceHeader) - 1);
+	CHECK(contains(decode(header, false), "too short"));
+
+	Blob events;
+	events.event(0, SIT_TRACE_START, 0, 10).event(1, SIT_TRACE_STOP, 0, 0);
+	events.bytes.resize(events.bytes.size() - 1);
+	CHECK(contains(decode(events, false), "cut short"));
+}
+
+// ------------------------------------------------------------
+// A real ring, overflowed by a running SIT
+// ------------------------------------------------------------
+IntervalTimer timer;
+void nop(void) {}
+
+static void testRingOverflow(void)
+{
+	SIT_Trace::clear();
+	timer.begin(nop, 100, uSec);		// start, then an update per 100us
+	SIT_Sim::advanceUs(3000);
+	timer.end();
+	uint32_t recorded = SIT_Trace::head.load();
+
+	Blob dump;
+	dump.bytes.clear();
+	SIT_Trace::dump(dump);
+	const SIT_TraceHeader& h = dump.header();
+	CHECK(recorded > SIT_TRACE_EVENTS);
+	CHECK(h.count == SIT_TRACE_EVENTS);
+	CHECK(h.lost == recorded - SIT_TRACE_EVENTS);
+	CHECK(dump.bytes.size() == sizeof(h) + SIT_TRACE_EVENTS * sizeof(SIT_TraceEvent));
+
+	// oldest first: stamps rise and the stop comes last
+	const SIT_TraceEvent* e = (const SIT_TraceEvent*)(dump.bytes.data() + sizeof(h));
+	for (uint32_t i = 1; i < h.count; i++)
+		CHECK((int32_t)(e[i].stamp - e[i - 1].stamp) >= 0);
+	CHECK(e[h.count - 1].type() == SIT_TRACE_STOP);
+	CHECK(e[0].type() == SIT_TRACE_UPDATE);
+
+	char lost[32];
+	snprintf(lost, sizeof(lost), "\"lost\":%u}", (unsigned)h.lost);
+	CHECK(contains(decode(dump), lost));
+
+	// a ring not yet full loses nothing
+	SIT_Trace::clear();
+	timer.begin(nop, 100, uSec);
+	timer.end();
+	Blob small;
+	small.bytes.clear();
+	SIT_Trace::dump(small);
+	CHECK(small.header().count == SIT_Trace::head.load());
+	CHECK(small.header().count < SIT_TRACE_EVENTS && small.header().lost == 0);
+}
+
+int main(void)
+{
+	testWrap();
+	testOutOfOrder();
+	testSaturated();
+	testUnknownType();
+	testEmpty();
+	testRejected();
+	testRingOverflow();
+
+	printf("SparkIntervalTraceTest: %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
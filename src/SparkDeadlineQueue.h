@@ -0,0 +1,128 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __DEADLINEQUEUE_H__
+#define __DEADLINEQUEUE_H__
+
+#include <stdint.h>
+
+// ------------------------------------------------------------
+// Fixed capacity binary min-heap of deadline nodes used by the
+// IntervalScheduler.  It has no Particle dependencies so it can
+// be built and exercised on a host.  Node type T must provide:
+//   uint32_t deadline;		// absolute expiry in timer ticks
+//   uint16_t heapIndex;	// slot in heap, NOT_QUEUED if idle
+// Deadlines are compared with wrap-around arithmetic, so any two
+// queued deadlines must lie within 2^31 ticks of each other.
+// push, pop and remove are O(log n), top is O(1).
+// ------------------------------------------------------------
+template <typename T, uint16_t N>
+class SIT_DeadlineQueue {
+  public:
+	static const uint16_t NOT_QUEUED = 0xFFFF;
+
+	SIT_DeadlineQueue() : count(0) {}
+
+	bool empty() const { return count == 0; }
+	bool full() const { return count == N; }
+	uint16_t size() const { return count; }
+	T* top() const { return count ? heap[0] : 0; }
+
+	bool push(T* node) {
+		if (count == N || node->heapIndex != NOT_QUEUED)
+			return false;
+		heap[count] = node;
+		node->heapIndex = count;
+		siftUp(count++);
+		return true;
+	}
+
+	T* pop() {
+		if (count == 0)
+			return 0;
+		T* node = heap[0];
+		removeAt(0);
+		return node;
+	}
+
+	bool remove(T* node) {
+		uint16_t i = node->heapIndex;
+		if (i >= count || heap[i] != node)
+			return false;
+		removeAt(i);
+		return true;
+	}
+
+	static bool before(const T* a, const T* b) {
+		return (int32_t)(a->deadline - b->deadline) < 0;
+	}
+
+  private:
+	T* heap[N];
+	uint16_t count;
+
+	void place(uint16_t i, T* node) {
+		heap[i] = node;
+		node->heapIndex = i;
+	}
+
+	void removeAt(uint16_t i) {
+		heap[i]->heapIndex = NOT_QUEUED;
+		if (i != --count) {
+			place(i, heap[count]);
+			// the moved tail node may need to travel either way
+			if (i > 0 && before(heap[i], heap[(i - 1) / 2]))
+				siftUp(i);
+			else
+				siftDown(i);
+		}
+	}
+
+	void siftUp(uint16_t i) {
+		T* node = heap[i];
+		while (i > 0) {
+			uint16_t parent = (i - 1) / 2;
+			if (!before(node, heap[parent]))
+				break;
+			place(i, heap[parent]);
+			i = parent;
+		}
+		place(i, node);
+	}
+
+	void siftDown(uint16_t i) {
+		T* node = heap[i];
+		for (;;) {
+			uint16_t child = 2 * i + 1;
+			if (child >= count)
+				break;
+			if (child + 1 < count && before(heap[child + 1], heap[child]))
+				child++;
+			if (!before(heap[child], node))
+				break;
+			place(i, heap[child]);
+			i = child;
+		}
+		place(i, node);
+	}
+};
+
+#endif
@@ -0,0 +1,386 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include "SparkIntervalCapture.h"
+
+// DMA serving the capture requests of channels 1 and 2 of the
+// pool timers (NULL where there is no request, or where it is
+// taken by the system firmware)
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+struct SIT_CaptureDMA {
+	TIMid id;
+	DMA_Channel_TypeDef* channel[2];
+	uint8_t number[2];
+};
+static const SIT_CaptureDMA SIT_CAPTURE_DMA[] = {
+	{ TIMER2, { NULL, DMA1_Channel7 }, { 0, 7 } },			// CC1 is on channel 5, the CC3000's SPI
+	{ TIMER3, { DMA1_Channel6, NULL }, { 6, 0 } },			// no CC2 request
+	{ TIMER4, { DMA1_Channel1, NULL }, { 1, 0 } },			// CC2 is on channel 4, the CC3000's SPI
+};
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+struct SIT_CaptureDMA {
+	TIMid id;
+	DMA_TypeDef* dma;
+	DMA_Stream_TypeDef* stream[2];
+	uint32_t channel[2];
+	uint8_t number[2];
+};
+static const SIT_CaptureDMA SIT_CAPTURE_DMA[] = {
+	{ TIMER3, DMA1, { DMA1_Stream4, DMA1_Stream5 }, { DMA_Channel_5, DMA_Channel_5 }, { 4, 5 } },
+	{ TIMER4, DMA1, { DMA1_Stream0, DMA1_Stream3 }, { DMA_Channel_2, DMA_Channel_2 }, { 0, 3 } },
+	{ TIMER5, DMA1, { DMA1_Stream2, DMA1_Stream4 }, { DMA_Channel_6, DMA_Channel_6 }, { 2, 4 } },
+	// CC1 is on DMA2 stream 1 (IntervalPattern's TIMER8) or 3 (SDIO to the Wi-Fi module)
+	{ TIMER1, DMA2, { NULL, DMA2_Stream2 }, { 0, DMA_Channel_6 }, { 0, 2 } },
+	{ TIMER8, DMA2, { DMA2_Stream2, NULL }, { DMA_Channel_7, 0 }, { 2, 0 } },
+};
+static const uint8_t SIT_DMA_FLAG_SHIFT[] = { 0, 6, 16, 22 };	// stream n & 3 in LISR/HISR
+const uint32_t SIT_DMA_FLAGS = 0x3D;			// FEIF, DMEIF, TEIF, HTIF and TCIF of stream 0
+#endif
+
+// ------------------------------------------------------------
+// Table entry for a pin, with the index of its channel (0 or 1)
+// ------------------------------------------------------------
+const SIT_CaptureDMA* IntervalCapture::lookup(uint16_t pin, uint8_t& ch) {
+	uint8_t id = IntervalTimer::pinTimer_SIT(pin);
+	if (id >= IntervalTimer::NUM_SIT)
+		return NULL;
+#if !defined(PLATFORM_ID)							//Core v0.3.4
+	uint16_t timerCh = PIN_MAP[pin].timer_ch;
+#else
+	uint16_t timerCh = HAL_Pin_Map()[pin].timer_ch;
+#endif
+	if (timerCh != TIM_Channel_1 && timerCh != TIM_Channel_2)
+		return NULL;
+	ch = (timerCh == TIM_Channel_1) ? 0 : 1;
+	for (uint8_t i = 0; i < sizeof(SIT_CAPTURE_DMA) / sizeof(SIT_CAPTURE_DMA[0]); i++) {
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+		bool usable = SIT_CAPTURE_DMA[i].channel[ch] != NULL;
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+		bool usable = SIT_CAPTURE_DMA[i].stream[ch] != NULL;
+#endif
+		if (SIT_CAPTURE_DMA[i].id == id)
+			return usable ? &SIT_CAPTURE_DMA[i] : NULL;
+	}
+	return NULL;
+}
+
+
+// ------------------------------------------------------------
+// Returns true if pin can be used by IntervalCapture
+// ------------------------------------------------------------
+bool IntervalCapture::canCapture(uint16_t pin) {
+	uint8_t ch;
+	return lookup(pin, ch) != NULL;
+}
+
+
+// ------------------------------------------------------------
+// Starts capturing pin into buf, two words per input cycle, so
+// len (even, at least 4) words hold len / 2 cycles.  Ticks are
+// as fine as allowed by cycles down to minHz fitting in the
+// counter; a cycle longer than that wraps the counter and is
+// dropped.  Totals are published every batch cycles.  Fails if
+// the pin's timer is in use, by a SIT or by analogWrite on
+// another of its pins, or its DMA channel or stream is reserved
+// by another driver (IntervalTimer::claimDMA_SIT).  buf must
+// stay valid until end().
+// ------------------------------------------------------------
+bool IntervalCapture::begin(uint16_t pin, uint32_t* buf, uint16_t len, double minHz, uint16_t batch) {
+
+	end();
+	uint8_t ch;
+	const SIT_CaptureDMA* dma = lookup(pin, ch);
+	if (dma == NULL || buf == NULL || len < 4 || len % 2 != 0 || batch < 1 || !(minHz > 0))
+		return false;
+	if (IntervalTimer::pwmConflict_SIT(dma->id))
+		return false;
+
+	// the smallest prescaler whose counter range spans a minHz cycle
+	uint64_t range = (uint64_t)IntervalTimer::maxReload_SIT(dma->id) + 1;
+	uint64_t clocks = SIT_Solver::clocksFromHz(minHz, IntervalTimer::clock_SIT(dma->id));
+	uint64_t divider = (clocks + range - 1) / range;
+	if (divider < 1)
+		divider = 1;
+	if (divider > SIT_Solver::MAX_DIVIDER)
+		return false;
+
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	dmaUnit = 1;
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	dmaUnit = (dma->dma == DMA1) ? 1 : 2;
+#endif
+	dmaNumber = dma->number[ch];
+	if (!IntervalTimer::claimDMA_SIT(dmaUnit, dmaNumber))
+		return false;
+
+	// the update interrupt is kept to catch counter wraps; the
+	// capture reset does not raise it (URS)
+	if (!hwTimer.beginCycles(SIT_Delegate(this, &IntervalCapture::wrapped), (intPeriod)(range - 1), (uint16_t)(divider - 1), dma->id)) {
+		IntervalTimer::releaseDMA_SIT(dmaUnit, dmaNumber);
+		return false;
+	}
+	ticks = (uint32_t)(IntervalTimer::clock_SIT(dma->id) / divider);
+	TIMx = hwTimer.timer_SIT();
+	TIM_Cmd(TIMx, DISABLE);
+	TIMx->CR1 |= TIM_CR1_URS;
+	TIM_ClearITPendingBit(TIMx, TIM_IT_Update);
+
+	inputPin = pin;
+	buffer = buf;
+	slots = len / 2;
+	tail = 0;
+	dropAt = 0;					// the first cycle starts with the capture, not an edge
+	swapped = (ch == 1);
+	batchCycles = batch;
+	clearBatch(acc);
+	clearBatch(last);
+	batches = 0;
+	missed = 0;
+	dropped = 0;
+
+	IntervalTimer::connect_SIT(pin, INPUT);
+
+	// PWM input: the pin's edge resets the counter; rising edges
+	// capture the period on its channel, falling edges the high
+	// time on the other one
+	TIM_ICInitTypeDef icInitStructure;
+	icInitStructure.TIM_Channel = swapped ? TIM_Channel_2 : TIM_Channel_1;
+	icInitStructure.TIM_ICPolarity = TIM_ICPolarity_Rising;
+	icInitStructure.TIM_ICSelection = TIM_ICSelection_DirectTI;
+	icInitStructure.TIM_ICPrescaler = TIM_ICPSC_DIV1;
+	icInitStructure.TIM_ICFilter = 0;
+	TIM_PWMIConfig(TIMx, &icInitStructure);
+	TIM_SelectInputTrigger(TIMx, swapped ? TIM_TS_TI2FP2 : TIM_TS_TI1FP1);
+	TIM_SelectSlaveMode(TIMx, TIM_SlaveMode_Reset);
+
+	// each period capture bursts CCR1 and CCR2 out through DMAR
+	TIM_DMAConfig(TIMx, TIM_DMABase_CCR1, TIM_DMABurstLength_2Transfers);
+
+	DMA_InitTypeDef dmaInitStructure;
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	channel = dma->channel[ch];
+	flagShift = 4 * (dma->number[ch] - 1);
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+	DMA_DeInit(channel);
+	dmaInitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&TIMx->DMAR;
+	dmaInitStructure.DMA_MemoryBaseAddr = (uint32_t)(uintptr_t)buf;
+	dmaInitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+	dmaInitStructure.DMA_BufferSize = len;
+	dmaInitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	dmaInitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	dmaInitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+	dmaInitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+	dmaInitStructure.DMA_Mode = DMA_Mode_Circular;
+	dmaInitStructure.DMA_Priority = DMA_Priority_High;
+	dmaInitStructure.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(channel, &dmaInitStructure);
+	DMA1->IFCR = (uint32_t)0x0F << flagShift;
+	DMA_Cmd(channel, ENABLE);
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	uint8_t number = dma->number[ch];
+	stream = dma->stream[ch];
+	isr = (number >= 4) ? &dma->dma->HISR : &dma->dma->LISR;
+	ifcr = (number >= 4) ? &dma->dma->HIFCR : &dma->dma->LIFCR;
+	flagShift = SIT_DMA_FLAG_SHIFT[number & 3];
+	RCC_AHB1PeriphClockCmd((dma->dma == DMA1) ? RCC_AHB1Periph_DMA1 : RCC_AHB1Periph_DMA2, ENABLE);
+	DMA_Cmd(stream, DISABLE);
+	DMA_DeInit(stream);
+	dmaInitStructure.DMA_Channel = dma->channel[ch];
+	dmaInitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&TIMx->DMAR;
+	dmaInitStructure.DMA_Memory0BaseAddr = (uint32_t)(uintptr_t)buf;
+	dmaInitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+	dmaInitStructure.DMA_BufferSize = len;
+	dmaInitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	dmaInitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	dmaInitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+	dmaInitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+	dmaInitStructure.DMA_Mode = DMA_Mode_Circular;
+	dmaInitStructure.DMA_Priority = DMA_Priority_High;
+	dmaInitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+	dmaInitStructure.DMA_FIFOThreshold = DMA_FIFOThreshold_HalfFull;
+	dmaInitStructure.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+	dmaInitStructure.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+	DMA_Init(stream, &dmaInitStructure);
+	*ifcr = SIT_DMA_FLAGS << flagShift;
+	DMA_Cmd(stream, ENABLE);
+#endif
+
+	TIM_DMACmd(TIMx, swapped ? TIM_DMA_CC2 : TIM_DMA_CC1, ENABLE);
+	TIMx->CNT = 0;
+	TIM_Cmd(TIMx, ENABLE);
+	return true;
+}
+
+
+// ------------------------------------------------------------
+// Stops capturing, releases the SIT and returns the pin to a
+// plain input.  The last batch stays readable.
+// ------------------------------------------------------------
+void IntervalCapture::end(void) {
+	if (TIMx == NULL)
+		return;
+
+	TIM_DMACmd(TIMx, swapped ? TIM_DMA_CC2 : TIM_DMA_CC1, DISABLE);
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	DMA_Cmd(channel, DISABLE);
+	DMA1->IFCR = (uint32_t)0x0F << flagShift;
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	DMA_Cmd(stream, DISABLE);
+	*ifcr = SIT_DMA_FLAGS << flagShift;
+#endif
+	IntervalTimer::releaseDMA_SIT(dmaUnit, dmaNumber);
+	hwTimer.end();
+	TIMx = NULL;
+	pinMode(inputPin, INPUT);
+}
+
+
+// ------------------------------------------------------------
+// SIT callback on counter overflow: no edge came for a whole
+// counter range, so the cycle the next edge closes is wrong.
+// Its burst goes to the slot after the last complete one.
+// ------------------------------------------------------------
+void IntervalCapture::wrapped(void) {
+	if (TIMx == NULL)
+		return;
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	uint32_t words = 2 * slots - DMA_GetCurrDataCounter(channel);
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	uint32_t words = 2 * slots - DMA_GetCurrDataCounter(stream);
+#endif
+	dropAt = (words / 2) % slots;
+}
+
+
+void IntervalCapture::clearBatch(SIT_CaptureStats& stats) {
+	stats.cycles = 0;
+	stats.period = 0;
+	stats.high = 0;
+	stats.minPeriod = UINT32_MAX;
+	stats.maxPeriod = 0;
+}
+
+
+// ------------------------------------------------------------
+// Call from loop() at least twice per buffer period.  Adds the
+// cycles captured since the last call to the batch in progress,
+// publishing it (and running the batch callback) each time it
+// reaches batch cycles.  Returns the number of batches published.
+// If a whole half buffer was captured since the last call,
+// cycles may have been overwritten: an overrun is counted and
+// the backlog is skipped.
+// ------------------------------------------------------------
+uint16_t IntervalCapture::service(void) {
+	if (TIMx == NULL)
+		return 0;
+
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	uint32_t flags = (DMA1->ISR >> flagShift) & (DMA_ISR_HTIF1 | DMA_ISR_TCIF1);
+	const uint32_t BOTH = DMA_ISR_HTIF1 | DMA_ISR_TCIF1;
+	DMA1->IFCR = flags << flagShift;
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	uint32_t flags = (*isr >> flagShift) & (DMA_LISR_HTIF0 | DMA_LISR_TCIF0);
+	const uint32_t BOTH = DMA_LISR_HTIF0 | DMA_LISR_TCIF0;
+	*ifcr = flags << flagShift;
+#endif
+
+	uint16_t head = position();
+	if (flags == BOTH) {
+		missed++;
+		tail = head;
+	}
+
+	uint16_t published = 0;
+	while (tail != head) {
+		uint16_t slot = tail;
+		tail = (tail + 1 == slots) ? 0 : tail + 1;
+		if (slot == dropAt) {
+			dropAt = -1;
+			dropped++;
+			continue;
+		}
+
+		uint32_t period = buffer[2 * slot + (swapped ? 1 : 0)];
+		uint32_t high = buffer[2 * slot + (swapped ? 0 : 1)];
+		acc.cycles++;
+		acc.period += period;
+		acc.high += high;
+		if (period < acc.minPeriod) acc.minPeriod = period;
+		if (period > acc.maxPeriod) acc.maxPeriod = period;
+		if (acc.cycles < batchCycles)
+			continue;
+
+		last = acc;
+		clearBatch(acc);
+		batches++;
+		published++;
+		if (batchCallback.isSet()) batchCallback();
+	}
+	return published;
+}
+
+
+// ------------------------------------------------------------
+// Copies the totals of the last complete batch; false if no
+// batch has completed yet
+// ------------------------------------------------------------
+bool IntervalCapture::stats(SIT_CaptureStats& batch) {
+	batch = last;
+	return last.cycles != 0;
+}
+
+
+// ------------------------------------------------------------
+// Mean frequency (Hz), period (ns) and duty cycle (0 to 1) of
+// the input over the last complete batch, 0 before the first
+// ------------------------------------------------------------
+double IntervalCapture::frequency(void) {
+	if (last.period == 0)
+		return 0;
+	return (double)ticks * last.cycles / last.period;
+}
+
+uint32_t IntervalCapture::periodNs(void) {
+	if (last.cycles == 0)
+		return 0;
+	return (uint32_t)(1e9 * last.period / ((double)ticks * last.cycles) + 0.5);
+}
+
+float IntervalCapture::duty(void) {
+	if (last.period == 0)
+		return 0.0f;
+	return (float)last.high / last.period;
+}
+
+
+// ------------------------------------------------------------
+// Slot the next complete cycle will be written to
+// ------------------------------------------------------------
+uint16_t IntervalCapture::position(void) {
+	if (TIMx == NULL)
+		return 0;
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	uint32_t words = 2 * slots - DMA_GetCurrDataCounter(channel);
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	uint32_t words = 2 * slots - DMA_GetCurrDataCounter(stream);
+#endif
+	return (uint16_t)((words / 2) % slots);
+}
@@ -0,0 +1,117 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __INTERVALCAPTURE_H__
+#define __INTERVALCAPTURE_H__
+
+#include "SparkIntervalTimer.h"
+
+struct SIT_CaptureDMA;
+
+// ------------------------------------------------------------
+// Totals over one batch of consecutive input cycles, in timer
+// ticks (see IntervalCapture::tickHz)
+// ------------------------------------------------------------
+struct SIT_CaptureStats {
+	uint32_t cycles;
+	uint64_t period;			// sum of the cycle periods
+	uint64_t high;				// sum of the high times
+	uint32_t minPeriod;
+	uint32_t maxPeriod;
+};
+
+// ------------------------------------------------------------
+// Measures a pulse train on a timer input pin in hardware.  The
+// pin's timer runs in PWM input mode: each rising edge latches
+// the cycle period and resets the counter, each falling edge
+// latches the high time, and a DMA burst copies both into a
+// circular buffer, so edges cost no CPU.  service(), polled from
+// loop(), folds the new cycles into running totals and publishes
+// them every batch cycles.
+//
+// The timer is taken from the SIT pool, so it is not available
+// to IntervalTimers while capturing and vice versa.  Pins must be
+// on channel 1 or 2 of a pool timer whose request has a free DMA
+// channel or stream, one not reserved by another capture, a
+// pattern or SampledADC (see README section 13):
+//   Core:   A1 (TIMER2), A4 (TIMER3), D1 (TIMER4)
+//   Photon: D0, D1 (TIMER4), D2, D3, A4, A5 (TIMER3), A7 (TIMER5),
+//           TX (TIMER1)
+// ------------------------------------------------------------
+class IntervalCapture {
+  private:
+	IntervalTimer hwTimer;
+	TIM_TypeDef* TIMx;
+	uint16_t inputPin;
+	uint32_t* buffer;
+	uint16_t slots;				// cycles the buffer holds
+	uint16_t tail;				// next slot service() reads
+	volatile int32_t dropAt;	// slot holding a cycle the counter wrapped in, or -1
+	bool swapped;				// channel 2 input: CCR1 holds the high time
+	uint16_t batchCycles;
+	uint32_t ticks;				// counter ticks per second
+	SIT_CaptureStats acc;		// batch in progress
+	SIT_CaptureStats last;		// last complete batch
+	SIT_Delegate batchCallback;
+	uint32_t batches;
+	uint32_t missed;
+	uint32_t dropped;
+	uint8_t dmaUnit;			// DMA controller and channel or stream reserved
+	uint8_t dmaNumber;
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)
+	DMA_Channel_TypeDef* channel;
+	uint8_t flagShift;			// position of the channel's flags in DMA1->ISR
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)
+	DMA_Stream_TypeDef* stream;
+	volatile uint32_t* isr;		// LISR or HISR of the stream's DMA, and the matching flag clear register
+	volatile uint32_t* ifcr;
+	uint8_t flagShift;			// position of the stream's flags in isr
+#endif
+
+	static const SIT_CaptureDMA* lookup(uint16_t pin, uint8_t& ch);
+	void wrapped(void);
+	void clearBatch(SIT_CaptureStats& stats);
+
+  public:
+	IntervalCapture() : TIMx(NULL), buffer(NULL), slots(0), dropAt(-1), ticks(0), batches(0), missed(0), dropped(0) {}
+	~IntervalCapture() { end(); }
+
+	bool begin(uint16_t pin, uint32_t* buf, uint16_t len, double minHz, uint16_t batch = 16);
+	void end(void);
+
+	void onBatch(const SIT_Delegate& callback) { batchCallback = callback; }
+
+	uint16_t service(void);
+	bool stats(SIT_CaptureStats& batch);
+	double frequency(void);
+	uint32_t periodNs(void);
+	float duty(void);
+	uint32_t tickHz(void) { return ticks; }
+	uint16_t position(void);
+	uint32_t serviced(void) { return batches; }
+	uint32_t overruns(void) { return missed; }
+	uint32_t drops(void) { return dropped; }
+	bool isActive(void) { return TIMx != NULL; }
+
+	static bool canCapture(uint16_t pin);
+};
+
+#endif
@@ -0,0 +1,171 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __INTERVALCLOCK_H__
+#define __INTERVALCLOCK_H__
+
+#include "SparkIntervalTimerT.h"
+
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core: all pool timers are 16 bit
+  #define SIT_CLOCK_TIMER	TIMER2
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon: TIM5 is 32 bit
+  #define SIT_CLOCK_TIMER	TIMER5
+#endif
+
+// ------------------------------------------------------------
+// Free-running 64 bit timestamp clock on a dedicated SIT.  The
+// counter runs at the full timer clock (or divided by a
+// prescaler) and the update ISR only counts overflows.
+//
+// now64() is lock-free and safe from thread and interrupt
+// context: it never masks interrupts, just reads the overflow
+// sequence, CNT and the update flag.  The ISR makes the
+// sequence odd while it acknowledges an overflow, so a reader
+// that preempts it still knows whether that overflow has been
+// counted, and one preempted by it retries.  Reads stay exact
+// as long as no context blocks the ISR for a whole counter
+// period (71s on TIM5, about 1ms on 16 bit timers).
+//
+// With a 32 bit counter the clock does not wrap in practice;
+// with a 16 bit counter it wraps after 2^47 counts (22 days
+// at 72MHz), longer with a prescaler.
+//
+//   IntervalClock<> clock;
+//   clock.begin();
+//   uint64_t t = clock.now64();
+// ------------------------------------------------------------
+template <TIMid ID = SIT_CLOCK_TIMER>
+class IntervalClock {
+  private:
+	typedef SIT_traits<ID> SIT;
+
+	static volatile uint32_t seq;		// twice the overflows, odd inside the ISR
+	static uint8_t bits;				// counter width
+	static uint32_t divider;			// PSC + 1
+
+	bool status;
+	uint8_t priority;			// NVIC preemption priority of the overflow interrupt
+
+  public:
+	IntervalClock() : status(false), priority(SIT_PRIORITY) {}
+	~IntervalClock() { end(); }
+	IntervalClock(const IntervalClock&) = delete;
+	IntervalClock& operator=(const IntervalClock&) = delete;
+
+	static void isr(void) {
+		TIM_TypeDef* TIMx = SIT::TIMx();
+
+		if (TIMx->SR & TIM_SR_UIF) {
+			seq = seq + 1;
+			TIMx->SR = (uint16_t)~TIM_SR_UIF;
+			seq = seq + 1;
+		}
+	}
+
+	bool begin(uint16_t prescaler = 0) {
+		if (status)
+			end();
+		if (!IntervalTimer::claim_SIT(ID))
+			return false;
+		status = true;
+
+		TIM_TypeDef* TIMx = SIT::TIMx();
+		uint32_t maxReload = IntervalTimer::maxReload_SIT(ID);
+
+		bits = (maxReload > UINT16_MAX) ? 32 : 16;
+		divider = prescaler + 1;
+		seq = 0;
+		SIT::attach(isr);
+		SIT::enable();
+		TIMx->CR1 = 0;
+		TIMx->PSC = prescaler;
+		TIMx->ARR = maxReload;
+		TIMx->EGR = TIM_EGR_UG;				// latch PSC, then drop the resulting flag
+		TIMx->SR = (uint16_t)~TIM_SR_UIF;
+		TIMx->DIER = TIM_DIER_UIE;
+		NVIC_SetPriority(SIT::irq, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), priority, 1));
+		NVIC_EnableIRQ(SIT::irq);
+		TIMx->CR1 = TIM_CR1_CEN;
+		return true;
+	}
+
+	// as IntervalTimer::priority_SIT(): 0 (most urgent) to 15,
+	// taking effect at the next begin()
+	void priority_SIT(uint8_t preempt) {
+		priority = (preempt > 15) ? 15 : preempt;
+	}
+
+	void end() {
+		if (!status)
+			return;
+
+		TIM_TypeDef* TIMx = SIT::TIMx();
+		TIMx->CR1 = 0;
+		TIMx->DIER = 0;
+		TIMx->SR = 0;
+		if (!IntervalTimer::sharedIrq_SIT(ID))
+			NVIC_DisableIRQ(SIT::irq);
+		SIT::restore();
+		IntervalTimer::release_SIT(ID);
+		status = false;
+	}
+
+	// ------------------------------------------------------------
+	// Counts since begin().  An even sequence with the update flag
+	// set is an overflow the ISR has not taken yet; CNT is read
+	// again after the flag so it is certainly past that overflow.
+	// ------------------------------------------------------------
+	static uint64_t now64(void) {
+		TIM_TypeDef* TIMx = SIT::TIMx();
+		uint32_t s, wraps, count;
+
+		do {
+			s = seq;
+			wraps = (s + 1) >> 1;
+			count = TIMx->CNT;
+			if (!(s & 1) && (TIMx->SR & TIM_SR_UIF)) {
+				wraps++;
+				count = TIMx->CNT;
+			}
+		} while (s != seq);
+		return ((uint64_t)wraps << bits) + count;
+	}
+
+	// counts per second
+	static uint32_t frequency(void) {
+		return IntervalTimer::clock_SIT(ID) / divider;
+	}
+
+	static uint64_t toNs(uint64_t counts) {
+		uint32_t hz = frequency();
+		return (counts / hz) * 1000000000ULL + (counts % hz) * 1000000000ULL / hz;
+	}
+
+	static uint64_t nanos64(void) {
+		return toNs(now64());
+	}
+};
+
+template <TIMid ID> volatile uint32_t IntervalClock<ID>::seq;
+template <TIMid ID> uint8_t IntervalClock<ID>::bits;
+template <TIMid ID> uint32_t IntervalClock<ID>::divider = 1;
+
+#endif
@@ -0,0 +1,439 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include "SparkIntervalCompare.h"
+
+#define SIT_CC_FLAGS	(TIM_IT_CC1 | TIM_IT_CC2 | TIM_IT_CC3 | TIM_IT_CC4)
+
+IntervalCompare* volatile IntervalCompare::SIT_bank[];
+
+#if defined(PLATFORM_ID)
+// ------------------------------------------------------------
+// Compare interrupt hook of SIT id, attached to the system
+// interrupts of all its channels
+// ------------------------------------------------------------
+template <uint8_t id>
+static void SIT_compareHook(void)
+{
+	IntervalCompare::dispatch_SIT(id);
+}
+
+// ------------------------------------------------------------
+// Compare channels of each SIT's timer and the system interrupts
+// their flags raise (unused entries repeat the first).  TIMER1
+// and TIMER8 raise them on an IRQ line of their own, apart from
+// the update line.
+// ------------------------------------------------------------
+struct SIT_CompareHardware {
+	uint8_t channels;
+	bool ownIrq;
+	IRQn_Type irq;
+	hal_irq_t sysint[4];
+	void (*hook)(void);
+};
+
+#define SIT_CC4(n)	{ SysInterrupt_TIM##n##_Compare1, SysInterrupt_TIM##n##_Compare2, SysInterrupt_TIM##n##_Compare3, SysInterrupt_TIM##n##_Compare4 }
+#define SIT_CC2(n)	{ SysInterrupt_TIM##n##_Compare1, SysInterrupt_TIM##n##_Compare2, SysInterrupt_TIM##n##_Compare1, SysInterrupt_TIM##n##_Compare1 }
+#define SIT_CC1(n)	{ SysInterrupt_TIM##n##_Compare1, SysInterrupt_TIM##n##_Compare1, SysInterrupt_TIM##n##_Compare1, SysInterrupt_TIM##n##_Compare1 }
+#define SIT_CC0(n)	{ SysInterrupt_TIM##n##_Update, SysInterrupt_TIM##n##_Update, SysInterrupt_TIM##n##_Update, SysInterrupt_TIM##n##_Update }
+
+#if defined(STM32F10X_MD)							//Core
+static const SIT_CompareHardware SIT_COMPARE[] = {
+	{ 4, false, TIM2_IRQn, SIT_CC4(2), SIT_compareHook<0> },
+	{ 4, false, TIM3_IRQn, SIT_CC4(3), SIT_compareHook<1> },
+	{ 4, false, TIM4_IRQn, SIT_CC4(4), SIT_compareHook<2> },
+};
+#elif defined(STM32F2XX)							//Photon: TIM6/7 are basic timers
+static const SIT_CompareHardware SIT_COMPARE[] = {
+	{ 4, false, TIM3_IRQn, SIT_CC4(3), SIT_compareHook<0> },
+	{ 4, false, TIM4_IRQn, SIT_CC4(4), SIT_compareHook<1> },
+	{ 4, false, TIM5_IRQn, SIT_CC4(5), SIT_compareHook<2> },
+	{ 0, false, TIM6_DAC_IRQn, SIT_CC0(6), SIT_compareHook<3> },
+	{ 0, false, TIM7_IRQn, SIT_CC0(7), SIT_compareHook<4> },
+	{ 4, true, TIM1_CC_IRQn, SIT_CC4(1), SIT_compareHook<5> },
+	{ 4, true, TIM8_CC_IRQn, SIT_CC4(8), SIT_compareHook<6> },
+	{ 2, false, TIM1_BRK_TIM9_IRQn, SIT_CC2(9), SIT_compareHook<7> },
+	{ 1, false, TIM1_UP_TIM10_IRQn, SIT_CC1(10), SIT_compareHook<8> },
+	{ 1, false, TIM1_TRG_COM_TIM11_IRQn, SIT_CC1(11), SIT_compareHook<9> },
+	{ 2, false, TIM8_BRK_TIM12_IRQn, SIT_CC2(12), SIT_compareHook<10> },
+	{ 1, false, TIM8_UP_TIM13_IRQn, SIT_CC1(13), SIT_compareHook<11> },
+	{ 1, false, TIM8_TRG_COM_TIM14_IRQn, SIT_CC1(14), SIT_compareHook<12> },
+};
+#endif
+
+#undef SIT_CC4
+#undef SIT_CC2
+#undef SIT_CC1
+#undef SIT_CC0
+#endif
+
+
+// ------------------------------------------------------------
+// Starts the timer of SIT id, or the free one with the most
+// compare channels, counting ticks of tickNs rounded to whole
+// timer clocks, at most 65536 of them.  Fails if the timer has
+// no compare channels or drives analogWrite pins.
+// ------------------------------------------------------------
+bool IntervalCompare::beginNs(uint32_t tickNs, TIMid id) {
+	end();
+#if !defined(PLATFORM_ID)							//Core v0.3.4
+	(void)tickNs;
+	(void)id;
+	return false;
+#else
+	uint8_t tid = (id == AUTO) ? pick() : (uint8_t)id;
+	if (tid >= IntervalTimer::NUM_SIT || SIT_COMPARE[tid].channels == 0 || IntervalTimer::pwmConflict_SIT(tid))
+		return false;
+	uint64_t clocks = SIT_Solver::clocksFromNs(tickNs, IntervalTimer::clock_SIT(tid));
+	if (clocks < 1 || clocks > SIT_Solver::MAX_DIVIDER)
+		return false;
+	if (!hwTimer.beginCycles(SIT_Delegate(), (intPeriod)IntervalTimer::maxReload_SIT(tid), (uint16_t)(clocks - 1), (TIMid)tid))
+		return false;
+
+	// the counter runs free and only serves the channels
+	const SIT_CompareHardware& hw = SIT_COMPARE[tid];
+	TIMx = hwTimer.timer_SIT();
+	TIM_ITConfig(TIMx, TIM_IT_Update, DISABLE);
+	TIM_ClearITPendingBit(TIMx, TIM_IT_Update);
+	channels = hw.channels;
+	mask = IntervalTimer::maxReload_SIT(tid);
+	divider = (uint32_t)clocks;
+
+	// frozen output compare: a match only sets the channel's flag
+	TIM_OCInitTypeDef ocInitStructure;
+	TIM_OCStructInit(&ocInitStructure);
+	ocInitStructure.TIM_OCMode = TIM_OCMode_Timing;
+	ocInitStructure.TIM_OutputState = TIM_OutputState_Disable;
+	TIM_OC1Init(TIMx, &ocInitStructure);
+	if (channels > 1)
+		TIM_OC2Init(TIMx, &ocInitStructure);
+	if (channels > 2) {
+		TIM_OC3Init(TIMx, &ocInitStructure);
+		TIM_OC4Init(TIMx, &ocInitStructure);
+	}
+
+	SIT_bank[tid] = this;
+	for (uint8_t c = 0; c < channels; c++)
+		attachSystemInterrupt(hw.sysint[c], hw.hook);
+	if (hw.ownIrq) {
+		NVIC_InitTypeDef nvicStructure;
+		nvicStructure.NVIC_IRQChannel = hw.irq;
+		nvicStructure.NVIC_IRQChannelPreemptionPriority = hwTimer.priority;
+		nvicStructure.NVIC_IRQChannelSubPriority = 1;
+		nvicStructure.NVIC_IRQChannelCmd = ENABLE;
+		NVIC_Init(&nvicStructure);
+	}
+	return true;
+#endif
+}
+
+
+// ------------------------------------------------------------
+// Stops every CompareTimer on the bank and releases the SIT
+// ------------------------------------------------------------
+void IntervalCompare::end(void) {
+	if (TIMx == NULL)
+		return;
+
+#if defined(PLATFORM_ID)
+	uint8_t tid = hwTimer.SIT_id;
+	const SIT_CompareHardware& hw = SIT_COMPARE[tid];
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	TIM_ITConfig(TIMx, SIT_CC_FLAGS, DISABLE);
+	for (uint8_t c = 0; c < 4; c++) {
+		if (slot[c] != NULL) {
+			slot[c]->channel = -1;
+			slot[c] = NULL;
+		}
+	}
+	SIT_bank[tid] = NULL;
+	__set_PRIMASK(primask);
+
+	for (uint8_t c = 0; c < channels; c++)
+		detachSystemInterrupt(hw.sysint[c]);
+	if (hw.ownIrq) {
+		NVIC_InitTypeDef nvicStructure;
+		nvicStructure.NVIC_IRQChannel = hw.irq;
+		nvicStructure.NVIC_IRQChannelCmd = DISABLE;
+		NVIC_Init(&nvicStructure);
+	}
+#endif
+	hwTimer.end();
+	TIMx = NULL;
+	channels = 0;
+}
+
+
+// ------------------------------------------------------------
+// SIT id of the free timer with the most compare channels that
+// drives no analogWrite pins, NUM_SIT if there is none
+// ------------------------------------------------------------
+uint8_t IntervalCompare::pick(void) {
+	uint8_t best = IntervalTimer::NUM_SIT;
+#if defined(PLATFORM_ID)
+	uint8_t most = 0;
+	for (uint8_t tid = 0; tid < IntervalTimer::NUM_SIT; tid++) {
+		if (SIT_COMPARE[tid].channels <= most || IntervalTimer::used_SIT(tid) || IntervalTimer::pwmConflict_SIT(tid))
+			continue;
+		best = tid;
+		most = SIT_COMPARE[tid].channels;
+	}
+#endif
+	return best;
+}
+
+
+// ------------------------------------------------------------
+// Counter ticks in ns, rounded
+// ------------------------------------------------------------
+uint32_t IntervalCompare::ticks(uint64_t ns) const {
+	uint64_t t = (SIT_Solver::clocksFromNs(ns, IntervalTimer::clock_SIT(hwTimer.SIT_id)) + divider / 2) / divider;
+	return (t > UINT32_MAX) ? UINT32_MAX : (uint32_t)t;
+}
+
+
+// ------------------------------------------------------------
+// Counter ticks per second, rounded; 0 when stopped
+// ------------------------------------------------------------
+uint32_t IntervalCompare::tickHz(void) const {
+	if (TIMx == NULL)
+		return 0;
+	return (IntervalTimer::clock_SIT(hwTimer.SIT_id) + divider / 2) / divider;
+}
+
+
+// ------------------------------------------------------------
+// Channels not taken by a CompareTimer
+// ------------------------------------------------------------
+uint8_t IntervalCompare::free_SIT(void) const {
+	uint8_t n = 0;
+	for (uint8_t c = 0; c < channels; c++) {
+		if (slot[c] == NULL)
+			n++;
+	}
+	return n;
+}
+
+
+// ------------------------------------------------------------
+// Gives timer the lowest free channel.  Call with IRQs masked.
+// ------------------------------------------------------------
+bool IntervalCompare::claim(CompareTimer* timer) {
+	for (uint8_t c = 0; c < channels; c++) {
+		if (slot[c] != NULL)
+			continue;
+		switch (c) {
+		case 0:
+			timer->ccr = &TIMx->CCR1;
+			break;
+		case 1:
+			timer->ccr = &TIMx->CCR2;
+			break;
+		case 2:
+			timer->ccr = &TIMx->CCR3;
+			break;
+		case 3:
+			timer->ccr = &TIMx->CCR4;
+			break;
+		}
+		timer->channel = c;
+		slot[c] = timer;
+		return true;
+	}
+	return false;
+}
+
+
+// ------------------------------------------------------------
+// Stops timer's channel and frees it.  Call with IRQs masked.
+// ------------------------------------------------------------
+void IntervalCompare::release(CompareTimer* timer) {
+	int8_t c = timer->channel;
+	if (c < 0)
+		return;
+	TIM_ITConfig(TIMx, TIM_IT_CC1 << c, DISABLE);
+	TIM_ClearITPendingBit(TIMx, TIM_IT_CC1 << c);
+	slot[c] = NULL;
+	timer->channel = -1;
+}
+
+
+// ------------------------------------------------------------
+// Compare interrupt of SIT id: reads the pending flags once,
+// clears them in one write and expires each flagged channel,
+// lowest first.  On the Photon each channel's flag raises its
+// own system interrupt; the first call takes every flag pending,
+// so the calls after it return at once.
+// ------------------------------------------------------------
+void IntervalCompare::dispatch_SIT(uint8_t id) {
+	IntervalCompare* bank = SIT_bank[id];
+	if (bank == NULL)
+		return;
+
+	TIM_TypeDef* TIMx = bank->TIMx;
+	uint32_t flags = TIMx->SR & TIMx->DIER & SIT_CC_FLAGS;
+	if (flags == 0)
+		return;
+	TIM_ClearITPendingBit(TIMx, (uint16_t)flags);
+	do {
+		CompareTimer* timer = bank->slot[__builtin_ctz(flags) - 1];
+		flags &= flags - 1;
+		if (timer != NULL)
+			timer->expire();
+	} while (flags);
+}
+
+
+// ------------------------------------------------------------
+// Starts the timer on a free channel of its bank.  The first
+// expiry is first ticks from now, or with at set, when the
+// counter reaches first; then every ticks, or only once if
+// ticks is 0.
+// ------------------------------------------------------------
+bool CompareTimer::start(const SIT_Delegate& isrCallback, uint32_t ticks, uint32_t first, bool at) {
+	end();
+	if (!bank.isActive() || ticks > bank.mask || (ticks != 0 && ticks < IntervalCompare::MIN_TICKS)
+			|| (!at && (first < IntervalCompare::MIN_TICKS || first > bank.mask)))
+		return false;
+	myISRcallback = isrCallback;
+	period = ticks;
+	skipped = 0;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	TIM_TypeDef* TIMx = bank.TIMx;
+	uint32_t cnt = TIMx->CNT;
+	uint32_t due = at ? first : cnt + first;
+	if (((due - cnt) & bank.mask) < IntervalCompare::GUARD_TICKS || !bank.claim(this)) {
+		__set_PRIMASK(primask);
+		return false;
+	}
+	*ccr = due & bank.mask;
+	TIM_ClearITPendingBit(TIMx, TIM_IT_CC1 << channel);
+	TIM_ITConfig(TIMx, TIM_IT_CC1 << channel, ENABLE);
+	__set_PRIMASK(primask);
+	return true;
+}
+
+
+// ------------------------------------------------------------
+// Calls back every Period microseconds (uSec) or half
+// milliseconds (hmSec), the first time Offset + Period after
+// begin().  Period and Offset are rounded to whole ticks.
+// ------------------------------------------------------------
+bool CompareTimer::begin(const SIT_Delegate& isrCallback, uint32_t Period, bool scale, uint32_t Offset) {
+	uint64_t unit = (scale == hmSec) ? 500000ULL : 1000ULL;
+	return beginNs(isrCallback, Period * unit, Offset * unit);
+}
+
+
+// ------------------------------------------------------------
+// As begin(), with the period and offset in nanoseconds
+// ------------------------------------------------------------
+bool CompareTimer::beginNs(const SIT_Delegate& isrCallback, uint64_t periodNs, uint64_t offsetNs) {
+	uint32_t ticks = bank.ticks(periodNs);
+	uint64_t first = (uint64_t)ticks + bank.ticks(offsetNs);
+
+	if (ticks < IntervalCompare::MIN_TICKS || first > UINT32_MAX)
+		return false;
+	return start(isrCallback, ticks, (uint32_t)first, false);
+}
+
+
+// ------------------------------------------------------------
+// Calls back once, Delay microseconds (uSec) or half
+// milliseconds (hmSec) from now, then frees the channel
+// ------------------------------------------------------------
+bool CompareTimer::beginOnce(const SIT_Delegate& isrCallback, uint32_t Delay, bool scale) {
+	uint64_t unit = (scale == hmSec) ? 500000ULL : 1000ULL;
+	return start(isrCallback, 0, bank.ticks(Delay * unit), false);
+}
+
+
+// ------------------------------------------------------------
+// Calls back when the bank's counter (IntervalCompare::now())
+// reaches at, then every periodTicks ticks, or only once if
+// periodTicks is 0.  Timers started from one now() reading keep
+// exact phases to each other.  at must lie within one counter
+// span ahead; one already passed comes a whole span late.
+// ------------------------------------------------------------
+bool CompareTimer::beginAt(const SIT_Delegate& isrCallback, uint32_t periodTicks, uint32_t at) {
+	return start(isrCallback, periodTicks, at, true);
+}
+
+
+// ------------------------------------------------------------
+// Stops the timer and frees its channel
+// ------------------------------------------------------------
+void CompareTimer::end() {
+	if (channel < 0)
+		return;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	bank.release(this);
+	__set_PRIMASK(primask);
+}
+
+
+// ------------------------------------------------------------
+// Changes the period of a running periodic timer from its next
+// deadline on, without restarting it
+// ------------------------------------------------------------
+bool CompareTimer::resetPeriod_SIT(uint32_t newPeriod, bool scale) {
+	uint32_t ticks = bank.ticks((uint64_t)newPeriod * ((scale == hmSec) ? 500000ULL : 1000ULL));
+
+	if (channel < 0 || period == 0 || ticks < IntervalCompare::MIN_TICKS || ticks > bank.mask)
+		return false;
+	period = ticks;
+	return true;
+}
+
+
+// ------------------------------------------------------------
+// Channel ISR: moves the compare to the next deadline, then
+// calls back.  If the counter is already within GUARD_TICKS of
+// that deadline or past it, the deadlines missed are skipped,
+// keeping the phase.  A one-shot frees its channel first, so
+// its callback may start it again.
+// ------------------------------------------------------------
+void CompareTimer::expire(void) {
+	uint32_t p = period;
+
+	if (p == 0) {
+		SIT_Delegate callback = myISRcallback;
+		end();
+		callback();
+		return;
+	}
+
+	uint32_t deadline = *ccr;
+	uint32_t late = (bank.TIMx->CNT - deadline) & bank.mask;
+	uint32_t step = p;
+	if (late >= p - IntervalCompare::GUARD_TICKS) {
+		uint32_t behind = (late - (p - IntervalCompare::GUARD_TICKS)) / p + 1;
+		skipped += behind;
+		step += behind * p;
+	}
+	*ccr = (deadline + step) & bank.mask;
+	myISRcallback();
+}
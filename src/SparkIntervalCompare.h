@@ -0,0 +1,140 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __INTERVALCOMPARE_H__
+#define __INTERVALCOMPARE_H__
+
+#include "SparkIntervalTimer.h"
+
+class IntervalCompare;
+
+// ------------------------------------------------------------
+// One capture/compare channel of an IntervalCompare's timer,
+// used as a timer of its own.  Each expiry writes the next
+// deadline to the channel's CCR before the callback runs, so
+// the period is kept by the hardware: callbacks do not drift
+// with interrupt latency or their own run time, and channels of
+// one timer do not delay each other's deadlines.  Callbacks run
+// from the timer's interrupt, like IntervalTimer callbacks.
+// Unlike IntervalTimer::begin() there is no callback at start.
+// ------------------------------------------------------------
+class CompareTimer {
+	friend class IntervalCompare;
+
+  private:
+	typedef decltype(TIM_TypeDef::CCR1) CCR;
+
+	IntervalCompare& bank;
+	SIT_Delegate myISRcallback;
+	CCR* ccr;					// the channel's compare register
+	volatile uint32_t period;	// ticks between expiries, 0 = one-shot
+	volatile int8_t channel;	// 0-3, -1 when stopped
+	volatile uint32_t skipped;
+
+	bool start(const SIT_Delegate& isrCallback, uint32_t ticks, uint32_t first, bool at);
+	void expire(void);
+
+  public:
+	CompareTimer(IntervalCompare& cmp) : bank(cmp), ccr(NULL), period(0), channel(-1), skipped(0) {}
+	~CompareTimer() { end(); }
+
+	bool begin(const SIT_Delegate& isrCallback, uint32_t Period, bool scale, uint32_t Offset = 0);
+	bool beginNs(const SIT_Delegate& isrCallback, uint64_t periodNs, uint64_t offsetNs = 0);
+	bool beginOnce(const SIT_Delegate& isrCallback, uint32_t Delay, bool scale);
+	bool beginAt(const SIT_Delegate& isrCallback, uint32_t periodTicks, uint32_t at);
+	void end();
+	bool resetPeriod_SIT(uint32_t newPeriod, bool scale);
+
+	bool isActive(void) const { return channel >= 0; }
+	int8_t channel_SIT(void) const { return channel; }
+	uint32_t missed_SIT(void) const { return skipped; }
+};
+
+// ------------------------------------------------------------
+// Runs a SIT's counter free over its full width and exposes its
+// capture/compare channels as independent CompareTimers, up to
+// four per timer:
+//   Core:   TIMER2, TIMER3, TIMER4            4 channels each
+//   Photon: TIMER3, TIMER4, TIMER5, TIMER1,   4 channels each
+//           TIMER8
+//           TIMER9, TIMER12                   2 channels each
+//           TIMER10, TIMER11, TIMER13,        1 channel each
+//           TIMER14
+// The update interrupt stays off; one handler per timer reads
+// the pending compare flags once, clears them in one write and
+// expires each channel flagged, lowest first.
+//
+// Periods are whole counter ticks (1us after begin(), or as
+// set with beginNs()) from 10 ticks up to the counter's span
+// less one: 65535 ticks on 16 bit timers.  A channel that falls
+// a whole period behind skips the deadlines it missed, keeping
+// its phase, and counts them (CompareTimer::missed_SIT()).
+//
+// The timer is taken from the SIT pool, so it is not available
+// to IntervalTimers meanwhile; timers in use by analogWrite are
+// refused, as their channels are busy.  The Core v0.3.4 firmware
+// has no compare interrupt hooks and is not supported.
+//
+//   IntervalCompare cmp;
+//   CompareTimer a(cmp), b(cmp);
+//   cmp.begin();
+//   a.begin(stepX, 250, uSec);
+//   b.begin(stepY, 400, uSec, 100);		// 100us later
+// ------------------------------------------------------------
+class IntervalCompare {
+	friend class CompareTimer;
+
+  private:
+	static const uint32_t MIN_TICKS = 10;		// shortest period or first deadline
+	static const uint32_t GUARD_TICKS = 2;		// a deadline this close is treated as passed
+
+	IntervalTimer hwTimer;
+	TIM_TypeDef* TIMx;
+	uint8_t channels;
+	uint32_t mask;				// counter span - 1
+	uint32_t divider;			// timer clocks per tick, PSC + 1
+	CompareTimer* volatile slot[4];
+
+	static IntervalCompare* volatile SIT_bank[IntervalTimer::NUM_SIT];
+
+	static uint8_t pick(void);
+	uint32_t ticks(uint64_t ns) const;
+	bool claim(CompareTimer* timer);
+	void release(CompareTimer* timer);
+
+  public:
+	IntervalCompare() : TIMx(NULL), channels(0), mask(0), divider(1), slot() {}
+	~IntervalCompare() { end(); }
+
+	bool begin(TIMid id = AUTO) { return beginNs(1000, id); }
+	bool beginNs(uint32_t tickNs, TIMid id = AUTO);
+	void end(void);
+
+	uint32_t now(void) const { return TIMx ? TIMx->CNT : 0; }	// counter, in ticks
+	uint32_t tickHz(void) const;
+	uint8_t channels_SIT(void) const { return channels; }
+	uint8_t free_SIT(void) const;
+	bool isActive(void) const { return TIMx != NULL; }
+
+	static void dispatch_SIT(uint8_t id);
+};
+
+#endif
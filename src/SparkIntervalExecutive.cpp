@@ -0,0 +1,217 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include "SparkIntervalExecutive.h"
+
+static uint32_t SIT_gcd(uint32_t a, uint32_t b)
+{
+	while (b != 0) {
+		uint32_t r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+// ------------------------------------------------------------
+// Registers a task to run every divisor frames.  Tasks can only
+// be added while the executive is stopped.  Returns false if it
+// is running, the table is full or divisor is 0.
+// ------------------------------------------------------------
+bool IntervalExecutive::add(const SIT_Delegate& isrCallback, uint16_t divisor)
+{
+	if (TIMx != NULL || count >= SIT_MAX_RATE_TASKS || divisor == 0)
+		return false;
+
+	tasks[count].callback = isrCallback;
+	tasks[count].divisor = divisor;
+	tasks[count].phase = 0;
+	count++;
+	return true;
+}
+
+// ------------------------------------------------------------
+// Stops the executive and removes every task
+// ------------------------------------------------------------
+void IntervalExecutive::clear(void)
+{
+	end();
+	count = 0;
+}
+
+// ------------------------------------------------------------
+// Phases the tasks and starts the frame tick on a SIT allocated
+// from the pool (or the specified id).  Period and scale are as
+// for IntervalTimer::begin() and give the frame length.
+// ------------------------------------------------------------
+bool IntervalExecutive::begin(intPeriod Period, bool scale, TIMid id)
+{
+	end();
+	if (count == 0)
+		return false;
+
+	stagger();
+	for (uint8_t i = 0; i < count; i++)
+		tasks[i].countdown = tasks[i].phase;
+	resetStats();
+	frameStats.budget = (uint32_t)Period + 1;
+	frameStats.maxTasks = busiest();
+
+	if (!hwTimer.begin(this, &IntervalExecutive::tick, Period, scale, id))
+		return false;
+	TIMx = hwTimer.timer_SIT();
+	return true;
+}
+
+void IntervalExecutive::end()
+{
+	if (TIMx == NULL)
+		return;
+
+	hwTimer.end();
+	TIMx = NULL;
+}
+
+// ------------------------------------------------------------
+// Gives each task in turn the phase (0 to divisor - 1) sharing
+// the smallest fraction of frames with the tasks already placed.
+// A task of divisor a at phase p and one of divisor b at phase q
+// meet every lcm(a, b) frames if p and q agree modulo gcd(a, b),
+// and never otherwise.  The first phase with no shared frames
+// is taken as soon as it is found.
+// ------------------------------------------------------------
+void IntervalExecutive::stagger(void)
+{
+	for (uint8_t i = 0; i < count; i++) {
+		Task& t = tasks[i];
+		double best = 0;
+
+		t.phase = 0;
+		for (uint32_t p = 0; p < t.divisor; p++) {
+			double shared = 0;
+			for (uint8_t j = 0; j < i; j++) {
+				uint32_t g = SIT_gcd(t.divisor, tasks[j].divisor);
+				if (p % g == tasks[j].phase % g)
+					shared += (double)g / ((double)t.divisor * tasks[j].divisor);
+			}
+			if (p == 0 || shared < best) {
+				best = shared;
+				t.phase = (uint16_t)p;
+			}
+			if (shared == 0)
+				break;
+		}
+	}
+}
+
+// ------------------------------------------------------------
+// Most tasks run in any one frame over the schedule's period
+// (the lcm of the divisors), or its first SCAN_FRAMES frames
+// ------------------------------------------------------------
+uint8_t IntervalExecutive::busiest(void)
+{
+	uint32_t frames = 1;
+	for (uint8_t i = 0; i < count && frames < SCAN_FRAMES; i++)
+		frames = frames / SIT_gcd(frames, tasks[i].divisor) * tasks[i].divisor;
+	if (frames > SCAN_FRAMES)
+		frames = SCAN_FRAMES;
+
+	uint8_t most = 0;
+	for (uint32_t f = 0; f < frames; f++) {
+		uint8_t n = 0;
+		for (uint8_t i = 0; i < count; i++) {
+			if (f % tasks[i].divisor == tasks[i].phase)
+				n++;
+		}
+		if (n > most)
+			most = n;
+	}
+	return most;
+}
+
+// ------------------------------------------------------------
+// SIT callback: runs the tasks due in this frame, then checks
+// how far into the frame they finished.  An update already
+// pending means the next frame is due: the frame overran.
+// ------------------------------------------------------------
+void IntervalExecutive::tick(void)
+{
+	// starting the SIT raises an update before begin() has set TIMx;
+	// it is not a frame
+	if (TIMx == NULL)
+		return;
+
+	uint32_t ran = 0;
+	for (uint8_t i = 0; i < count; i++) {
+		Task& t = tasks[i];
+		if (t.countdown == 0) {
+			t.countdown = t.divisor - 1;
+			ran |= 1UL << i;
+			t.callback();
+		}
+		else
+			t.countdown--;
+	}
+
+	uint32_t length = TIMx->CNT;
+	if (TIMx->SR & TIM_IT_Update) {
+		length = frameStats.budget + TIMx->CNT;
+		frameStats.overruns++;
+	}
+	if (length > frameStats.worst) {
+		frameStats.worst = length;
+		frameStats.worstFrame = frameStats.frames;
+		frameStats.worstTasks = ran;
+	}
+	frameStats.frames++;
+}
+
+// ------------------------------------------------------------
+// Copies the frame figures.  Returns false if the executive
+// has not been started.
+// ------------------------------------------------------------
+bool IntervalExecutive::stats(SIT_FrameStats& snapshot)
+{
+	if (frameStats.budget == 0)
+		return false;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	snapshot = frameStats;
+	__set_PRIMASK(primask);
+	return true;
+}
+
+// ------------------------------------------------------------
+// Clears the frame counts and the worst frame, also done by
+// begin(); the budget and maxTasks are kept
+// ------------------------------------------------------------
+void IntervalExecutive::resetStats(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	frameStats.frames = 0;
+	frameStats.overruns = 0;
+	frameStats.worst = 0;
+	frameStats.worstFrame = 0;
+	frameStats.worstTasks = 0;
+	__set_PRIMASK(primask);
+}
@@ -0,0 +1,97 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __INTERVALEXECUTIVE_H__
+#define __INTERVALEXECUTIVE_H__
+
+#include "SparkIntervalTimer.h"
+
+#ifndef SIT_MAX_RATE_TASKS
+#define SIT_MAX_RATE_TASKS	8		// task table size, at most 32
+#endif
+
+// ------------------------------------------------------------
+// Frame figures of an IntervalExecutive.  Frame lengths are in
+// timer ticks from the update event that starts the frame to
+// the end of its last task, so they include interrupt entry; a
+// frame overruns when it is still running at the next update.
+// worstTasks has bit i set for each task that ran in the worst
+// frame.  maxTasks is the most tasks the chosen phases put in
+// any one frame.
+// ------------------------------------------------------------
+struct SIT_FrameStats {
+	uint32_t frames;
+	uint32_t overruns;
+	uint32_t budget;			// frame length, ARR + 1 ticks
+	uint32_t worst;				// longest frame
+	uint32_t worstFrame;		// number of the longest frame
+	uint32_t worstTasks;
+	uint8_t maxTasks;
+};
+
+// ------------------------------------------------------------
+// Cyclic executive: one SIT ticks at the base (frame) period
+// and each registered task runs every divisor frames, so a set
+// of rate groups costs a single timer.  At begin() each task is
+// given a phase offset within its divisor chosen to share as few
+// frames as possible with the tasks added before it, so tasks
+// whose rates are harmonics of each other are staggered rather
+// than all running on the frames where their periods align.
+// Tasks run from the SIT interrupt in the order they were added.
+// ------------------------------------------------------------
+class IntervalExecutive {
+  private:
+	static const uint32_t SCAN_FRAMES = 4096;	// longest schedule checked for maxTasks
+	static_assert(SIT_MAX_RATE_TASKS <= 32, "worstTasks holds one bit per task");
+
+	struct Task {
+		SIT_Delegate callback;
+		uint16_t divisor;
+		uint16_t phase;
+		uint16_t countdown;		// frames until the task runs next
+	};
+
+	IntervalTimer hwTimer;
+	TIM_TypeDef* TIMx;
+	Task tasks[SIT_MAX_RATE_TASKS];
+	uint8_t count;
+	SIT_FrameStats frameStats;
+
+	void tick(void);
+	void stagger(void);
+	uint8_t busiest(void);
+
+  public:
+	IntervalExecutive() : TIMx(NULL), count(0), frameStats() {}
+	~IntervalExecutive() { end(); }
+
+	bool add(const SIT_Delegate& isrCallback, uint16_t divisor);
+	void clear(void);
+	uint8_t size(void) const { return count; }
+	uint16_t phase(uint8_t task) const { return (task < count) ? tasks[task].phase : 0; }
+
+	bool begin(intPeriod Period, bool scale, TIMid id = AUTO);
+	void end();
+	bool stats(SIT_FrameStats& snapshot);
+	void resetStats(void);
+};
+
+#endif
@@ -0,0 +1,291 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include "SparkIntervalPattern.h"
+
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+// DMA1 channel serving each SIT's update request (TIM2, TIM3, TIM4)
+static DMA_Channel_TypeDef* const SIT_DMA_CHANNEL[] = { DMA1_Channel2, DMA1_Channel3, DMA1_Channel7 };
+static const uint8_t SIT_DMA_NUMBER[] = { 2, 3, 7 };
+const uint8_t SIT_PATTERN_DMA = 1;
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+// DMA2 stream and channel serving the update request of the
+// pool timers whose requests reach DMA2.  Streams 1 and 5 both
+// sit second in their flag register (LISR and HISR).
+struct SIT_PatternDMA {
+	TIMid id;
+	DMA_Stream_TypeDef* stream;
+	uint8_t number;
+	uint32_t channel;
+	bool high;
+};
+static const SIT_PatternDMA SIT_DMA_STREAM[] = {
+	{ TIMER1, DMA2_Stream5, 5, DMA_Channel_6, true },
+	{ TIMER8, DMA2_Stream1, 1, DMA_Channel_7, false },
+};
+const uint8_t SIT_PATTERN_DMA = 2;
+const uint8_t SIT_DMA_FLAG_SHIFT = 6;
+const uint32_t SIT_DMA_FLAGS = 0x3D;			// FEIF, DMEIF, TEIF, HTIF and TCIF of stream 0
+#endif
+
+
+// ------------------------------------------------------------
+// Starts playback of len words from buf to port->BSRR, one word
+// every Period + 1 counts of the timebase (uSec or hmSec, as for
+// IntervalTimer::begin).  buf must stay valid until end().
+// ------------------------------------------------------------
+bool IntervalPattern::begin(GPIO_TypeDef* port, uint32_t* buf, uint16_t len, intPeriod Period, bool scale, TIMid id) {
+	if (Period < 1 || Period > hwTimer.maxPeriod_SIT(id))
+		return false;
+	return start(port, buf, len, Period, hwTimer.prescaler_SIT(scale, id), id);
+}
+
+
+// ------------------------------------------------------------
+// Same as begin with one word every ns nanoseconds.  DMA takes
+// the bus for each word, so periods are limited to MIN_CLOCKS.
+// ------------------------------------------------------------
+bool IntervalPattern::beginNs(GPIO_TypeDef* port, uint32_t* buf, uint16_t len, uint64_t ns, TIMid id) {
+	const uint64_t MIN_CLOCKS = 24;
+	uint8_t sit = (id < IntervalTimer::NUM_SIT) ? id : 0;
+
+	uint64_t clocks = SIT_Solver::clocksFromNs(ns, IntervalTimer::clock_SIT(sit));
+	if (clocks < MIN_CLOCKS)
+		return false;
+	SIT_Solution sol = SIT_Solver::solve(clocks, (id < IntervalTimer::NUM_SIT) ? IntervalTimer::maxReload_SIT(id) : UINT16_MAX);
+	if (!sol.valid())
+		return false;
+	return start(port, buf, len, sol.reload, sol.prescaler, id);
+}
+
+
+// ------------------------------------------------------------
+// Allocates the SIT through IntervalTimer, then swaps its update
+// interrupt for a DMA request feeding the port's BSRR register.
+// The SIT's DMA channel or stream is reserved first, and SITs
+// whose one is taken are passed over.
+// ------------------------------------------------------------
+bool IntervalPattern::start(GPIO_TypeDef* port, uint32_t* buf, uint16_t len, intPeriod Period, uint16_t prescaler, TIMid id) {
+
+	end();
+	if (buf == NULL || len < 2)
+		return false;
+
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	bool allocated = false;
+	for (uint8_t sit = 0; sit < IntervalTimer::NUM_SIT && !allocated; sit++) {
+		if ((id < IntervalTimer::NUM_SIT && sit != id) || IntervalTimer::used_SIT(sit))
+			continue;
+		if (!IntervalTimer::claimDMA_SIT(SIT_PATTERN_DMA, SIT_DMA_NUMBER[sit]))
+			continue;
+		allocated = hwTimer.beginCycles(SIT_Delegate(), Period, prescaler, (TIMid)sit);
+		if (!allocated)
+			IntervalTimer::releaseDMA_SIT(SIT_PATTERN_DMA, SIT_DMA_NUMBER[sit]);
+	}
+	if (!allocated)
+		return false;
+	channel = SIT_DMA_CHANNEL[hwTimer.SIT_id];
+	dmaNumber = SIT_DMA_NUMBER[hwTimer.SIT_id];
+	flagShift = 4 * (dmaNumber - 1);
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	// with AUTO, prescaler is for SYSCORECLOCK and is scaled to the SIT picked
+	const SIT_PatternDMA* dma = NULL;
+	for (uint8_t i = 0; i < sizeof(SIT_DMA_STREAM) / sizeof(SIT_DMA_STREAM[0]) && dma == NULL; i++) {
+		uint16_t scaled = prescaler;
+		if (id < IntervalTimer::NUM_SIT && id != SIT_DMA_STREAM[i].id)
+			continue;
+		if (id >= IntervalTimer::NUM_SIT && !IntervalTimer::rescale_SIT(SIT_DMA_STREAM[i].id, scaled))
+			continue;
+		if (!IntervalTimer::claimDMA_SIT(SIT_PATTERN_DMA, SIT_DMA_STREAM[i].number))
+			continue;
+		if (hwTimer.beginCycles(SIT_Delegate(), Period, scaled, SIT_DMA_STREAM[i].id))
+			dma = &SIT_DMA_STREAM[i];
+		else
+			IntervalTimer::releaseDMA_SIT(SIT_PATTERN_DMA, SIT_DMA_STREAM[i].number);
+	}
+	if (dma == NULL)
+		return false;
+	stream = dma->stream;
+	dmaNumber = dma->number;
+	isr = dma->high ? &DMA2->HISR : &DMA2->LISR;
+	ifcr = dma->high ? &DMA2->HIFCR : &DMA2->LIFCR;
+	flagShift = SIT_DMA_FLAG_SHIFT;
+#endif
+
+	// no update interrupts, only the DMA request
+	TIMx = hwTimer.timer_SIT();
+	TIM_Cmd(TIMx, DISABLE);
+	TIM_ITConfig(TIMx, TIM_IT_Update, DISABLE);
+	TIM_ClearITPendingBit(TIMx, TIM_IT_Update);
+
+	buffer = buf;
+	length = len;
+	halves = 0;
+	missed = 0;
+
+	DMA_InitTypeDef dmaInitStructure;
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+	DMA_DeInit(channel);
+	dmaInitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&port->BSRR;
+	dmaInitStructure.DMA_MemoryBaseAddr = (uint32_t)(uintptr_t)buf;
+	dmaInitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+	dmaInitStructure.DMA_BufferSize = len;
+	dmaInitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	dmaInitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	dmaInitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+	dmaInitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+	dmaInitStructure.DMA_Mode = DMA_Mode_Circular;
+	dmaInitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+	dmaInitStructure.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(channel, &dmaInitStructure);
+	DMA1->IFCR = (uint32_t)0x0F << flagShift;
+	DMA_Cmd(channel, ENABLE);
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+	DMA_Cmd(stream, DISABLE);
+	DMA_DeInit(stream);
+	dmaInitStructure.DMA_Channel = dma->channel;
+	dmaInitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&port->BSRRL;	// BSRRL and BSRRH as one word
+	dmaInitStructure.DMA_Memory0BaseAddr = (uint32_t)(uintptr_t)buf;
+	dmaInitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+	dmaInitStructure.DMA_BufferSize = len;
+	dmaInitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	dmaInitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	dmaInitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+	dmaInitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+	dmaInitStructure.DMA_Mode = DMA_Mode_Circular;
+	dmaInitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+	dmaInitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+	dmaInitStructure.DMA_FIFOThreshold = DMA_FIFOThreshold_HalfFull;
+	dmaInitStructure.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+	dmaInitStructure.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+	DMA_Init(stream, &dmaInitStructure);
+	*ifcr = SIT_DMA_FLAGS << flagShift;
+	DMA_Cmd(stream, ENABLE);
+#endif
+
+	TIM_DMACmd(TIMx, TIM_DMA_Update, ENABLE);
+	TIMx->CNT = 0;
+	TIM_Cmd(TIMx, ENABLE);
+	return true;
+}
+
+
+// ------------------------------------------------------------
+// Stops playback and releases the SIT.  Pins keep the state the
+// last word left them in.
+// ------------------------------------------------------------
+void IntervalPattern::end(void) {
+	if (TIMx == NULL)
+		return;
+
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	TIM_DMACmd(TIMx, TIM_DMA_Update, DISABLE);
+	DMA_Cmd(channel, DISABLE);
+	DMA1->IFCR = (uint32_t)0x0F << flagShift;
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	TIM_DMACmd(TIMx, TIM_DMA_Update, DISABLE);
+	DMA_Cmd(stream, DISABLE);
+	*ifcr = SIT_DMA_FLAGS << flagShift;
+#endif
+	IntervalTimer::releaseDMA_SIT(SIT_PATTERN_DMA, dmaNumber);
+	hwTimer.end();
+	TIMx = NULL;
+}
+
+
+// ------------------------------------------------------------
+// Call from loop() at least twice per buffer period.  If a half
+// of the buffer has gone out since the last call, runs the half
+// or complete callback for it and returns 1, else returns 0.  If
+// both halves went out, one refill was missed: an overrun is
+// counted and only the half that is free now gets reported.
+// ------------------------------------------------------------
+uint8_t IntervalPattern::service(void) {
+	if (TIMx == NULL)
+		return 0;
+
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	uint32_t flags = (DMA1->ISR >> flagShift) & (DMA_ISR_HTIF1 | DMA_ISR_TCIF1);
+	const uint32_t HALF = DMA_ISR_HTIF1, BOTH = DMA_ISR_HTIF1 | DMA_ISR_TCIF1;
+	if (flags == 0)
+		return 0;
+	DMA1->IFCR = flags << flagShift;
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	uint32_t flags = (*isr >> flagShift) & (DMA_LISR_HTIF0 | DMA_LISR_TCIF0);
+	const uint32_t HALF = DMA_LISR_HTIF0, BOTH = DMA_LISR_HTIF0 | DMA_LISR_TCIF0;
+	if (flags == 0)
+		return 0;
+	*ifcr = flags << flagShift;
+#endif
+
+	bool firstHalfFree;
+	if (flags == BOTH) {
+		missed++;
+		firstHalfFree = position() >= length / 2;
+	}
+	else
+		firstHalfFree = (flags == HALF);
+
+	halves++;
+	if (firstHalfFree) {
+		if (halfCallback.isSet()) halfCallback();
+	}
+	else {
+		if (completeCallback.isSet()) completeCallback();
+	}
+	return 1;
+}
+
+
+// ------------------------------------------------------------
+// Index of the next word the DMA will write
+// ------------------------------------------------------------
+uint16_t IntervalPattern::position(void) {
+	if (TIMx == NULL)
+		return 0;
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	return length - DMA_GetCurrDataCounter(channel);
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	return length - DMA_GetCurrDataCounter(stream);
+#endif
+}
+
+
+// ------------------------------------------------------------
+// GPIO port and BSRR bit of a pin, for building pattern words
+// ------------------------------------------------------------
+GPIO_TypeDef* IntervalPattern::port(uint16_t pin) {
+#if !defined(PLATFORM_ID)							//Core v0.3.4
+	return PIN_MAP[pin].gpio_peripheral;
+#else
+	return HAL_Pin_Map()[pin].gpio_peripheral;
+#endif
+}
+
+uint16_t IntervalPattern::mask(uint16_t pin) {
+#if !defined(PLATFORM_ID)							//Core v0.3.4
+	return PIN_MAP[pin].gpio_pin;
+#else
+	return HAL_Pin_Map()[pin].gpio_pin;
+#endif
+}
@@ -0,0 +1,90 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __INTERVALPATTERN_H__
+#define __INTERVALPATTERN_H__
+
+#include "SparkIntervalTimer.h"
+
+// BSRR words: the low half sets pins, the high half resets them
+#define SIT_BSRR_SET(mask)		((uint32_t)(mask))
+#define SIT_BSRR_RESET(mask)	((uint32_t)(mask) << 16)
+
+// ------------------------------------------------------------
+// Plays a buffer of BSRR words to one GPIO port by DMA, one word
+// per update event of a SIT, so output costs no CPU per sample.
+// The buffer is circular: service(), polled from loop(), calls
+// the half callback once the first half has gone out and the
+// complete callback once the second half has, so each half can
+// be refilled while the other one plays.
+//
+// Core: TIMER2/3/4 update requests are served by DMA1 channel
+// 2/3/7 (shared with SPI1 RX/TX and USART2 TX).  Photon: DMA1
+// cannot reach GPIO, so only TIMER1 and TIMER8, whose update
+// requests go to DMA2 stream 5 and stream 1, can play patterns.
+// A timer whose channel or stream another driver has reserved
+// (IntervalTimer::claimDMA_SIT) is not used.
+// ------------------------------------------------------------
+class IntervalPattern {
+  private:
+	IntervalTimer hwTimer;
+	TIM_TypeDef* TIMx;
+	uint32_t* buffer;
+	uint16_t length;
+	SIT_Delegate halfCallback;
+	SIT_Delegate completeCallback;
+	uint32_t halves;			// halves reported by service()
+	uint32_t missed;			// halves that went out twice before service() saw them
+	uint8_t dmaNumber;			// DMA1 channel (Core) or DMA2 stream (Photon) reserved
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)
+	DMA_Channel_TypeDef* channel;
+	uint8_t flagShift;			// position of the channel's flags in DMA1->ISR
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)
+	DMA_Stream_TypeDef* stream;
+	volatile uint32_t* isr;		// DMA2->LISR or HISR, and the matching flag clear register
+	volatile uint32_t* ifcr;
+	uint8_t flagShift;			// position of the stream's flags in isr
+#endif
+
+	bool start(GPIO_TypeDef* port, uint32_t* buf, uint16_t len, intPeriod Period, uint16_t prescaler, TIMid id);
+
+  public:
+	IntervalPattern() : TIMx(NULL), buffer(NULL), length(0), halves(0), missed(0) {}
+	~IntervalPattern() { end(); }
+
+	bool begin(GPIO_TypeDef* port, uint32_t* buf, uint16_t len, intPeriod Period, bool scale, TIMid id = AUTO);
+	bool beginNs(GPIO_TypeDef* port, uint32_t* buf, uint16_t len, uint64_t ns, TIMid id = AUTO);
+	void end(void);
+
+	void onHalf(const SIT_Delegate& callback) { halfCallback = callback; }
+	void onComplete(const SIT_Delegate& callback) { completeCallback = callback; }
+
+	uint8_t service(void);
+	uint16_t position(void);
+	uint32_t serviced(void) { return halves; }
+	uint32_t overruns(void) { return missed; }
+	bool isActive(void) { return TIMx != NULL; }
+
+	static GPIO_TypeDef* port(uint16_t pin);
+	static uint16_t mask(uint16_t pin);
+};
+
+#endif
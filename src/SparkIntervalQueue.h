@@ -0,0 +1,129 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __INTERVALQUEUE_H__
+#define __INTERVALQUEUE_H__
+
+#include <stdint.h>
+#include <atomic>
+
+// ------------------------------------------------------------
+// Wait-free single producer / single consumer queue for passing
+// data from an IntervalTimer callback to loop() without turning
+// interrupts off.  The callback is the only producer (push) and
+// loop() the only consumer (pop, peek/consume, drain).
+//
+// Capacity N must be a power of two; head and tail are free
+// running 32 bit counters, so all N slots are usable.  A push
+// into a full queue fails and is counted in overflows() rather
+// than overwriting unread data.
+//
+// Only std::atomic loads and stores are used (plain LDR/STR plus
+// barriers on Cortex-M3), so it has no Particle dependencies and
+// can be exercised on a host with two threads.
+// ------------------------------------------------------------
+template <typename T, uint32_t N>
+class SIT_Queue {
+	static_assert(N >= 2 && (N & (N - 1)) == 0, "SIT_Queue capacity must be a power of two");
+
+  private:
+	static const uint32_t MASK = N - 1;
+
+	T buf[N];
+	std::atomic<uint32_t> head;		// next slot to write, owned by the producer
+	std::atomic<uint32_t> tail;		// next slot to read, owned by the consumer
+	std::atomic<uint32_t> dropped;	// failed pushes, written by the producer only
+
+  public:
+	SIT_Queue() : head(0), tail(0), dropped(0) {}
+
+	// ------------------------------------------------------------
+	// Producer side (interrupt context)
+	// ------------------------------------------------------------
+	bool push(const T& item) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+
+		if (h - tail.load(std::memory_order_acquire) == N) {
+			dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return false;
+		}
+		buf[h & MASK] = item;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// ------------------------------------------------------------
+	// Consumer side (loop)
+	// ------------------------------------------------------------
+	bool pop(T& item) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+
+		if (head.load(std::memory_order_acquire) == t)
+			return false;
+		item = buf[t & MASK];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Points data at the oldest unread item and returns how many
+	// items follow it contiguously (up to the end of the buffer).
+	// The items stay valid until consume() releases them.
+	uint32_t peek(const T*& data) const {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		uint32_t count = head.load(std::memory_order_acquire) - t;
+		uint32_t toEnd = N - (t & MASK);
+
+		data = &buf[t & MASK];
+		return (count < toEnd) ? count : toEnd;
+	}
+
+	void consume(uint32_t count) {
+		tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+
+	// Hands every unread item to fn(const T* data, uint32_t count)
+	// in at most two contiguous batches, returns the items drained
+	template <typename F>
+	uint32_t drain(F fn) {
+		uint32_t total = 0;
+		const T* data;
+		uint32_t count;
+
+		for (int pass = 0; pass < 2 && (count = peek(data)) != 0; pass++) {
+			fn(data, count);
+			consume(count);
+			total += count;
+		}
+		return total;
+	}
+
+	// ------------------------------------------------------------
+	// Either side
+	// ------------------------------------------------------------
+	uint32_t available() const {
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+
+	uint32_t overflows() const { return dropped.load(std::memory_order_relaxed); }
+	static uint32_t capacity() { return N; }
+};
+
+#endif
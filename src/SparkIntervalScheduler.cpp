@@ -0,0 +1,231 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include "SparkIntervalScheduler.h"
+
+// ------------------------------------------------------------
+// Starts the scheduler on a SIT allocated from the pool (or the
+// specified id).  The SIT idles at its longest period until the
+// first VirtualTimer is scheduled.
+// ------------------------------------------------------------
+bool IntervalScheduler::begin(TIMid id) {
+
+	end();
+	base = 0;
+	programmed = MAX_TICKS - 1;
+	if (!hwTimer.begin(this, &IntervalScheduler::tick, (intPeriod)programmed, uSec, id))
+		return false;
+	TIMx = hwTimer.timer_SIT();
+	return true;
+}
+
+
+// ------------------------------------------------------------
+// Stops the SIT and drops every pending VirtualTimer
+// ------------------------------------------------------------
+void IntervalScheduler::end() {
+	if (TIMx == NULL)
+		return;
+
+	hwTimer.end();
+	TIMx = NULL;
+	while (queue.pop() != NULL) ;
+}
+
+
+// ------------------------------------------------------------
+// Current scheduler time in microseconds (wraps at 2^32)
+// ------------------------------------------------------------
+uint32_t IntervalScheduler::now(void) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t t = base + elapsed();
+	__set_PRIMASK(primask);
+	return t;
+}
+
+
+// ------------------------------------------------------------
+// Ticks since the last serviced update event.  If the update
+// flag is pending the ISR has not yet advanced base, so the
+// full programmed interval is added.  Call with IRQs masked.
+// ------------------------------------------------------------
+uint32_t IntervalScheduler::elapsed(void) {
+	uint32_t cnt = TIMx->CNT;
+	if (TIMx->SR & TIM_IT_Update)
+		return programmed + 1 + TIMx->CNT;
+	return cnt;
+}
+
+
+// ------------------------------------------------------------
+// Loads ARR so the next update fires delta ticks after base.
+// The counter is already running, so ARR is kept a few ticks
+// ahead of CNT to avoid missing the compare and wrapping.
+// ------------------------------------------------------------
+void IntervalScheduler::program(uint32_t delta) {
+	uint32_t earliest = TIMx->CNT + MIN_TICKS;
+
+	if (delta < earliest)
+		delta = earliest;
+	if (delta > MAX_TICKS)
+		delta = MAX_TICKS;
+	programmed = delta - 1;
+	TIMx->ARR = programmed;
+}
+
+
+// ------------------------------------------------------------
+// SIT callback: advance time, run every expired VirtualTimer
+// and reprogram the SIT for the next deadline.  ARR is parked
+// at its longest while the callbacks run, so one running past
+// the next deadline cannot wrap the counter unseen.
+// ------------------------------------------------------------
+void IntervalScheduler::tick(void) {
+	VirtualTimer* vt;
+
+	// starting the SIT raises an update before begin() has set TIMx;
+	// it marks no elapsed interval
+	if (TIMx == NULL)
+		return;
+
+	base += programmed + 1;
+	programmed = MAX_TICKS - 1;
+	TIMx->ARR = programmed;
+	inTick = true;
+	while ((vt = queue.top()) != NULL && (int32_t)(vt->deadline - base) <= 0) {
+		queue.pop();
+		if (vt->period) {
+			vt->deadline += vt->period;
+			uint32_t t = base + elapsed();
+			if ((int32_t)(vt->deadline - t) <= 0)	// fell behind, skip missed periods but keep phase
+				vt->deadline += ((t - vt->deadline) / vt->period + 1) * vt->period;
+			queue.push(vt);
+		}
+		vt->myISRcallback();
+	}
+	inTick = false;
+
+	// callbacks that took over MAX_TICKS left an update pending,
+	// which accounts for the interval: leave ARR alone
+	if (TIMx->SR & TIM_IT_Update)
+		return;
+	vt = queue.top();
+	program(vt != NULL ? vt->deadline - base : MAX_TICKS);
+}
+
+
+// ------------------------------------------------------------
+// (Re)queues a VirtualTimer to expire delay ticks from now.
+// The SIT is only reprogrammed when the new deadline becomes
+// the earliest one; later deadlines are picked up by the ISR.
+// ------------------------------------------------------------
+bool IntervalScheduler::schedule(VirtualTimer* vt, uint32_t delay) {
+
+	if (TIMx == NULL)
+		return false;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	queue.remove(vt);
+	vt->deadline = base + elapsed() + delay;
+	bool ok = queue.push(vt);
+
+	if (ok && !inTick && queue.top() == vt && !(TIMx->SR & TIM_IT_Update)) {
+		uint32_t delta = vt->deadline - base;
+		if (delta <= programmed)
+			program(delta);
+	}
+
+	__set_PRIMASK(primask);
+	return ok;
+}
+
+
+// ------------------------------------------------------------
+// Removes a VirtualTimer.  The SIT is left as programmed; an
+// early wake-up with nothing expired simply reprograms it.
+// ------------------------------------------------------------
+void IntervalScheduler::cancel(VirtualTimer* vt) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	queue.remove(vt);
+	__set_PRIMASK(primask);
+}
+
+
+// ------------------------------------------------------------
+// Starts a periodic VirtualTimer.  Period units are defined by
+// scale as for IntervalTimer, but are not limited to 16 bits.
+// Returns false if the scheduler is not running or full.
+// ------------------------------------------------------------
+bool VirtualTimer::begin(const SIT_Delegate& isrCallback, uint32_t Period, bool scale) {
+	uint64_t ticks = toTicks(Period, scale);
+
+	if (ticks < 10 || ticks > INT32_MAX)
+		return false;
+	end();
+	myISRcallback = isrCallback;
+	period = (uint32_t)ticks;
+	return scheduler.schedule(this, (uint32_t)ticks);
+}
+
+
+// ------------------------------------------------------------
+// Starts a one-shot VirtualTimer which expires once after Delay
+// ------------------------------------------------------------
+bool VirtualTimer::beginOnce(const SIT_Delegate& isrCallback, uint32_t Delay, bool scale) {
+	uint64_t ticks = toTicks(Delay, scale);
+
+	if (ticks > INT32_MAX)
+		return false;
+	end();
+	myISRcallback = isrCallback;
+	period = 0;
+	return scheduler.schedule(this, (uint32_t)ticks);
+}
+
+
+// ------------------------------------------------------------
+// Cancels the VirtualTimer.  Safe to call from its own callback.
+// ------------------------------------------------------------
+void VirtualTimer::end() {
+	scheduler.cancel(this);
+}
+
+
+// ------------------------------------------------------------
+// Sets a new period, restarting the current interval from now
+// ------------------------------------------------------------
+void VirtualTimer::resetPeriod_SIT(uint32_t newPeriod, bool scale) {
+	uint64_t ticks = toTicks(newPeriod, scale);
+
+	if (ticks < 10 || ticks > INT32_MAX || !myISRcallback.isSet())
+		return;
+	period = (uint32_t)ticks;
+	scheduler.schedule(this, (uint32_t)ticks);
+}
+
+
+bool VirtualTimer::isActive(void) const {
+	return heapIndex != SIT_DeadlineQueue<VirtualTimer, 1>::NOT_QUEUED;
+}
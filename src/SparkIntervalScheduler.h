@@ -0,0 +1,102 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __INTERVALSCHEDULER_H__
+#define __INTERVALSCHEDULER_H__
+
+#include "SparkIntervalTimer.h"
+#include "SparkDeadlineQueue.h"
+
+#ifndef SIT_MAX_VIRTUAL_TIMERS
+#define SIT_MAX_VIRTUAL_TIMERS	32		// queue capacity, override before including
+#endif
+
+class IntervalScheduler;
+
+// ------------------------------------------------------------
+// A software timer multiplexed onto the single hardware SIT
+// owned by an IntervalScheduler.  Callbacks run from the SIT
+// interrupt, exactly like IntervalTimer callbacks.
+// ------------------------------------------------------------
+class VirtualTimer {
+	friend class IntervalScheduler;
+	template <typename T, uint16_t N> friend class SIT_DeadlineQueue;
+
+  private:
+	IntervalScheduler& scheduler;
+	SIT_Delegate myISRcallback;
+	uint32_t period;			// ticks between expiries, 0 = one-shot
+	uint32_t deadline;			// absolute expiry in scheduler ticks
+	uint16_t heapIndex;
+
+	static uint64_t toTicks(uint32_t Period, bool scale) {
+		return (scale == hmSec) ? (uint64_t)Period * 500 : Period;
+	}
+
+  public:
+	VirtualTimer(IntervalScheduler& sched) : scheduler(sched),
+		period(0), deadline(0), heapIndex(SIT_DeadlineQueue<VirtualTimer, 1>::NOT_QUEUED) {}
+	~VirtualTimer() { end(); }
+
+	bool begin(const SIT_Delegate& isrCallback, uint32_t Period, bool scale);
+	bool beginOnce(const SIT_Delegate& isrCallback, uint32_t Delay, bool scale);
+	void end();
+	void resetPeriod_SIT(uint32_t newPeriod, bool scale);
+	bool isActive(void) const;
+};
+
+// ------------------------------------------------------------
+// Tickless deadline scheduler.  Allocates one SIT at a 1us
+// timebase and reprograms its ARR to the next pending deadline
+// instead of ticking at a fixed rate, so the interrupt rate
+// follows the real event rate of the attached VirtualTimers.
+// ------------------------------------------------------------
+class IntervalScheduler {
+	friend class VirtualTimer;
+
+  private:
+	static const uint32_t MIN_TICKS = 10;		// smallest programmable distance, us
+	static const uint32_t MAX_TICKS = 65536;	// 16 bit ARR, idle wake-up interval
+
+	IntervalTimer hwTimer;
+	TIM_TypeDef* TIMx;
+	volatile uint32_t base;			// scheduler time of the last update event
+	volatile uint32_t programmed;	// ARR value currently loaded
+	volatile bool inTick;
+	SIT_DeadlineQueue<VirtualTimer, SIT_MAX_VIRTUAL_TIMERS> queue;
+
+	void tick(void);
+	void program(uint32_t delta);
+	uint32_t elapsed(void);
+	bool schedule(VirtualTimer* vt, uint32_t delay);
+	void cancel(VirtualTimer* vt);
+
+  public:
+	IntervalScheduler() : TIMx(NULL), base(0), programmed(MAX_TICKS - 1), inTick(false) {}
+	~IntervalScheduler() { end(); }
+
+	bool begin(TIMid id = AUTO);
+	void end();
+	uint32_t now(void);
+	uint16_t pending(void) const { return queue.size(); }
+};
+
+#endif
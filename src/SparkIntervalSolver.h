@@ -0,0 +1,136 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __INTERVALSOLVER_H__
+#define __INTERVALSOLVER_H__
+
+#include <stdint.h>
+
+#ifndef SIT_SOLVER_WINDOW
+#define SIT_SOLVER_WINDOW	64		// prescaler candidates tried above the smallest usable one
+#endif
+
+// ------------------------------------------------------------
+// A prescaler / auto-reload pair for a timer and the period it
+// actually produces, in timer input clock cycles:
+//   clocks = (prescaler + 1) * (reload + 1)
+// clocks is 0 if the requested period cannot be produced.
+// ------------------------------------------------------------
+struct SIT_Solution {
+	uint32_t prescaler;		// PSC register value
+	uint32_t reload;		// ARR register value
+	uint64_t clocks;		// achieved period in timer clock cycles
+
+	constexpr SIT_Solution(uint32_t psc, uint32_t arr, uint64_t clk)
+		: prescaler(psc), reload(arr), clocks(clk) {}
+
+	constexpr bool valid() const { return clocks != 0; }
+
+	constexpr uint64_t nanoseconds(uint32_t timerClock) const {
+		return (clocks / timerClock) * 1000000000ULL
+			+ ((clocks % timerClock) * 1000000000ULL + timerClock / 2) / timerClock;
+	}
+};
+
+// ------------------------------------------------------------
+// Finds the PSC/ARR pair whose period is closest to a target
+// given in timer clock cycles.  The smallest usable divider is
+// the one that just fits the target into the counter; it and
+// the next SIT_SOLVER_WINDOW - 1 dividers are tried, keeping
+// the smallest error and, on ties, the smallest divider (the
+// finest resolution for later period changes).
+//
+// Everything is C++11 constexpr, so constant arguments are
+// solved at compile time, and there are no Particle
+// dependencies so the solver can be checked on a host.
+// ------------------------------------------------------------
+struct SIT_Solver {
+	static const uint32_t MAX_DIVIDER = 65536;		// 16 bit PSC on every timer
+
+	// target period in timer clock cycles, rounded, without 64 bit overflow
+	static constexpr uint64_t clocksFromNs(uint64_t ns, uint32_t timerClock) {
+		return (ns / 1000000000ULL) * timerClock
+			+ ((ns % 1000000000ULL) * timerClock + 500000000ULL) / 1000000000ULL;
+	}
+
+	static constexpr uint64_t clocksFromHz(double hz, uint32_t timerClock) {
+		return hz > 0 ? (uint64_t)(timerClock / hz + 0.5) : 0;
+	}
+
+	static constexpr SIT_Solution solve(uint64_t clocks, uint32_t maxReload) {
+		return solveFrom(clocks, (uint64_t)maxReload + 1, minDivider(clocks, (uint64_t)maxReload + 1));
+	}
+
+	static constexpr SIT_Solution solveNs(uint64_t ns, uint32_t timerClock, uint32_t maxReload) {
+		return solve(clocksFromNs(ns, timerClock), maxReload);
+	}
+
+	static constexpr SIT_Solution solveHz(double hz, uint32_t timerClock, uint32_t maxReload) {
+		return solve(clocksFromHz(hz, timerClock), maxReload);
+	}
+
+  private:
+	static constexpr uint64_t absDiff(uint64_t a, uint64_t b) {
+		return a > b ? a - b : b - a;
+	}
+
+	static constexpr uint64_t minDivider(uint64_t clocks, uint64_t maxCount) {
+		return clocks <= maxCount ? 1 : (clocks + maxCount - 1) / maxCount;
+	}
+
+	static constexpr uint64_t clampCount(uint64_t count, uint64_t maxCount) {
+		return count < 1 ? 1 : (count > maxCount ? maxCount : count);
+	}
+
+	static constexpr uint64_t countFor(uint64_t clocks, uint64_t divider, uint64_t maxCount) {
+		return clampCount((clocks + divider / 2) / divider, maxCount);
+	}
+
+	static constexpr uint64_t errorFor(uint64_t clocks, uint64_t divider, uint64_t maxCount) {
+		return absDiff(countFor(clocks, divider, maxCount) * divider, clocks);
+	}
+
+	static constexpr uint64_t bestDivider(uint64_t clocks, uint64_t maxCount,
+			uint64_t divider, uint64_t last, uint64_t best) {
+		return divider > last ? best
+			: bestDivider(clocks, maxCount, divider + 1, last,
+				errorFor(clocks, divider, maxCount) < errorFor(clocks, best, maxCount) ? divider : best);
+	}
+
+	static constexpr uint64_t lastDivider(uint64_t first) {
+		return first + SIT_SOLVER_WINDOW - 1 < MAX_DIVIDER ? first + SIT_SOLVER_WINDOW - 1 : MAX_DIVIDER;
+	}
+
+	static constexpr SIT_Solution make(uint64_t divider, uint64_t count) {
+		return SIT_Solution((uint32_t)(divider - 1), (uint32_t)(count - 1), divider * count);
+	}
+
+	static constexpr SIT_Solution solveWith(uint64_t clocks, uint64_t maxCount, uint64_t divider) {
+		return make(divider, countFor(clocks, divider, maxCount));
+	}
+
+	static constexpr SIT_Solution solveFrom(uint64_t clocks, uint64_t maxCount, uint64_t first) {
+		return (clocks == 0 || first > MAX_DIVIDER) ? SIT_Solution(0, 0, 0)
+			: solveWith(clocks, maxCount, bestDivider(clocks, maxCount, first + 1, lastDivider(first), first));
+	}
+};
+
+#endif
@@ -27,118 +27,459 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 // ------------------------------------------------------------
 // static class variables need to be reiterated here before use
 // ------------------------------------------------------------
-bool IntervalTimer::SIT_used[];
-IntervalTimer::ISRcallback IntervalTimer::SIT_CALLBACK[];
+std::atomic<uint32_t> IntervalTimer::SIT_used(0);
+std::atomic<uint32_t> IntervalTimer::SIT_dmaUsed(0);
+std::atomic<bool> IntervalTimer::SIT_attached(false);
+SIT_Delegate IntervalTimer::SIT_CALLBACK[];
+SIT_Deferred IntervalTimer::SIT_deferred[];
+SIT_Overrun IntervalTimer::SIT_overrun[];
+SIT_Load IntervalTimer::SIT_load[];
+float IntervalTimer::SIT_loadCeiling = 0;
+#if SIT_ENABLE_STATS
+SIT_Stats IntervalTimer::SIT_stats[];
+#endif
+#if SIT_ENABLE_TRACE
+SIT_TraceEvent SIT_Trace::ring[];
+std::atomic<uint32_t> SIT_Trace::head(0);
+volatile bool SIT_Trace::full = false;
+volatile bool SIT_Trace::enabled = true;
+#endif
+
+// ------------------------------------------------------------
+// Hardware behind each SIT id: timer, update IRQ line, RCC
+// enable bit (in APB2ENR for APB2 timers, else APB1ENR) and the
+// system interrupt its update hook is attached to.  On the
+// Photon TIM1/TIM10 and TIM8/TIM13 share their update lines.
+// ------------------------------------------------------------
+struct SIT_Hardware {
+	TIM_TypeDef* TIMx;
+	IRQn_Type irq;
+	uint32_t rcc;
+	bool apb2;
+#if defined(PLATFORM_ID)
+	hal_irq_t sysint;
+	void (*hook)(void);
+#endif
+};
+
+#if !defined(PLATFORM_ID)							//Core v0.3.4
+static const SIT_Hardware SIT_HARDWARE[] = {
+	{ TIM2, TIM2_IRQn, RCC_APB1Periph_TIM2, false },
+	{ TIM3, TIM3_IRQn, RCC_APB1Periph_TIM3, false },
+	{ TIM4, TIM4_IRQn, RCC_APB1Periph_TIM4, false },
+};
+#elif defined(STM32F10X_MD)							//Core
+static const SIT_Hardware SIT_HARDWARE[] = {
+	{ TIM2, TIM2_IRQn, RCC_APB1Periph_TIM2, false, SysInterrupt_TIM2_Update, Wiring_TIM2_Interrupt_Handler_override },
+	{ TIM3, TIM3_IRQn, RCC_APB1Periph_TIM3, false, SysInterrupt_TIM3_Update, Wiring_TIM3_Interrupt_Handler_override },
+	{ TIM4, TIM4_IRQn, RCC_APB1Periph_TIM4, false, SysInterrupt_TIM4_Update, Wiring_TIM4_Interrupt_Handler_override },
+};
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+static const SIT_Hardware SIT_HARDWARE[] = {
+	{ TIM3, TIM3_IRQn, RCC_APB1Periph_TIM3, false, SysInterrupt_TIM3_Update, Wiring_TIM3_Interrupt_Handler_override },
+	{ TIM4, TIM4_IRQn, RCC_APB1Periph_TIM4, false, SysInterrupt_TIM4_Update, Wiring_TIM4_Interrupt_Handler_override },
+	{ TIM5, TIM5_IRQn, RCC_APB1Periph_TIM5, false, SysInterrupt_TIM5_Update, Wiring_TIM5_Interrupt_Handler_override },
+	{ TIM6, TIM6_DAC_IRQn, RCC_APB1Periph_TIM6, false, SysInterrupt_TIM6_Update, Wiring_TIM6_Interrupt_Handler_override },
+	{ TIM7, TIM7_IRQn, RCC_APB1Periph_TIM7, false, SysInterrupt_TIM7_Update, Wiring_TIM7_Interrupt_Handler_override },
+	{ TIM1, TIM1_UP_TIM10_IRQn, RCC_APB2Periph_TIM1, true, SysInterrupt_TIM1_Update, Wiring_TIM1_Interrupt_Handler_override },
+	{ TIM8, TIM8_UP_TIM13_IRQn, RCC_APB2Periph_TIM8, true, SysInterrupt_TIM8_Update, Wiring_TIM8_Interrupt_Handler_override },
+	{ TIM9, TIM1_BRK_TIM9_IRQn, RCC_APB2Periph_TIM9, true, SysInterrupt_TIM9_Update, Wiring_TIM9_Interrupt_Handler_override },
+	{ TIM10, TIM1_UP_TIM10_IRQn, RCC_APB2Periph_TIM10, true, SysInterrupt_TIM10_Update, Wiring_TIM10_Interrupt_Handler_override },
+	{ TIM11, TIM1_TRG_COM_TIM11_IRQn, RCC_APB2Periph_TIM11, true, SysInterrupt_TIM11_Update, Wiring_TIM11_Interrupt_Handler_override },
+	{ TIM12, TIM8_BRK_TIM12_IRQn, RCC_APB1Periph_TIM12, false, SysInterrupt_TIM12_Update, Wiring_TIM12_Interrupt_Handler_override },
+	{ TIM13, TIM8_UP_TIM13_IRQn, RCC_APB1Periph_TIM13, false, SysInterrupt_TIM13_Update, Wiring_TIM13_Interrupt_Handler_override },
+	{ TIM14, TIM8_TRG_COM_TIM14_IRQn, RCC_APB1Periph_TIM14, false, SysInterrupt_TIM14_Update, Wiring_TIM14_Interrupt_Handler_override },
+};
+#endif
+
+#if defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+// GPIO alternate function connecting pins to each SIT's timer
+static const uint8_t SIT_AF[] = {
+	GPIO_AF_TIM3, GPIO_AF_TIM4, GPIO_AF_TIM5, 0, 0, GPIO_AF_TIM1, GPIO_AF_TIM8,
+	GPIO_AF_TIM9, GPIO_AF_TIM10, GPIO_AF_TIM11, GPIO_AF_TIM12, GPIO_AF_TIM13, GPIO_AF_TIM14
+};
+#endif
 
 // ------------------------------------------------------------
-// Define interval timer ISR hooks for three available timers
-// TIM2...TIM7 with callbacks to user code.
+// Internal trigger (ITR) input of the slave SIT that the master
+// SIT's TRGO drives, SIT_NO_TRIGGER where they are not linked
 // ------------------------------------------------------------
+#define SIT_NO_TRIGGER	0xFFFF
+
 #if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
-void Wiring_TIM2_Interrupt_Handler_override()
+static const uint16_t SIT_TRIGGER[3][3] = {
+	// master:	TIM2				TIM3			TIM4
+	{ SIT_NO_TRIGGER,	TIM_TS_ITR2,	TIM_TS_ITR3 },		// slave TIM2
+	{ TIM_TS_ITR1,		SIT_NO_TRIGGER,	TIM_TS_ITR3 },		// slave TIM3
+	{ TIM_TS_ITR1,		TIM_TS_ITR2,	SIT_NO_TRIGGER },	// slave TIM4
+};
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon: TIM6/7/10/11/13/14 have no slave mode,
+#define NO	SIT_NO_TRIGGER							//TIM9/12 ITR2/3 are TIM10/11/13/14 compare outputs
+static const uint16_t SIT_TRIGGER[13][13] = {
+	// master:	TIM3		TIM4		TIM5		TIM6	TIM7	TIM1		TIM8		TIM9	TIM10	TIM11	TIM12	TIM13	TIM14
+	{ NO,			TIM_TS_ITR3,	TIM_TS_ITR2,	NO,		NO,		TIM_TS_ITR0,	NO,				NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM3
+	{ TIM_TS_ITR2,	NO,				NO,				NO,		NO,		TIM_TS_ITR0,	TIM_TS_ITR3,	NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM4
+	{ TIM_TS_ITR1,	TIM_TS_ITR2,	NO,				NO,		NO,		NO,				TIM_TS_ITR3,	NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM5
+	{ NO,			NO,				NO,				NO,		NO,		NO,				NO,				NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM6
+	{ NO,			NO,				NO,				NO,		NO,		NO,				NO,				NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM7
+	{ TIM_TS_ITR2,	TIM_TS_ITR3,	TIM_TS_ITR0,	NO,		NO,		NO,				NO,				NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM1
+	{ NO,			TIM_TS_ITR2,	TIM_TS_ITR3,	NO,		NO,		TIM_TS_ITR0,	NO,				NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM8
+	{ TIM_TS_ITR1,	NO,				NO,				NO,		NO,		NO,				NO,				NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM9
+	{ NO,			NO,				NO,				NO,		NO,		NO,				NO,				NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM10
+	{ NO,			NO,				NO,				NO,		NO,		NO,				NO,				NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM11
+	{ NO,			TIM_TS_ITR0,	TIM_TS_ITR1,	NO,		NO,		NO,				NO,				NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM12
+	{ NO,			NO,				NO,				NO,		NO,		NO,				NO,				NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM13
+	{ NO,			NO,				NO,				NO,		NO,		NO,				NO,				NO,		NO,		NO,		NO,		NO,		NO },	// slave TIM14
+};
+#undef NO
+#endif
+
+#if SIT_ENABLE_STATS
+// ------------------------------------------------------------
+// Folds one sample into a min/max/sum series and its log2
+// histogram (bucket k holds values in [2^(k-1), 2^k))
+// ------------------------------------------------------------
+static inline void SIT_record(SIT_StatSeries& series, uint32_t value)
 {
-	if (TIM_GetITStatus(TIM2, TIM_IT_Update) != RESET)
-	{
-		TIM_ClearITPendingBit(TIM2, TIM_IT_Update);
-		IntervalTimer::SIT_CALLBACK[0]();
+	uint32_t bucket = value ? 32 - __builtin_clz(value) : 0;
+
+	if (bucket >= SIT_STATS_BUCKETS)
+		bucket = SIT_STATS_BUCKETS - 1;
+	series.hist[bucket]++;
+	series.sum += value;
+	if (value < series.min)
+		series.min = value;
+	if (value > series.max)
+		series.max = value;
+}
+
+static inline uint32_t SIT_cycles(TIM_TypeDef* TIMx)
+{
+#if SIT_STATS_DWT
+	(void)TIMx;
+	return DWT->CYCCNT;
+#else
+	return TIMx->CNT;
+#endif
+}
+#endif
+
+// ------------------------------------------------------------
+// Appends an event stamped at stamp (a DWT cycle count), or at
+// the present, to the trace ring; nothing unless SIT_ENABLE_TRACE
+// ------------------------------------------------------------
+static inline void SIT_traceAt(uint8_t type, uint8_t idx, uint32_t value, uint32_t stamp)
+{
+#if SIT_ENABLE_TRACE
+	if (!SIT_Trace::enabled)
+		return;
+	uint32_t n = SIT_Trace::head.fetch_add(1, std::memory_order_relaxed) & (SIT_TRACE_EVENTS - 1);
+	SIT_Trace::ring[n].stamp = stamp;
+	SIT_Trace::ring[n].info = SIT_TraceEvent::pack(type, idx, value);
+	if (n == SIT_TRACE_EVENTS - 1)
+		SIT_Trace::full = true;
+#else
+	(void)type; (void)idx; (void)value; (void)stamp;
+#endif
+}
+
+static inline void SIT_trace(uint8_t type, uint8_t idx, uint32_t value = 0)
+{
+#if SIT_ENABLE_TRACE
+	SIT_traceAt(type, idx, value, DWT->CYCCNT);
+#else
+	(void)type; (void)idx; (void)value;
+#endif
+}
+
+// period events carry the period in microseconds
+static inline void SIT_tracePeriod(uint8_t type, uint8_t idx, uint64_t clocks)
+{
+#if SIT_ENABLE_TRACE
+	uint64_t us = clocks / (IntervalTimer::clock_SIT(idx) / 1000000UL);
+	SIT_trace(type, idx, (us > SIT_TRACE_MAX_VALUE) ? SIT_TRACE_MAX_VALUE : (uint32_t)us);
+#else
+	(void)type; (void)idx; (void)clocks;
+#endif
+}
+
+#if SIT_ENABLE_TRACE
+// ------------------------------------------------------------
+// Empties the trace ring
+// ------------------------------------------------------------
+void SIT_Trace::clear(void)
+{
+	bool was = enabled;
+	enabled = false;
+	head.store(0);
+	full = false;
+	enabled = was;
+}
+#endif
+
+// The update ISR reads CNT and the cycle counter on entry and
+// times the callback only for the load figures or the trace
+#define SIT_TIMED	(SIT_ENABLE_LOAD || SIT_ENABLE_TRACE)
+
+// ------------------------------------------------------------
+// Called when the update flag is set again by the time a
+// callback returns.  The update events that passed since the
+// one being handled are worked out from CNT and DWT->CYCCNT at
+// handler entry, then the SIT's overrun policy is applied.  A
+// chained SIT (beginChained) counts its source's update events,
+// not timer clocks, so no estimate is made and one is counted;
+// so does every SIT when the handler does not time callbacks.
+// ------------------------------------------------------------
+static void SIT_overran(TIM_TypeDef* TIMx, uint8_t idx, uint32_t entryCount, uint32_t entryCycles)
+{
+	SIT_Overrun& o = IntervalTimer::SIT_overrun[idx];
+
+	// a one-shot re-armed by its callback has simply fired again
+	if (TIMx->CR1 & TIM_CR1_OPM)
+		return;
+
+	uint32_t updates = 1;
+	if (SIT_TIMED && (TIMx->SMCR & TIM_SMCR_SMS) != TIM_SlaveMode_External1) {
+		uint32_t prescale = TIMx->PSC + 1;
+		uint64_t period = ((uint64_t)TIMx->ARR + 1) * prescale;
+		uint64_t clocks = (uint64_t)entryCount * prescale
+			+ (DWT->CYCCNT - entryCycles) / (SystemCoreClock / IntervalTimer::clock_SIT(idx));
+		updates = (uint32_t)(clocks / period);
+		if (updates == 0)
+			updates = 1;
+	}
+	SIT_trace(SIT_TRACE_OVERRUN, idx, updates);
+	o.overruns++;
+	o.strikes++;
+	if (o.policy == SIT_OVERRUN_CATCHUP) {
+		// the pending update calls back at once, standing for all of them
+		o.missed += updates - 1;
+		o.elapsed = updates;
+		return;
+	}
+
+	o.missed += updates;
+	TIM_ClearITPendingBit(TIMx, TIM_IT_Update);
+	if (o.policy == SIT_OVERRUN_DISABLE && o.strikes >= o.limit) {
+		TIM_ITConfig(TIMx, TIM_IT_Update, DISABLE);
+		o.tripped = true;
+		SIT_trace(SIT_TRACE_DISABLE, idx, 1);
 	}
 }
 
-void Wiring_TIM3_Interrupt_Handler_override()
+// ------------------------------------------------------------
+// Folds one callback time (CPU cycles) into a SIT's load; the
+// first call after the SIT starts seeds the average
+// ------------------------------------------------------------
+static inline void SIT_measure(uint8_t idx, uint32_t cycles)
 {
-	if (TIM_GetITStatus(TIM3, TIM_IT_Update) != RESET)
+	SIT_Load& l = IntervalTimer::SIT_load[idx];
+	uint32_t average = l.average;
+	uint32_t worst = l.worst - (l.worst >> SIT_LOAD_DECAY);
+
+	l.average = average ? average - (average >> SIT_LOAD_AVERAGE) + cycles : cycles << SIT_LOAD_AVERAGE;
+	l.worst = (cycles > worst) ? cycles : worst;
+}
+
+// ------------------------------------------------------------
+// Common body of the update ISR hooks: acknowledge the update,
+// call the SIT's callback and check it finished before the
+// next update event.  With SIT_ENABLE_LOAD its time is added to
+// the SIT's load (a deferred callback is timed by the bottom
+// half instead).  With SIT_ENABLE_STATS the entry latency
+// (timer ticks since the update event, read from CNT) and
+// callback duration are recorded under a sequence count.
+// ------------------------------------------------------------
+static inline void SIT_handler(TIM_TypeDef* TIMx, uint8_t idx)
+{
+	if (TIM_GetITStatus(TIMx, TIM_IT_Update) != RESET)
 	{
-		TIM_ClearITPendingBit(TIM3, TIM_IT_Update);
-		IntervalTimer::SIT_CALLBACK[1]();
+		uint32_t latency = (SIT_TIMED || SIT_ENABLE_STATS) ? TIMx->CNT : 0;
+		uint32_t entry = SIT_TIMED ? DWT->CYCCNT : 0;
+#if SIT_ENABLE_STATS
+		uint32_t start = SIT_cycles(TIMx);
+#endif
+		TIM_ClearITPendingBit(TIMx, TIM_IT_Update);
+		IntervalTimer::SIT_CALLBACK[idx]();
+
+		SIT_Overrun& o = IntervalTimer::SIT_overrun[idx];
+		if (TIMx->SR & TIM_IT_Update)
+			SIT_overran(TIMx, idx, latency, entry);
+		else if (o.elapsed != 1)
+			o.elapsed = 1;
+#if SIT_TIMED
+		uint32_t cycles = DWT->CYCCNT - entry;
+#if SIT_ENABLE_LOAD
+		if (!IntervalTimer::SIT_deferred[idx].active)
+			SIT_measure(idx, cycles);
+#endif
+		SIT_traceAt(SIT_TRACE_UPDATE, idx, cycles, entry);
+#endif
+#if SIT_ENABLE_STATS
+		uint32_t duration = SIT_cycles(TIMx) - start;
+		SIT_Stats& st = IntervalTimer::SIT_stats[idx];
+
+		st.seq++;
+		st.count++;
+		SIT_record(st.latency, latency);
+		SIT_record(st.duration, duration);
+		st.seq++;
+#endif
 	}
 }
 
+// ------------------------------------------------------------
+// Define interval timer ISR hooks for the available timers
+// (TIM2...TIM4 on the Core, TIM1 and TIM3...TIM14 on the Photon)
+// with callbacks to user code.
+// ------------------------------------------------------------
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+void Wiring_TIM2_Interrupt_Handler_override()
+{
+	SIT_handler(TIM2, 0);
+}
+
+void Wiring_TIM3_Interrupt_Handler_override()
+{
+	SIT_handler(TIM3, 1);
+}
+
 void Wiring_TIM4_Interrupt_Handler_override()
 {
-	if (TIM_GetITStatus(TIM4, TIM_IT_Update) != RESET)
-	{
-		TIM_ClearITPendingBit(TIM4, TIM_IT_Update);
-		IntervalTimer::SIT_CALLBACK[2]();
-	}
+	SIT_handler(TIM4, 2);
 }
 #elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
 void Wiring_TIM3_Interrupt_Handler_override()
 {
-	if (TIM_GetITStatus(TIM3, TIM_IT_Update) != RESET)
-	{
-		TIM_ClearITPendingBit(TIM3, TIM_IT_Update);
-		IntervalTimer::SIT_CALLBACK[0]();
-	}
+	SIT_handler(TIM3, 0);
 }
 
 void Wiring_TIM4_Interrupt_Handler_override()
 {
-	if (TIM_GetITStatus(TIM4, TIM_IT_Update) != RESET)
-	{
-		TIM_ClearITPendingBit(TIM4, TIM_IT_Update);
-		IntervalTimer::SIT_CALLBACK[1]();
-	}
+	SIT_handler(TIM4, 1);
 }
 
 void Wiring_TIM5_Interrupt_Handler_override()
 {
-	if (TIM_GetITStatus(TIM5, TIM_IT_Update) != RESET)
-	{
-		TIM_ClearITPendingBit(TIM5, TIM_IT_Update);
-		IntervalTimer::SIT_CALLBACK[2]();
-	}
+	SIT_handler(TIM5, 2);
 }
 
 void Wiring_TIM6_Interrupt_Handler_override()
 {
-	if (TIM_GetITStatus(TIM6, TIM_IT_Update) != RESET)
-	{
-		TIM_ClearITPendingBit(TIM6, TIM_IT_Update);
-		IntervalTimer::SIT_CALLBACK[3]();
-	}
+	SIT_handler(TIM6, 3);
 }
 
 void Wiring_TIM7_Interrupt_Handler_override()
 {
-	if (TIM_GetITStatus(TIM7, TIM_IT_Update) != RESET)
-	{
-		TIM_ClearITPendingBit(TIM7, TIM_IT_Update);
-		IntervalTimer::SIT_CALLBACK[4]();
-	}
+	SIT_handler(TIM7, 4);
+}
+
+void Wiring_TIM1_Interrupt_Handler_override()
+{
+	SIT_handler(TIM1, 5);
+}
+
+void Wiring_TIM8_Interrupt_Handler_override()
+{
+	SIT_handler(TIM8, 6);
+}
+
+void Wiring_TIM9_Interrupt_Handler_override()
+{
+	SIT_handler(TIM9, 7);
+}
+
+void Wiring_TIM10_Interrupt_Handler_override()
+{
+	SIT_handler(TIM10, 8);
+}
+
+void Wiring_TIM11_Interrupt_Handler_override()
+{
+	SIT_handler(TIM11, 9);
+}
+
+void Wiring_TIM12_Interrupt_Handler_override()
+{
+	SIT_handler(TIM12, 10);
+}
+
+void Wiring_TIM13_Interrupt_Handler_override()
+{
+	SIT_handler(TIM13, 11);
+}
+
+void Wiring_TIM14_Interrupt_Handler_override()
+{
+	SIT_handler(TIM14, 12);
 }
 #else
   #error "*** PARTICLE device not supported by this library. PLATFORM should be Core or Photon ***"
 #endif
 
+// ------------------------------------------------------------
+// Deferred callback IRQ.  Where SIT_DEFERRED_HANDLER names its
+// vector the handler is defined here, overriding the startup
+// code's weak default; otherwise it is attached at run time.
+// ------------------------------------------------------------
+#ifdef SIT_DEFERRED_HANDLER
+extern "C" void SIT_DEFERRED_HANDLER(void)
+{
+	IntervalTimer::bottomHalf_SIT();
+}
+#else
+static bool SIT_deferredAttached = false;
+#endif
+
+// ------------------------------------------------------------
+// Attaches every SIT's update hook to its system interrupt
+// ------------------------------------------------------------
+void IntervalTimer::attach_SIT(void)
+{
+#if defined(PLATFORM_ID)
+	for (uint8_t tid = 0; tid < NUM_SIT; tid++) {
+		if (!attachSystemInterrupt(SIT_HARDWARE[tid].sysint, SIT_HARDWARE[tid].hook)) ;	//error
+	}
+#endif
+}
+
 // ------------------------------------------------------------
 // this function inits and starts the timer, using the specified
-// function as a callback and the period provided. must be passed
-// the name of a function taking no arguments and returning void.
-// make sure this function can complete within the time allowed.
+// function as a callback and the period provided. the callback
+// is a SIT_Delegate: a function taking no arguments, a function
+// taking a context pointer, an object/member function pair or a
+// small lambda, all returning void. make sure this function can
+// complete within the time allowed.
 // attempts to allocate a timer using available resources,
 // returning true on success or false in case of failure.
-// Period units is defined by scale, where scale = uSec or hmSec
-// and = 1-65535 microsecond (uSec)
+// Period is the ARR value and prescaler the PSC value, which for
+// AUTO is taken as a prescaler for SYSCORECLOCK and scaled to the
+// timer allocated; begin() derives prescaler from scale, where
+// scale = uSec or hmSec
+// and Period = 1-65535 microsecond (uSec)
 // or 1-65535 0.5ms increments (hmSec)
 // ------------------------------------------------------------
-bool IntervalTimer::beginCycles(void (*isrCallback)(), intPeriod Period, bool scale, TIMid id) {
+bool IntervalTimer::beginCycles(const SIT_Delegate& isrCallback, intPeriod Period, uint16_t prescaler, TIMid id, bool oneShot) {
 
 	// if this interval timer is already running, stop and deallocate it
 	if (status == TIMER_SIT) {
 		stop_SIT();
 		status = TIMER_OFF;
 	}
-	// store callback pointer
+	frac.active = false;
+	once.active = oneShot;
+
+	// store callback
 	myISRcallback = isrCallback;
 
 	if (id < NUM_SIT) {		// Allocate specified timer (id=0 to 2/4) or auto-allocate from pool (id=255)
 		// attempt to allocate this timer
-		if (allocate_SIT(Period, scale, id)) status = TIMER_SIT;		//255 means allocate from pool
+		if (allocate_SIT(Period, prescaler, id)) status = TIMER_SIT;		//255 means allocate from pool
 		else status = TIMER_OFF;
 	}
 	else {
 		// attempt to allocate this timer
-		if (allocate_SIT(Period, scale, AUTO)) status = TIMER_SIT;		//255 means allocate from pool
+		if (allocate_SIT(Period, prescaler, AUTO)) status = TIMER_SIT;		//255 means allocate from pool
 		else status = TIMER_OFF;
 	}
 
@@ -155,23 +496,27 @@ bool IntervalTimer::beginCycles(void (*isrCallback)(), intPeriod Period, bool sc
 // it's initialized and started with the specified value, and
 // the function returns true, otherwise it returns false
 // ------------------------------------------------------------
-bool IntervalTimer::allocate_SIT(intPeriod Period, bool scale, TIMid id) {
+bool IntervalTimer::allocate_SIT(intPeriod Period, uint16_t prescaler, TIMid id) {
 
 	if (id < NUM_SIT) {		// Allocate specified timer (id=TIMER3/4/5) or auto-allocate from pool (id=AUTO)
-		if (!SIT_used[id]) {
+		if (claim_SIT(id)) {
 			SIT_id = id;
-			start_SIT(Period, scale);
-			SIT_used[id] = true;
+			start_SIT(Period, prescaler);
 			return true;
 		}
 	}
 	else {	
-		// Auto allocate - check for an available SIT, and if so, start it
-		for (uint8_t tid = 0; tid < NUM_SIT; tid++) {
-			if (!SIT_used[tid]) {
+		// Auto allocate - check for an available SIT, and if so, start it.
+		// The first pass passes over timers driving analogWrite() pins in
+		// use; prescaler is for SYSCORECLOCK and is scaled to each timer.
+		// A timer claimed by another thread meanwhile is passed over too.
+		for (uint8_t pass = 0; pass < 2; pass++) {
+			for (uint8_t tid = 0; tid < NUM_SIT; tid++) {
+				uint16_t scaled = prescaler;
+				if (used_SIT(tid) || (pass == 0 && pwmConflict_SIT(tid)) || !rescale_SIT(tid, scaled) || !claim_SIT(tid))
+					continue;
 				SIT_id = tid;
-				start_SIT(Period, scale);
-				SIT_used[tid] = true;
+				start_SIT(Period, scaled);
 				return true;
 			}
 		}
@@ -182,84 +527,133 @@ bool IntervalTimer::allocate_SIT(intPeriod Period, bool scale, TIMid id) {
 }
 
 
+// ------------------------------------------------------------
+// Returns true if a pin set up by analogWrite() (AF push-pull
+// output) is driven by SIT id's timer
+// ------------------------------------------------------------
+bool IntervalTimer::pwmConflict_SIT(uint8_t id)
+{
+#if !defined(PLATFORM_ID)							//Core v0.3.4
+	const STM32_Pin_Info* map = PIN_MAP;
+#else
+	const STM32_Pin_Info* map = HAL_Pin_Map();
+#endif
+	for (uint16_t pin = 0; pin < TOTAL_PINS; pin++) {
+		if (map[pin].timer_peripheral == SIT_HARDWARE[id].TIMx && map[pin].pin_mode == AF_OUTPUT_PUSHPULL)
+			return true;
+	}
+	return false;
+}
+
+
+// ------------------------------------------------------------
+// SIT id of the timer behind pin, or NUM_SIT if its timer is not
+// in the pool (or it has none)
+// ------------------------------------------------------------
+uint8_t IntervalTimer::pinTimer_SIT(uint16_t pin)
+{
+	if (pin >= TOTAL_PINS)
+		return NUM_SIT;
+#if !defined(PLATFORM_ID)							//Core v0.3.4
+	TIM_TypeDef* TIMx = PIN_MAP[pin].timer_peripheral;
+#else
+	TIM_TypeDef* TIMx = HAL_Pin_Map()[pin].timer_peripheral;
+#endif
+	for (uint8_t id = 0; id < NUM_SIT; id++) {
+		if (TIMx != NULL && SIT_HARDWARE[id].TIMx == TIMx)
+			return id;
+	}
+	return NUM_SIT;
+}
+
+
+// ------------------------------------------------------------
+// Sets pin to mode and hands it to its timer, for timer inputs
+// and outputs driven by the library.  The Photon only connects
+// pins in alternate function mode, with the timer's AF number.
+// ------------------------------------------------------------
+void IntervalTimer::connect_SIT(uint16_t pin, PinMode mode)
+{
+	pinMode(pin, mode);
+#if defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	uint8_t id = pinTimer_SIT(pin);
+	if (id >= NUM_SIT)
+		return;
+	const STM32_Pin_Info& info = HAL_Pin_Map()[pin];
+	GPIO_TypeDef* port = info.gpio_peripheral;
+	uint8_t source = 0;
+	while (!(info.gpio_pin & (1 << source)))
+		source++;
+	port->AFR[source >> 3] = (port->AFR[source >> 3] & ~((uint32_t)0xF << (4 * (source & 7))))
+		| ((uint32_t)SIT_AF[id] << (4 * (source & 7)));
+	port->MODER = (port->MODER & ~((uint32_t)3 << (2 * source))) | ((uint32_t)2 << (2 * source));
+#endif
+}
+
+
+// ------------------------------------------------------------
+// Returns true if another SIT in use shares SIT id's update IRQ
+// line, which must then stay enabled in the NVIC
+// ------------------------------------------------------------
+bool IntervalTimer::sharedIrq_SIT(uint8_t id)
+{
+	for (uint8_t tid = 0; tid < NUM_SIT; tid++) {
+		if (tid != id && used_SIT(tid) && SIT_HARDWARE[tid].irq == SIT_HARDWARE[id].irq)
+			return true;
+	}
+	return false;
+}
+
+
 
 // ------------------------------------------------------------
 // configuters a SIT's TIMER registers, etc and enables
 // interrupts, effectively starting the timer upon completion
 // ------------------------------------------------------------
-void IntervalTimer::start_SIT(intPeriod Period, bool scale) {
+void IntervalTimer::start_SIT(intPeriod Period, uint16_t prescaler) {
 
 	TIM_TimeBaseInitTypeDef timerInitStructure;
     NVIC_InitTypeDef nvicStructure;
-	intPeriod prescaler;
-	TIM_TypeDef* TIMx;
+	const SIT_Hardware& hw = SIT_HARDWARE[SIT_id];
+	TIM_TypeDef* TIMx = hw.TIMx;
 
-	//use SIT_id to identify TIM#
-	switch (SIT_id) {
-#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
-	case 0:		// TIM2
-		RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
-		nvicStructure.NVIC_IRQChannel = TIM2_IRQn;
-		TIMx = TIM2;
-		break;
-	case 1:		// TIM3
-		RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
-		nvicStructure.NVIC_IRQChannel = TIM3_IRQn;
-		TIMx = TIM3;
-		break;
-	case 2:		// TIM4
-		RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM4, ENABLE);
-		nvicStructure.NVIC_IRQChannel = TIM4_IRQn;
-		TIMx = TIM4;
-		break;
-#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
-	case 0:		// TIM3
-		RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
-		nvicStructure.NVIC_IRQChannel = TIM3_IRQn;
-		TIMx = TIM3;
-		break;
-	case 1:		// TIM4
-		RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM4, ENABLE);
-		nvicStructure.NVIC_IRQChannel = TIM4_IRQn;
-		TIMx = TIM4;
-		break;
-	case 2:		// TIM5
-		RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM5, ENABLE);
-		nvicStructure.NVIC_IRQChannel = TIM5_IRQn;
-		TIMx = TIM5;
-		break;
-	case 3:		// TIM6
-		RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM6, ENABLE);
-		nvicStructure.NVIC_IRQChannel = TIM6_DAC_IRQn;
-		TIMx = TIM6;
-		break;
-	case 4:		// TIM7
-		RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM7, ENABLE);
-		nvicStructure.NVIC_IRQChannel = TIM7_IRQn;
-		TIMx = TIM7;
-		break;
-#endif
-	}
+	if (hw.apb2)
+		RCC_APB2PeriphClockCmd(hw.rcc, ENABLE);
+	else
+		RCC_APB1PeriphClockCmd(hw.rcc, ENABLE);
+	nvicStructure.NVIC_IRQChannel = hw.irq;
 	
-	// Initialize Timer
-	switch (scale) {
-		case uSec:
-			prescaler = SIT_PRESCALERu;	// Set prescaler for 1MHz clock, 1us period
-			break;
-		case hmSec:
-			prescaler = SIT_PRESCALERm;	// Set prescaler for 2Hz clock, .5ms period
-			break;
-		default:
-			prescaler = SIT_PRESCALERu;
-			scale = uSec;				// Default to microseconds
-			break;
-	}
+	// remember the period actually produced: ARR + 1 counts of PSC + 1 clocks
+	periodClocks = ((uint64_t)Period + 1) * ((uint32_t)prescaler + 1);
+
+	// point to the correct SIT ISR, directly or through the deferred IRQ
+	SIT_Deferred& d = SIT_deferred[SIT_id];
+	d.active = false;
+	d.posted = d.taken = 0;
+	d.batch = d.coalesced = 0;
+	route_SIT(deferred);
+#if SIT_ENABLE_STATS
+	resetStats();
+#endif
+
+	// overrun accounting times late callbacks with the cycle counter
+	SIT_Overrun& o = SIT_overrun[SIT_id];
+	o.policy = overrunPolicy;
+	o.limit = overrunLimit;
+	o.tripped = false;
+	o.elapsed = 1;
+	o.strikes = o.overruns = o.missed = 0;
 
-	// point to the correct SIT ISR
-	SIT_CALLBACK[SIT_id] = myISRcallback;
+	// so is the load, against the period in CPU cycles
+	SIT_Load& l = SIT_load[SIT_id];
+	l.period = once.active ? 0 : periodClocks * (SystemCoreClock / clock_SIT(SIT_id));
+	l.average = l.worst = 0;
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	SIT_tracePeriod(SIT_TRACE_START, SIT_id, periodClocks);
 
-	// Enable Timer Interrupt
-    	nvicStructure.NVIC_IRQChannelPreemptionPriority = 10;
+	// Enable Timer Interrupt; on a shared line the last SIT started sets the priority
+    	nvicStructure.NVIC_IRQChannelPreemptionPriority = priority;
     	nvicStructure.NVIC_IRQChannelSubPriority = 1;
     	nvicStructure.NVIC_IRQChannelCmd = ENABLE;
     	NVIC_Init(&nvicStructure);
@@ -271,9 +665,17 @@ void IntervalTimer::start_SIT(intPeriod Period, bool scale) {
 	timerInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
 	timerInitStructure.TIM_RepetitionCounter = 0;
 
+	// one-shot timers stop at the update event (OPM) and only raise the
+	// interrupt on overflow (URS), so the UG below does not fire them
+	if (once.active)
+		TIMx->CR1 |= TIM_CR1_OPM | TIM_CR1_URS;
+	else if (preload)
+		TIMx->CR1 |= TIM_CR1_ARPE;
+
 	TIM_TimeBaseInit(TIMx, &timerInitStructure);
 	TIM_ITConfig(TIMx, TIM_IT_Update, ENABLE);
-	TIM_Cmd(TIMx, ENABLE);
+	if (!once.active)
+		TIM_Cmd(TIMx, ENABLE);
 }
 
 
@@ -284,6 +686,57 @@ void IntervalTimer::start_SIT(intPeriod Period, bool scale) {
 void IntervalTimer::end() {
 	if (status == TIMER_SIT) stop_SIT();
 	status = TIMER_OFF;
+	frac.active = false;
+	once.active = false;
+}
+
+
+// ------------------------------------------------------------
+// Moving a timer hands its SIT, settings and callback over to
+// the new object and leaves the old one stopped, so timers can
+// be kept in containers and passed between drivers.  Copies are
+// not allowed, as both would end the same SIT.
+// ------------------------------------------------------------
+IntervalTimer::IntervalTimer(IntervalTimer&& other) noexcept : IntervalTimer()
+{
+	take_SIT(other);
+}
+
+IntervalTimer& IntervalTimer::operator=(IntervalTimer&& other) noexcept
+{
+	if (this != &other) {
+		end();
+		take_SIT(other);
+	}
+	return *this;
+}
+
+void IntervalTimer::take_SIT(IntervalTimer& other)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	status = other.status;
+	preload = other.preload;
+	deferred = other.deferred;
+	priority = other.priority;
+	overrunPolicy = other.overrunPolicy;
+	overrunLimit = other.overrunLimit;
+	SIT_id = other.SIT_id;
+	periodClocks = other.periodClocks;
+	budgetNs = other.budgetNs;
+	myISRcallback = other.myISRcallback;
+	frac = other.frac;
+	once = other.once;
+
+	// the fractional mode ISR is bound to the object running it
+	if (status == TIMER_SIT && frac.active) {
+		myISRcallback = SIT_Delegate(this, &IntervalTimer::fractionalTick);
+		SIT_CALLBACK[SIT_id] = myISRcallback;
+	}
+	other.status = TIMER_OFF;
+	other.frac.active = false;
+	other.once.active = false;
+	__set_PRIMASK(primask);
 }
 
 
@@ -294,59 +747,27 @@ void IntervalTimer::end() {
 void IntervalTimer::stop_SIT() {
 
     NVIC_InitTypeDef nvicStructure;
-	TIM_TypeDef* TIMx;
-
+	TIM_TypeDef* TIMx = SIT_HARDWARE[SIT_id].TIMx;
 
-	//use SIT_id to identify TIM#
-	switch (SIT_id) {
-#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
-	case 0:		// TIM2
-		nvicStructure.NVIC_IRQChannel = TIM2_IRQn;
-		TIMx = TIM2;
-		break;
-	case 1:		// TIM3
-		nvicStructure.NVIC_IRQChannel = TIM3_IRQn;
-		TIMx = TIM3;
-		break;
-	case 2:		// TIM4
-		nvicStructure.NVIC_IRQChannel = TIM4_IRQn;
-		TIMx = TIM4;
-		break;
-#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
-	case 0:		// TIM3
-		nvicStructure.NVIC_IRQChannel = TIM3_IRQn;
-		TIMx = TIM3;
-		break;
-	case 1:		// TIM4
-		nvicStructure.NVIC_IRQChannel = TIM4_IRQn;
-		TIMx = TIM4;
-		break;
-	case 2:		// TIM5
-		nvicStructure.NVIC_IRQChannel = TIM5_IRQn;
-		TIMx = TIM5;
-		break;
-	case 3:		// TIM6
-		nvicStructure.NVIC_IRQChannel = TIM6_DAC_IRQn;
-		TIMx = TIM6;
-		break;
-	case 4:		// TIM7
-		nvicStructure.NVIC_IRQChannel = TIM7_IRQn;
-		TIMx = TIM7;
-		break;
-#endif
-		}
 	// disable counter
 	TIM_Cmd(TIMx, DISABLE);
+	SIT_trace(SIT_TRACE_STOP, SIT_id);
 	
-	// disable interrupt
-    nvicStructure.NVIC_IRQChannelCmd = DISABLE;
-    NVIC_Init(&nvicStructure);
+	// disable interrupt, unless the line serves another SIT too
+	if (!sharedIrq_SIT(SIT_id)) {
+		nvicStructure.NVIC_IRQChannel = SIT_HARDWARE[SIT_id].irq;
+		nvicStructure.NVIC_IRQChannelCmd = DISABLE;
+		NVIC_Init(&nvicStructure);
+	}
 	
 	// disable timer peripheral
 	TIM_DeInit(TIMx);
+
+	// drop deferred callbacks not yet run
+	SIT_deferred[SIT_id].active = false;
 	
 	// free SIT for future use
-	SIT_used[SIT_id] = false;
+	release_SIT(SIT_id);
 }
 
 
@@ -357,57 +778,30 @@ void IntervalTimer::stop_SIT() {
 void IntervalTimer::interrupt_SIT(action ACT)
 {
     NVIC_InitTypeDef nvicStructure;
-	TIM_TypeDef* TIMx;
-
-	//use SIT_id to identify TIM#
-	switch (SIT_id) {
-#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
-	case 0:		// TIM2
-		nvicStructure.NVIC_IRQChannel = TIM2_IRQn;
-		TIMx = TIM2;
-		break;
-	case 1:		// TIM3
-		nvicStructure.NVIC_IRQChannel = TIM3_IRQn;
-		TIMx = TIM3;
-		break;
-	case 2:		// TIM4
-		nvicStructure.NVIC_IRQChannel = TIM4_IRQn;
-		TIMx = TIM4;
-		break;
-#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
-	case 0:		// TIM3
-		nvicStructure.NVIC_IRQChannel = TIM3_IRQn;
-		TIMx = TIM3;
-		break;
-	case 1:		// TIM4
-		nvicStructure.NVIC_IRQChannel = TIM4_IRQn;
-		TIMx = TIM4;
-		break;
-	case 2:		// TIM5
-		nvicStructure.NVIC_IRQChannel = TIM5_IRQn;
-		TIMx = TIM5;
-		break;
-	case 3:		// TIM6
-		nvicStructure.NVIC_IRQChannel = TIM6_DAC_IRQn;
-		TIMx = TIM6;
-		break;
-	case 4:		// TIM7
-		nvicStructure.NVIC_IRQChannel = TIM7_IRQn;
-		TIMx = TIM7;
-		break;
-#endif
-	}
+	TIM_TypeDef* TIMx = SIT_HARDWARE[SIT_id].TIMx;
 
+	nvicStructure.NVIC_IRQChannel = SIT_HARDWARE[SIT_id].irq;
 	switch (ACT) {
 	case INT_ENABLE:
+		// re-arm an update interrupt turned off by SIT_OVERRUN_DISABLE
+		SIT_overrun[SIT_id].strikes = 0;
+		SIT_overrun[SIT_id].tripped = false;
+		TIM_ITConfig(TIMx, TIM_IT_Update, ENABLE);
+		SIT_trace(SIT_TRACE_ENABLE, SIT_id);
+
 		//Enable Timer Interrupt
-		nvicStructure.NVIC_IRQChannelPreemptionPriority = 0;
+		nvicStructure.NVIC_IRQChannelPreemptionPriority = priority;
 		nvicStructure.NVIC_IRQChannelSubPriority = 1;
 		nvicStructure.NVIC_IRQChannelCmd = ENABLE;
 		NVIC_Init(&nvicStructure);
 		break;
 	case INT_DISABLE:
-		// disable interrupt
+		SIT_trace(SIT_TRACE_DISABLE, SIT_id);
+		// disable interrupt, at the timer if the line serves another SIT too
+		if (sharedIrq_SIT(SIT_id)) {
+			TIM_ITConfig(TIMx, TIM_IT_Update, DISABLE);
+			break;
+		}
 		nvicStructure.NVIC_IRQChannelCmd = DISABLE;
 		NVIC_Init(&nvicStructure);
 		break;
@@ -424,68 +818,1095 @@ void IntervalTimer::interrupt_SIT(action ACT)
 // ------------------------------------------------------------
 void IntervalTimer::resetPeriod_SIT(intPeriod newPeriod, bool scale)
 {
-	//TIM_TimeBaseInitTypeDef timerInitStructure;
-	TIM_TypeDef* TIMx;
-	intPeriod prescaler;
+	if (!admit_SIT(periodNs_SIT(newPeriod, scale)))
+		return;
+	reload_SIT(newPeriod, prescaler_SIT(scale, (TIMid)SIT_id));
+}
 
-	//use SIT_id to identify TIM#
-	switch (SIT_id) {
-#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
-	case 0:		// TIM2
-		TIMx = TIM2;
-		break;
-	case 1:		// TIM3
-		TIMx = TIM3;
-		break;
-	case 2:		// TIM4
-		TIMx = TIM4;
-		break;
-#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
-	case 0:		// TIM3
-		TIMx = TIM3;
-		break;
-	case 1:		// TIM4
-		TIMx = TIM4;
-		break;
-	case 2:		// TIM5
-		TIMx = TIM5;
-		break;
-	case 3:		// TIM6
-		TIMx = TIM6;
-		break;
-	case 4:		// TIM7
-		TIMx = TIM7;
-		break;
+// ------------------------------------------------------------
+// Set new period in nanoseconds or Hz, using the PSC/ARR pair
+// with the smallest error for this SIT's clock and counter
+// width.  Returns false if not running or out of range.
+// ------------------------------------------------------------
+bool IntervalTimer::resetPeriodNs_SIT(uint64_t ns)
+{
+	SIT_Solution sol = solve_SIT(ns);
+	if (!sol.valid() || !admit_SIT(ns))
+		return false;
+	reload_SIT(sol.reload, sol.prescaler);
+	return true;
+}
+
+bool IntervalTimer::resetPeriodHz_SIT(double hz)
+{
+	return hz > 0 && resetPeriodNs_SIT((uint64_t)(1e9 / hz + 0.5));
+}
+
+// ------------------------------------------------------------
+// PSC/ARR pair for a period on this SIT, invalid if the SIT
+// is not running or the period is out of range
+// ------------------------------------------------------------
+SIT_Solution IntervalTimer::solve_SIT(uint64_t ns)
+{
+	if (status != TIMER_SIT || ns < MIN_PERIOD_NS)
+		return SIT_Solution(0, 0, 0);
+	return SIT_Solver::solveNs(ns, clock_SIT(SIT_id), maxReload_SIT(SIT_id));
+}
+
+// ------------------------------------------------------------
+// With preload off (the default) period changes restart the
+// count at once.  With preload on, ARR is buffered (ARPE) and
+// new ARR and PSC values only take effect at the next update
+// event: the period in progress completes unchanged, the phase
+// of the update events is kept and no extra callback is raised.
+// The setting is kept across begin() calls; one-shot and
+// fractional mode timers always run without preload.
+// ------------------------------------------------------------
+void IntervalTimer::preload_SIT(bool enable)
+{
+	preload = enable;
+	if (status != TIMER_SIT || once.active || frac.active)
+		return;
+
+	TIM_TypeDef* TIMx = timer_SIT();
+	if (enable)
+		TIMx->CR1 |= TIM_CR1_ARPE;
+	else
+		TIMx->CR1 &= ~TIM_CR1_ARPE;
+}
+
+// ------------------------------------------------------------
+// Sets the NVIC preemption priority (0 most urgent, 15 least)
+// of this SIT's update interrupt.  It is kept across begin()
+// calls and takes effect when the SIT is next started or its
+// interrupt is enabled with interrupt_SIT(INT_ENABLE).
+// ------------------------------------------------------------
+void IntervalTimer::priority_SIT(uint8_t preempt)
+{
+	priority = (preempt > 15) ? 15 : preempt;
+}
+
+// ------------------------------------------------------------
+// With deferred mode on, the update ISR no longer runs the
+// callback: it stamps the cycle counter and posts to the
+// deferred IRQ, which runs at SIT_DEFERRED_PRIORITY once the
+// more urgent interrupts are done.  Posts that pile up before
+// the callback gets to run are merged into one call; see
+// batch_SIT(), batchStamp_SIT() and coalesced_SIT().  The
+// setting is kept across begin() calls.  Fractional mode
+// timers always run their callback in the update ISR.
+// ------------------------------------------------------------
+void IntervalTimer::deferred_SIT(bool enable)
+{
+	deferred = enable;
+	if (status != TIMER_SIT || frac.active)
+		return;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	route_SIT(enable);
+	__set_PRIMASK(primask);
+}
+
+// ------------------------------------------------------------
+// Points the SIT's ISR at myISRcallback, or at post_SIT with
+// myISRcallback handed to the deferred IRQ.  The deferred IRQ
+// and the cycle counter are set up when a SIT starts deferring.
+// ------------------------------------------------------------
+void IntervalTimer::route_SIT(bool defer)
+{
+	SIT_Deferred& d = SIT_deferred[SIT_id];
+
+	if (!defer) {
+		d.active = false;
+		SIT_CALLBACK[SIT_id] = myISRcallback;
+		return;
+	}
+
+	if (!d.active) {
+		NVIC_InitTypeDef nvicStructure;
+
+#ifndef SIT_DEFERRED_HANDLER
+		if (!SIT_deferredAttached) {
+			SIT_deferredAttached = true;
+			if (!attachInterruptDirect(SIT_DEFERRED_IRQn, bottomHalf_SIT, false)) ;	//error
+		}
 #endif
+		CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;		// make sure the cycle counter runs
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+		nvicStructure.NVIC_IRQChannel = SIT_DEFERRED_IRQn;
+		nvicStructure.NVIC_IRQChannelPreemptionPriority = SIT_DEFERRED_PRIORITY;
+		nvicStructure.NVIC_IRQChannelSubPriority = 0;
+		nvicStructure.NVIC_IRQChannelCmd = ENABLE;
+		NVIC_Init(&nvicStructure);
 	}
+	d.callback = myISRcallback;
+	d.active = true;
+	SIT_CALLBACK[SIT_id] = SIT_Delegate(post_SIT, &d);
+}
 
-	switch (scale) {
-	case uSec:
-		prescaler = SIT_PRESCALERu;	// Set prescaler for 1MHz clock, 1us period
-		break;
-	case hmSec:
-		prescaler = SIT_PRESCALERm;	// Set prescaler for 2Hz clock, .5ms period
-		break;
-	default:
-		scale = uSec;				// Default to microseconds
-		prescaler = SIT_PRESCALERu;
-		break;
+// ------------------------------------------------------------
+// Top half of a deferred SIT, run by the update ISR
+// ------------------------------------------------------------
+void IntervalTimer::post_SIT(void* state)
+{
+	SIT_Deferred* d = (SIT_Deferred*)state;
+
+	d->stamp = DWT->CYCCNT;
+	d->posted++;
+	NVIC_SetPendingIRQ(SIT_DEFERRED_IRQn);
+}
+
+// ------------------------------------------------------------
+// Bottom half: runs the callback of every deferring SIT with
+// posts outstanding, once per SIT however many there are.  A
+// post arriving meanwhile pends the IRQ again.
+// ------------------------------------------------------------
+void IntervalTimer::bottomHalf_SIT(void)
+{
+	for (uint8_t i = 0; i < NUM_SIT; i++) {
+		SIT_Deferred& d = SIT_deferred[i];
+		SIT_Delegate callback;
+		bool run;
+
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		uint32_t n = d.posted - d.taken;
+		run = d.active && n != 0;
+		if (run) {
+			d.taken += n;
+			d.batch = n;
+			d.batchStamp = d.stamp;
+			d.coalesced += n - 1;
+			callback = d.callback;
+		}
+		__set_PRIMASK(primask);
+
+		if (run) {
+#if SIT_TIMED
+			uint32_t start = DWT->CYCCNT;
+			callback();
+			uint32_t cycles = DWT->CYCCNT - start;
+#if SIT_ENABLE_LOAD
+			SIT_measure(i, cycles);
+#endif
+			SIT_traceAt(SIT_TRACE_DEFERRED, i, cycles, start);
+#else
+			callback();
+#endif
+		}
+	}
+}
+
+// ------------------------------------------------------------
+// Deferred mode figures, for use from the callback: the posts
+// this call covers, the cycle count (DWT->CYCCNT) of the latest
+// of them and the total of posts merged since the SIT started
+// ------------------------------------------------------------
+uint32_t IntervalTimer::batch_SIT(void)
+{
+	return SIT_deferred[SIT_id].batch;
+}
+
+uint32_t IntervalTimer::batchStamp_SIT(void)
+{
+	return SIT_deferred[SIT_id].batchStamp;
+}
+
+uint32_t IntervalTimer::coalesced_SIT(void)
+{
+	return SIT_deferred[SIT_id].coalesced;
+}
+
+// ------------------------------------------------------------
+// Chooses what happens when a callback overruns, ie. is still
+// running at the next update event.  SIT_OVERRUN_CATCHUP (the
+// default) lets the pending update call back as soon as the
+// callback returns and elapsed_SIT() tells that call how many
+// update events it stands for.  SIT_OVERRUN_SKIP drops the
+// pending update, so the next call comes at the next update.
+// SIT_OVERRUN_DISABLE skips too and turns the SIT's interrupt
+// off at the limit-th overrun; tripped_SIT() reports it and
+// interrupt_SIT(INT_ENABLE) turns it back on.  Update events
+// without a callback of their own are counted by missed_SIT().
+// The policy is kept across begin() calls.
+// ------------------------------------------------------------
+void IntervalTimer::overrunPolicy_SIT(SIT_OverrunPolicy policy, uint32_t limit)
+{
+	overrunPolicy = policy;
+	overrunLimit = (limit == 0) ? 1 : limit;
+	if (status != TIMER_SIT)
+		return;
+
+	SIT_overrun[SIT_id].policy = overrunPolicy;
+	SIT_overrun[SIT_id].limit = overrunLimit;
+}
+
+uint32_t IntervalTimer::elapsed_SIT(void)
+{
+	return SIT_overrun[SIT_id].elapsed;
+}
+
+uint32_t IntervalTimer::overruns_SIT(void)
+{
+	return SIT_overrun[SIT_id].overruns;
+}
+
+uint32_t IntervalTimer::missed_SIT(void)
+{
+	return SIT_overrun[SIT_id].missed;
+}
+
+bool IntervalTimer::tripped_SIT(void)
+{
+	return SIT_overrun[SIT_id].tripped;
+}
+
+// ------------------------------------------------------------
+// Callback time of this SIT in nanoseconds, the moving average
+// or the decaying worst case.  Times include interrupts that
+// preempt the callback, so they err high.  Always 0 unless the
+// library is built with SIT_ENABLE_LOAD.
+// ------------------------------------------------------------
+uint32_t IntervalTimer::callbackNs_SIT(bool worst)
+{
+	if (status != TIMER_SIT)
+		return 0;
+
+	const SIT_Load& l = SIT_load[SIT_id];
+	uint32_t cycles = worst ? l.worst : (l.average >> SIT_LOAD_AVERAGE);
+	return (uint32_t)((uint64_t)cycles * 1000000000ULL / SystemCoreClock);
+}
+
+// ------------------------------------------------------------
+// Share of the CPU taken by this SIT's callback (callback time
+// over period), 0 if not running or one-shot
+// ------------------------------------------------------------
+float IntervalTimer::load_SIT(bool worst)
+{
+	if (status != TIMER_SIT || SIT_load[SIT_id].period == 0)
+		return 0;
+
+	const SIT_Load& l = SIT_load[SIT_id];
+	float cycles = worst ? (float)l.worst : (float)l.average / (1 << SIT_LOAD_AVERAGE);
+	return cycles / l.period;
+}
+
+// ------------------------------------------------------------
+// Share of the CPU taken by the callbacks of all running SITs,
+// from their average or worst times.  Near or above 1, loop()
+// and the system firmware starve.
+// ------------------------------------------------------------
+float IntervalTimer::utilization_SIT(bool worst)
+{
+	float load = 0;
+
+	for (uint8_t id = 0; id < NUM_SIT; id++) {
+		const SIT_Load& l = SIT_load[id];
+		if (!used_SIT(id) || l.period == 0)
+			continue;
+		float cycles = worst ? (float)l.worst : (float)l.average / (1 << SIT_LOAD_AVERAGE);
+		load += cycles / l.period;
+	}
+	return load;
+}
+
+// ------------------------------------------------------------
+// With a ceiling set by loadCeiling_SIT() (0, the default, turns
+// the check off), begin and resetPeriod calls fail if the new
+// period would take the average utilization over it.  This
+// SIT's callback time is the larger of budget_SIT() and its
+// measured average, so declare a budget for a new callback.
+// Without SIT_ENABLE_LOAD nothing is measured and only this
+// SIT's budget counts.  One-shots are not checked.
+// ------------------------------------------------------------
+bool IntervalTimer::admit_SIT(uint64_t ns)
+{
+	if (!(SIT_loadCeiling > 0) || ns == 0)
+		return true;
+
+	float load = utilization_SIT();
+	if (status == TIMER_SIT)
+		load -= load_SIT();
+	return load + (float)costNs_SIT() / ns <= SIT_loadCeiling;
+}
+
+// callback time counted by admission
+uint32_t IntervalTimer::costNs_SIT(void)
+{
+	uint32_t measured = callbackNs_SIT();
+	return (measured > budgetNs) ? measured : budgetNs;
+}
+
+// ------------------------------------------------------------
+// Loads new ARR and PSC values, restarting the count unless
+// the SIT is in preload mode
+// ------------------------------------------------------------
+void IntervalTimer::reload_SIT(intPeriod newPeriod, uint16_t prescaler)
+{
+	TIM_TypeDef* TIMx = timer_SIT();
+
+	if (preload) {
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		shadow_SIT(newPeriod, prescaler);
+		__set_PRIMASK(primask);
+		return;
 	}
 
+	// URS keeps the UG restart from raising an update interrupt
+	fixedPeriod_SIT(newPeriod, prescaler);
 	TIMx->ARR = newPeriod;
 	TIMx->PSC = prescaler;
+	TIMx->CR1 |= TIM_CR1_URS;
 	TIMx->EGR = TIM_PSCReloadMode_Immediate;
+	TIMx->CR1 &= ~TIM_CR1_URS;
+	TIM_ClearITPendingBit(TIMx, TIM_IT_Update);
+}
+
+// ------------------------------------------------------------
+// Writes new ARR and PSC values to the preload registers, to
+// take effect at the next update event.  An ARR-only change is
+// a single store.  When PSC changes too, update events are held
+// off (UDIS) across both stores so the pair cannot be split by
+// an update; if the counter wrapped meanwhile, the held-off
+// update is raised with UG, loading both values at once a few
+// clocks late rather than losing the callback.  Call with
+// interrupts disabled.
+// ------------------------------------------------------------
+void IntervalTimer::shadow_SIT(intPeriod newPeriod, uint16_t prescaler)
+{
+	TIM_TypeDef* TIMx = timer_SIT();
+
+	fixedPeriod_SIT(newPeriod, prescaler);
+	TIMx->CR1 |= TIM_CR1_ARPE;
+	if (TIMx->PSC == prescaler) {
+		TIMx->ARR = newPeriod;
+		return;
+	}
+
+	uint32_t count = TIMx->CNT;
+	TIMx->CR1 |= TIM_CR1_UDIS;
+	TIMx->ARR = newPeriod;
+	TIMx->PSC = prescaler;
+	TIMx->CR1 &= ~TIM_CR1_UDIS;
+	if (TIMx->CNT < count)
+		TIMx->EGR = TIM_PSCReloadMode_Immediate;
+}
+
+// ------------------------------------------------------------
+// Records a fixed period; this ends fractional mode and hands
+// the user callback back
+// ------------------------------------------------------------
+void IntervalTimer::fixedPeriod_SIT(intPeriod newPeriod, uint16_t prescaler)
+{
+	if (frac.active) {
+		frac.active = false;
+		myISRcallback = frac.callback;
+		route_SIT(deferred);
+	}
+	periodClocks = ((uint64_t)newPeriod + 1) * ((uint32_t)prescaler + 1);
+	SIT_load[SIT_id].period = periodClocks * (SystemCoreClock / clock_SIT(SIT_id));
+	SIT_tracePeriod(SIT_TRACE_PERIOD, SIT_id, periodClocks);
+}
+
+// ------------------------------------------------------------
+// Starts the timer with a period in nanoseconds or Hz instead
+// of ARR counts.  The prescaler and ARR are searched for the
+// smallest period error (see SIT_Solver).  With AUTO, a period
+// too long for a 16 bit counter is placed on a free 32 bit
+// timer (TIM5 on Photon).  period_SIT() reports the result.
+// ------------------------------------------------------------
+bool IntervalTimer::beginNs(const SIT_Delegate& isrCallback, uint64_t ns, TIMid id)
+{
+	if (ns < MIN_PERIOD_NS || !admit_SIT(ns))
+		return false;
+
+	if (id >= NUM_SIT) {
+		// any pool timer will do if the period fits 16 bits
+		SIT_Solution sol = SIT_Solver::solveNs(ns, clock_SIT(0), UINT16_MAX);
+		if (sol.valid())
+			return beginCycles(isrCallback, sol.reload, sol.prescaler, AUTO);
+
+		// otherwise it needs a free 32 bit timer
+		for (uint8_t tid = 0; tid < NUM_SIT && id >= NUM_SIT; tid++) {
+			if (maxReload_SIT(tid) > UINT16_MAX && !used_SIT(tid))
+				id = (TIMid)tid;
+		}
+		if (id >= NUM_SIT)
+			return false;
+	}
+
+	SIT_Solution sol = SIT_Solver::solveNs(ns, clock_SIT(id), maxReload_SIT(id));
+	if (!sol.valid())
+		return false;
+	return beginCycles(isrCallback, sol.reload, sol.prescaler, id);
+}
+
+bool IntervalTimer::beginHz(const SIT_Delegate& isrCallback, double hz, TIMid id)
+{
+	return hz > 0 && beginNs(isrCallback, (uint64_t)(1e9 / hz + 0.5), id);
+}
+
+// ------------------------------------------------------------
+// Period the running SIT actually produces, in nanoseconds,
+// or 0 if the timer is not allocated
+// ------------------------------------------------------------
+uint64_t IntervalTimer::period_SIT(void)
+{
+	if (status != TIMER_SIT)
+		return 0;
+	if (frac.active)		// long-term average, exact up to rounding
+		return ((uint64_t)frac.freqDen * 1000000000ULL + frac.freqNum / 2) / frac.freqNum;
+	return SIT_Solution(0, 0, periodClocks).nanoseconds(clock_SIT(SIT_id));
+}
+
+// ------------------------------------------------------------
+// Starts the timer at exactly num / den Hz, eg. 44100 / 1 or
+// 60 / 1, which integer ARR values cannot hit.  The period in
+// timer counts is the rational whole + rem / den; each update
+// ISR reloads ARR with whole or whole + 1 counts as a phase
+// accumulator carries the fraction, so the long-run average
+// period is exact and never drifts while each single period
+// differs from the ideal by less than one count.
+// ------------------------------------------------------------
+bool IntervalTimer::beginFrequency(const SIT_Delegate& isrCallback, uint32_t num, uint32_t den, TIMid id)
+{
+	if (num == 0 || den == 0 || (uint64_t)den * 1000000ULL < num)	// at most 1MHz
+		return false;
+	if (!admit_SIT((uint64_t)den * 1000000000ULL / num))
+		return false;
+
+	// smallest divider that keeps whole + 1 counts within the counter
+	uint64_t maxCount = (uint64_t)UINT16_MAX + 1;
+	uint64_t clocks = (uint64_t)clock_SIT(id < NUM_SIT ? id : 0) * den;
+	if (id < NUM_SIT)
+		maxCount = (uint64_t)maxReload_SIT(id) + 1;
+	uint64_t divider = clocks / ((uint64_t)num * maxCount) + 1;
+
+	if (divider > 65536 && id >= NUM_SIT) {
+		// too slow for a 16 bit counter, try a free 32 bit timer
+		for (uint8_t tid = 0; tid < NUM_SIT && id >= NUM_SIT; tid++) {
+			if (maxReload_SIT(tid) > UINT16_MAX && !used_SIT(tid))
+				id = (TIMid)tid;
+		}
+		if (id >= NUM_SIT)
+			return false;
+		maxCount = (uint64_t)maxReload_SIT(id) + 1;
+		clocks = (uint64_t)clock_SIT(id) * den;
+		divider = clocks / ((uint64_t)num * maxCount) + 1;
+	}
+	if (divider > 65536)
+		return false;
+
+	frac.active = false;
+	frac.callback = isrCallback;
+	frac.divider = (uint32_t)divider;
+	frac.den = (uint64_t)num * divider;
+	frac.whole = (uint32_t)(clocks / frac.den);
+	frac.rem = clocks % frac.den;
+	frac.acc = 0;
+	frac.periods = 0;
+	frac.counts = 0;
+	frac.freqNum = num;
+	frac.freqDen = den;
+
+	if (!beginCycles(SIT_Delegate(this, &IntervalTimer::fractionalTick), fractionalStep() - 1, divider - 1, id))
+		return false;
+
+	// drop the update raised by starting the timer, then let the ISR run the accumulator;
+	// an APB2 timer picked by AUTO runs the same counts off a doubled prescaler
+	frac.TIMx = timer_SIT();
+	frac.divider = frac.TIMx->PSC + 1;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	TIM_ClearITPendingBit(frac.TIMx, TIM_IT_Update);
+	route_SIT(false);
+	frac.TIMx->CR1 &= ~TIM_CR1_ARPE;		// the ISR's ARR write is for the period just begun
+	frac.active = true;
+	__set_PRIMASK(primask);
+	return true;
+}
+
+// ------------------------------------------------------------
+// Advances the phase accumulator by one period and returns the
+// length of that period in timer counts
+// ------------------------------------------------------------
+uint32_t IntervalTimer::fractionalStep(void)
+{
+	uint32_t count = frac.whole;
+	uint64_t acc = frac.acc + frac.rem;
+
+	if (acc >= frac.den) {
+		acc -= frac.den;
+		count++;
+	}
+	frac.acc = acc;
+	frac.periods++;
+	frac.counts += count;
+	return count;
+}
+
+// ------------------------------------------------------------
+// Update callback in fractional mode.  The counter has just
+// wrapped and runs without ARR preload, so the new ARR applies
+// to the period that has just begun.
+// ------------------------------------------------------------
+void IntervalTimer::fractionalTick(void)
+{
+	if (!frac.active)
+		return;
+	frac.TIMx->ARR = fractionalStep() - 1;
+	frac.callback();
+}
+
+// ------------------------------------------------------------
+// Long-term error of a beginFrequency() timer.  Returns false
+// if the timer is not running in fractional mode.
+// ------------------------------------------------------------
+bool IntervalTimer::fractionalStats(SIT_FractionalStats& stats)
+{
+	if (status != TIMER_SIT || !frac.active)
+		return false;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint64_t acc = frac.acc;
+	stats.periods = frac.periods;
+	stats.counts = frac.counts;
+	__set_PRIMASK(primask);
+
+	double countNs = 1e9 * frac.divider / clock_SIT(SIT_id);
+	stats.errorCounts = -(double)acc / (double)frac.den;
+	stats.errorNs = stats.errorCounts * countNs;
+	stats.countNs = (uint32_t)(countNs + 0.5);
+	return true;
+}
+
+// ------------------------------------------------------------
+// Runs isrCallback once, delay microseconds from now, or at the
+// micros() value deadline (fireAt).  The first call allocates
+// a SIT in one-pulse mode; later calls on the same object only
+// rewrite PSC/ARR and restart the counter, so a pending one-shot
+// is replaced rather than queued.  The callback may re-arm its
+// own timer.  Delays beyond the counter's range at 1MHz use a
+// coarser prescaler (up to about a minute on 16 bit timers).
+// ------------------------------------------------------------
+bool IntervalTimer::fireOnce(const SIT_Delegate& isrCallback, uint32_t delay, TIMid id)
+{
+	if (!prepareOnce(isrCallback, id))
+		return false;
+	return armOnce(isrCallback, delay);
+}
+
+bool IntervalTimer::fireAt(const SIT_Delegate& isrCallback, uint32_t deadline, TIMid id)
+{
+	if (!prepareOnce(isrCallback, id))
+		return false;
+
+	// a deadline already passed fires as soon as possible
+	int32_t delay = (int32_t)(deadline - micros());
+	return armOnce(isrCallback, delay > 0 ? (uint32_t)delay : 0);
+}
+
+// ------------------------------------------------------------
+// Disarms a pending one-shot without releasing its SIT.
+// Returns true if the callback had not run yet.
+// ------------------------------------------------------------
+bool IntervalTimer::cancel_SIT(void)
+{
+	if (status != TIMER_SIT || !once.active)
+		return false;
+
+	TIM_TypeDef* TIMx = once.TIMx;
+	bool pending = (TIMx->CR1 & TIM_CR1_CEN) || TIM_GetITStatus(TIMx, TIM_IT_Update) != RESET;
+	TIMx->CR1 &= ~TIM_CR1_CEN;
 	TIM_ClearITPendingBit(TIMx, TIM_IT_Update);
+	return pending;
 }
 
 // ------------------------------------------------------------
-// Returns -1 if timer not allocated or sid number:
-// 0 = TMR2, 1 = TMR3, 2 = TMR4
+// Allocates a one-pulse SIT unless this object already holds one.
+// start_SIT leaves the counter stopped; armOnce starts it.
+// ------------------------------------------------------------
+bool IntervalTimer::prepareOnce(const SIT_Delegate& isrCallback, TIMid id)
+{
+	if (status == TIMER_SIT && once.active)
+		return true;
+
+	if (!beginCycles(isrCallback, MAX_PERIOD, prescaler_SIT(uSec, id), id, true))
+		return false;
+
+	once.TIMx = timer_SIT();
+	once.ticksPerUs = clock_SIT(SIT_id) / 1000000UL;
+	once.maxReload = maxReload_SIT(SIT_id);
+	return true;
+}
+
+bool IntervalTimer::armOnce(const SIT_Delegate& isrCallback, uint32_t delay)
+{
+	// ARR = 0 stalls the counter, so two ticks is the shortest delay
+	if (delay < 2)
+		delay = 2;
+
+	// stretch each count over several microseconds when needed
+	uint32_t scale = 1;
+	if (delay - 1 > once.maxReload)
+		scale = (delay - 1) / (once.maxReload + 1) + 1;
+	uint32_t prescaler = scale * once.ticksPerUs - 1;
+	if (prescaler > UINT16_MAX)
+		return false;
+
+	TIM_TypeDef* TIMx = once.TIMx;
+
+	// stop the counter and drop an expiry the ISR has not seen yet,
+	// so the old callback cannot run after it has been replaced
+	TIMx->CR1 &= ~TIM_CR1_CEN;
+	TIM_ClearITPendingBit(TIMx, TIM_IT_Update);
+
+	myISRcallback = isrCallback;
+	route_SIT(deferred);
+	periodClocks = (uint64_t)(delay / scale) * (prescaler + 1);
+	SIT_tracePeriod(SIT_TRACE_PERIOD, SIT_id, periodClocks);
+
+	// UG loads PSC and clears CNT; URS keeps it from raising UIF
+	TIMx->ARR = delay / scale - 1;
+	TIMx->PSC = prescaler;
+	TIMx->EGR = TIM_PSCReloadMode_Immediate;
+	TIMx->CR1 |= TIM_CR1_CEN;
+	return true;
+}
+
+// ------------------------------------------------------------
+// Runs isrCallback once every count update events of source,
+// a running SIT: this SIT counts source's update output (TRGO)
+// in external clock mode instead of the timer clock, so long
+// periods need no software counters.  count is split over PSC
+// and ARR and must factor exactly, which any count up to the
+// counter range does.  With AUTO a free SIT linked to source
+// is chosen.  period_SIT() assumes source keeps its period.
+// ------------------------------------------------------------
+bool IntervalTimer::beginChained(const SIT_Delegate& isrCallback, IntervalTimer& source, uint32_t count, TIMid id)
+{
+	if (&source == this || source.status != TIMER_SIT || source.once.active || count < 2)
+		return false;
+	if (!admit_SIT((uint64_t)count * source.period_SIT()))
+		return false;
+
+	uint8_t master = source.SIT_id;
+	if (id >= NUM_SIT) {
+		for (uint8_t tid = 0; tid < NUM_SIT && id >= NUM_SIT; tid++) {
+			if (!used_SIT(tid) && trigger_SIT(master, tid) != SIT_NO_TRIGGER)
+				id = (TIMid)tid;
+		}
+		if (id >= NUM_SIT)
+			return false;
+	}
+	if (trigger_SIT(master, id) == SIT_NO_TRIGGER)
+		return false;
+
+	SIT_Solution sol = SIT_Solver::solve(count, maxReload_SIT(id));
+	if (sol.clocks != count)
+		return false;
+	if (!beginCycles(isrCallback, sol.reload, sol.prescaler, id))
+		return false;
+
+	// switch to counting source's updates from zero, quietly
+	TIM_TypeDef* TIMx = timer_SIT();
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	TIMx->CR1 &= ~TIM_CR1_CEN;
+	TIM_ITRxExternalClockConfig(TIMx, trigger_SIT(master, SIT_id));
+	TIMx->CR1 |= TIM_CR1_URS;
+	TIMx->EGR = TIM_PSCReloadMode_Immediate;
+	TIMx->CR1 &= ~TIM_CR1_URS;
+	TIM_SelectOutputTrigger(source.timer_SIT(), TIM_TRGOSource_Update);
+	TIMx->CR1 |= TIM_CR1_CEN;
+	__set_PRIMASK(primask);
+
+	periodClocks = (uint64_t)count * source.periodClocks;
+	SIT_load[SIT_id].period = (uint64_t)count * SIT_load[source.SIT_id].period;
+#if SIT_ENABLE_TRACE
+	SIT_trace(SIT_TRACE_PERIOD, SIT_id, (uint32_t)(period_SIT() / 1000));
+#endif
+	return true;
+}
+
+uint16_t IntervalTimer::trigger_SIT(uint8_t master, uint8_t slave)
+{
+	if (master >= NUM_SIT || slave >= NUM_SIT)
+		return SIT_NO_TRIGGER;
+	return SIT_TRIGGER[slave][master];
+}
+
+// ------------------------------------------------------------
+// Input clock of a SIT's counter (before PSC) and its largest
+// ARR value.  APB1 timers run at SYSCORECLOCK and APB2 timers
+// (TIM1, TIM8-11 on the Photon) at SYSCORECLOCK2; TIM5 on the
+// Photon has a 32 bit counter.
+// ------------------------------------------------------------
+uint32_t IntervalTimer::clock_SIT(uint8_t id)
+{
+	if (id < NUM_SIT && SIT_HARDWARE[id].apb2)
+		return SYSCORECLOCK2;
+	return SYSCORECLOCK;
+}
+
+// ------------------------------------------------------------
+// Converts a prescaler for SYSCORECLOCK into the one giving the
+// same count rate on SIT id.  Returns false, leaving prescaler
+// unchanged, if the result does not fit PSC.
+// ------------------------------------------------------------
+bool IntervalTimer::rescale_SIT(uint8_t id, uint16_t& prescaler)
+{
+	uint32_t mul = clock_SIT(id) / SYSCORECLOCK;
+	uint32_t scaled = ((uint32_t)prescaler + 1) * mul - 1;
+
+	if (scaled > UINT16_MAX)
+		return false;
+	prescaler = (uint16_t)scaled;
+	return true;
+}
+
+uint32_t IntervalTimer::maxReload_SIT(uint8_t id)
+{
+#if defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	if (id == TIMER5)
+		return UINT32_MAX;
+#endif
+	(void)id;
+	return UINT16_MAX;
+}
+
+// ------------------------------------------------------------
+// Returns -1 if timer not allocated or its SIT id, the TIMid of
+// any pool timer (eg. 0 = TIMER2 on the Core, TIMER3 on the
+// Photon; see the TIMid enum)
 // ------------------------------------------------------------
 int8_t IntervalTimer::isAllocated_SIT(void)
 {
-	if (status == TIMER_SIT)
+	if (status != TIMER_SIT)
 		return -1;
 	else 
 		return SIT_id;
 }
+
+// ------------------------------------------------------------
+// Reserves or frees a SIT slot, for the pool allocator and for
+// users that drive the hardware themselves (eg. IntervalTimerT),
+// so the same timer is never handed out twice.  The slots are
+// bits of one word updated by compare and swap (LDREX/STREX on
+// the device), so claims from other threads or from interrupts
+// cannot both succeed.  A released slot's load is cleared so
+// a user that never measures it (eg. IntervalTimerT) does not
+// inherit the last SIT's share in utilization_SIT().
+// ------------------------------------------------------------
+bool IntervalTimer::claim_SIT(uint8_t id)
+{
+	if (id >= NUM_SIT)
+		return false;
+
+	uint32_t bit = 1UL << id;
+	uint32_t used = SIT_used.load(std::memory_order_relaxed);
+	do {
+		if (used & bit)
+			return false;
+	} while (!SIT_used.compare_exchange_weak(used, used | bit, std::memory_order_acquire, std::memory_order_relaxed));
+	return true;
+}
+
+void IntervalTimer::release_SIT(uint8_t id)
+{
+	if (id >= NUM_SIT)
+		return;
+
+	SIT_Load& l = SIT_load[id];
+	l.period = 0;
+	l.average = l.worst = 0;
+	SIT_used.fetch_and(~(1UL << id), std::memory_order_release);
+}
+
+bool IntervalTimer::used_SIT(uint8_t id)
+{
+	return id < NUM_SIT && (SIT_used.load(std::memory_order_acquire) & (1UL << id));
+}
+
+// ------------------------------------------------------------
+// Reserves or frees a DMA channel (Core: DMA1 channel 1-7) or
+// stream (Photon: DMA1 or DMA2 stream 0-7) for the drivers that
+// program one (IntervalCapture, IntervalPattern, SampledADC),
+// as claim_SIT does for timers, so two drivers never share one.
+// Code driving DMA itself can reserve its channels here too.
+// ------------------------------------------------------------
+static inline uint32_t SIT_dmaBit(uint8_t dma, uint8_t number)
+{
+	return (dma >= 1 && dma <= 2 && number < 8) ? 1UL << (8 * (dma - 1) + number) : 0;
+}
+
+bool IntervalTimer::claimDMA_SIT(uint8_t dma, uint8_t number)
+{
+	uint32_t bit = SIT_dmaBit(dma, number);
+	if (bit == 0)
+		return false;
+
+	uint32_t used = SIT_dmaUsed.load(std::memory_order_relaxed);
+	do {
+		if (used & bit)
+			return false;
+	} while (!SIT_dmaUsed.compare_exchange_weak(used, used | bit, std::memory_order_acquire, std::memory_order_relaxed));
+	return true;
+}
+
+void IntervalTimer::releaseDMA_SIT(uint8_t dma, uint8_t number)
+{
+	SIT_dmaUsed.fetch_and(~SIT_dmaBit(dma, number), std::memory_order_release);
+}
+
+bool IntervalTimer::usedDMA_SIT(uint8_t dma, uint8_t number)
+{
+	return SIT_dmaUsed.load(std::memory_order_acquire) & SIT_dmaBit(dma, number);
+}
+
+// ------------------------------------------------------------
+// Returns the TIM register block of the allocated SIT so
+// layered drivers can read CNT or retune ARR directly
+// ------------------------------------------------------------
+TIM_TypeDef* IntervalTimer::timer_SIT(void)
+{
+	return (SIT_id < NUM_SIT) ? SIT_HARDWARE[SIT_id].TIMx : NULL;
+}
+
+#if SIT_ENABLE_STATS
+// ------------------------------------------------------------
+// Copies a consistent snapshot of this SIT's interrupt stats.
+// The ISR brackets each update with an odd sequence count, so
+// the copy is retried if an update was in progress.  Returns
+// false if the timer is not allocated or no stable copy could
+// be taken (eg. called from an ISR that preempted the update).
+// ------------------------------------------------------------
+bool IntervalTimer::stats(SIT_Stats& snapshot)
+{
+	if (status != TIMER_SIT)
+		return false;
+
+	volatile SIT_Stats& st = SIT_stats[SIT_id];
+	for (int tries = 0; tries < 4; tries++) {
+		uint32_t seq = st.seq;
+		if (seq & 1)
+			continue;
+		__DMB();
+		memcpy(&snapshot, (const void*)&st, sizeof(snapshot));
+		__DMB();
+		if (st.seq == seq)
+			return true;
+	}
+	return false;
+}
+
+// ------------------------------------------------------------
+// Clears this SIT's stats, also done each time it is started
+// ------------------------------------------------------------
+void IntervalTimer::resetStats(void)
+{
+	SIT_Stats& st = SIT_stats[SIT_id];
+	uint32_t seq = st.seq + 2;
+
+#if SIT_STATS_DWT
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;		// make sure the cycle counter runs
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+	st.seq = seq - 1;
+	memset(&st.count, 0, sizeof(st) - offsetof(SIT_Stats, count));
+	st.latency.min = UINT32_MAX;
+	st.duration.min = UINT32_MAX;
+	st.seq = seq;
+}
+#endif
+
+
+// ------------------------------------------------------------
+// Stages a new period for a running SIT, replacing one already
+// staged for it.  Returns false if the SIT is not running, the
+// period is out of range, the periods staged so far would take
+// the utilization over the load ceiling (see admit) or the
+// transaction is full.
+// ------------------------------------------------------------
+bool SIT_Transaction::resetPeriod_SIT(IntervalTimer& timer, intPeriod newPeriod, bool scale)
+{
+	if (newPeriod < 10 || newPeriod > timer.maxPeriod_SIT((TIMid)timer.SIT_id))
+		return false;
+	return stage(timer, newPeriod, timer.prescaler_SIT(scale, (TIMid)timer.SIT_id), IntervalTimer::periodNs_SIT(newPeriod, scale));
+}
+
+bool SIT_Transaction::resetPeriodNs_SIT(IntervalTimer& timer, uint64_t ns)
+{
+	SIT_Solution sol = timer.solve_SIT(ns);
+	return sol.valid() && stage(timer, sol.reload, sol.prescaler, ns);
+}
+
+bool SIT_Transaction::resetPeriodHz_SIT(IntervalTimer& timer, double hz)
+{
+	return hz > 0 && resetPeriodNs_SIT(timer, (uint64_t)(1e9 / hz + 0.5));
+}
+
+bool SIT_Transaction::stage(IntervalTimer& timer, intPeriod period, uint16_t prescaler, uint64_t ns)
+{
+	if (timer.status != IntervalTimer::TIMER_SIT || timer.once.active)
+		return false;
+
+	uint8_t i = 0;
+	while (i < count && entries[i].timer != &timer)
+		i++;
+	if (i == IntervalTimer::NUM_SIT)
+		return false;
+
+	Entry was = entries[i];
+	uint8_t wasCount = count;
+	if (i == count)
+		count++;
+	entries[i].timer = &timer;
+	entries[i].period = period;
+	entries[i].prescaler = prescaler;
+	entries[i].ns = ns;
+	if (!admit()) {
+		entries[i] = was;
+		count = wasCount;
+		return false;
+	}
+	return true;
+}
+
+// ------------------------------------------------------------
+// Admission of the whole batch: the utilization once every
+// staged period is in place, each staged SIT's callback time
+// (as in IntervalTimer::admit_SIT) over its new period instead
+// of its present load, checked once against the ceiling.
+// ------------------------------------------------------------
+bool SIT_Transaction::admit(void)
+{
+	if (!(IntervalTimer::SIT_loadCeiling > 0))
+		return true;
+
+	float load = IntervalTimer::utilization_SIT();
+	for (uint8_t i = 0; i < count; i++) {
+		IntervalTimer* t = entries[i].timer;
+		if (t->status == IntervalTimer::TIMER_SIT)
+			load -= t->load_SIT();
+		if (entries[i].ns != 0)
+			load += (float)t->costNs_SIT() / entries[i].ns;
+	}
+	return load <= IntervalTimer::SIT_loadCeiling;
+}
+
+// ------------------------------------------------------------
+// Writes every staged period with interrupts disabled, then
+// empties the transaction.  Returns false, writing nothing, if
+// a staged SIT has been stopped or re-purposed since staging,
+// or the staged periods together no longer pass admission
+// because loads grew in the meantime.
+// ------------------------------------------------------------
+bool SIT_Transaction::commit(void)
+{
+	bool ok = admit();
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	for (uint8_t i = 0; i < count; i++) {
+		IntervalTimer* t = entries[i].timer;
+		if (t->status != IntervalTimer::TIMER_SIT || t->once.active)
+			ok = false;
+	}
+	for (uint8_t i = 0; ok && i < count; i++) {
+		IntervalTimer* t = entries[i].timer;
+		t->preload = true;
+		t->shadow_SIT(entries[i].period, entries[i].prescaler);
+	}
+	__set_PRIMASK(primask);
+	count = 0;
+	return ok;
+}
+
+
+// ------------------------------------------------------------
+// Adds a running SIT to the group, or changes its offset if it
+// is already a member.  Its update events will come offsetNs
+// after those of a member with offset 0 and the same period.
+// ------------------------------------------------------------
+bool SIT_Group::add(IntervalTimer& timer, uint64_t offsetNs)
+{
+	if (timer.status != IntervalTimer::TIMER_SIT || timer.once.active)
+		return false;
+
+	uint8_t i = 0;
+	while (i < count && members[i].timer != &timer)
+		i++;
+	if (i == IntervalTimer::NUM_SIT)
+		return false;
+	if (i == count)
+		count++;
+	members[i].timer = &timer;
+	members[i].offsetNs = offsetNs;
+	return true;
+}
+
+// ------------------------------------------------------------
+// Stops every member, presets its counter for its offset, and
+// starts them all from the master's counter enable.  Pending
+// updates are dropped and the restart raises no callback.
+// Returns false, changing nothing, if a member has stopped or
+// no member can trigger all the others (eg. TIM6 or TIM7).
+// ------------------------------------------------------------
+bool SIT_Group::start(void)
+{
+	int master = -1;
+	for (uint8_t i = 0; i < count && master < 0; i++) {
+		bool reaches = true;
+		for (uint8_t j = 0; j < count; j++) {
+			if (j != i && IntervalTimer::trigger_SIT(members[i].timer->SIT_id, members[j].timer->SIT_id) == SIT_NO_TRIGGER)
+				reaches = false;
+		}
+		if (reaches)
+			master = i;
+	}
+	if (master < 0)
+		return false;
+
+	// first update after ARR + 1 - preset counts
+	uint32_t preset[IntervalTimer::NUM_SIT];
+	for (uint8_t i = 0; i < count; i++) {
+		IntervalTimer* t = members[i].timer;
+		if (t->status != IntervalTimer::TIMER_SIT || t->once.active)
+			return false;
+
+		TIM_TypeDef* TIMx = t->timer_SIT();
+		uint64_t counts = (uint64_t)TIMx->ARR + 1;
+		uint64_t lag = SIT_Solver::clocksFromNs(members[i].offsetNs, IntervalTimer::clock_SIT(t->SIT_id));
+		lag = lag / ((uint64_t)TIMx->PSC + 1) % counts;
+		preset[i] = (uint32_t)((counts - lag) % counts);
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	for (uint8_t i = 0; i < count; i++) {
+		IntervalTimer* t = members[i].timer;
+		TIM_TypeDef* TIMx = t->timer_SIT();
+
+		TIMx->CR1 &= ~TIM_CR1_CEN;
+		TIMx->CR1 |= TIM_CR1_URS;
+		TIMx->EGR = TIM_PSCReloadMode_Immediate;		// clear the prescaler, load PSC/ARR
+		TIMx->CR1 &= ~TIM_CR1_URS;
+		TIM_ClearITPendingBit(TIMx, TIM_IT_Update);
+		TIMx->CNT = preset[i];
+		if (i == master) {
+			TIMx->SMCR &= ~TIM_SMCR_SMS;
+			TIM_SelectOutputTrigger(TIMx, TIM_TRGOSource_Enable);
+		}
+		else {
+			TIM_SelectInputTrigger(TIMx, IntervalTimer::trigger_SIT(members[master].timer->SIT_id, t->SIT_id));
+			TIM_SelectSlaveMode(TIMx, TIM_SlaveMode_Trigger);
+		}
+	}
+	members[master].timer->timer_SIT()->CR1 |= TIM_CR1_CEN;
+	__set_PRIMASK(primask);
+	return true;
+}
@@ -26,19 +26,28 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 #define __INTERVALTIMER_H__
 
 #include "Particle.h"
+#include <new>
+#include <type_traits>
+#include <chrono>
+#include <atomic>
+#include "SparkIntervalSolver.h"
+#include "SparkIntervalTrace.h"
 
 
 #if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
   #define SYSCORECLOCK	72000000UL
+  #define SYSCORECLOCK2	72000000UL		// APB2 timers run at the same clock
 
 #elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
   #define SYSCORECLOCK	60000000UL		// Timer clock tree uses core clock / 2
+  #define SYSCORECLOCK2	120000000UL		// APB2 timers (TIM1, TIM8-11) run at twice SYSCORECLOCK
 #else
   #error "*** PARTICLE device not supported by this library. PLATFORM should be Core or Photon ***"
 #endif
 
 enum {uSec, hmSec};			// microseconds or half-milliseconds
 enum action {INT_DISABLE, INT_ENABLE};
+enum SIT_OverrunPolicy {SIT_OVERRUN_CATCHUP, SIT_OVERRUN_SKIP, SIT_OVERRUN_DISABLE};
 
 #ifdef __cplusplus
 extern "C" {
@@ -70,96 +79,603 @@ extern void Wiring_TIM4_Interrupt_Handler_override(void);
 extern void Wiring_TIM5_Interrupt_Handler_override(void);
 extern void Wiring_TIM6_Interrupt_Handler_override(void);
 extern void Wiring_TIM7_Interrupt_Handler_override(void);
-
-enum TIMid {TIMER3, TIMER4, TIMER5, TIMER6, TIMER7, AUTO=255};
+extern void Wiring_TIM1_Interrupt_Handler_override(void);
+extern void Wiring_TIM8_Interrupt_Handler_override(void);
+extern void Wiring_TIM9_Interrupt_Handler_override(void);
+extern void Wiring_TIM10_Interrupt_Handler_override(void);
+extern void Wiring_TIM11_Interrupt_Handler_override(void);
+extern void Wiring_TIM12_Interrupt_Handler_override(void);
+extern void Wiring_TIM13_Interrupt_Handler_override(void);
+extern void Wiring_TIM14_Interrupt_Handler_override(void);
+
+// TIMER3-7 keep their original ids; the APB2 and remaining timers follow
+enum TIMid {TIMER3, TIMER4, TIMER5, TIMER6, TIMER7, TIMER1, TIMER8, TIMER9, TIMER10, TIMER11, TIMER12, TIMER13, TIMER14, AUTO=255};
 typedef uint32_t intPeriod;
 #endif
 
+#ifdef __cplusplus
+}
+#endif
+
+#ifndef SIT_ENABLE_STATS
+#define SIT_ENABLE_STATS	0		// 1 = record per-SIT interrupt latency and callback duration
+#endif
+#ifndef SIT_ENABLE_LOAD
+#define SIT_ENABLE_LOAD		0		// 1 = time every callback for the load figures and overrun estimate
+#endif
+#ifndef SIT_STATS_DWT
+#define SIT_STATS_DWT		1		// time callbacks in CPU cycles (DWT) instead of timer ticks
+#endif
+#define SIT_STATS_BUCKETS	16
+
+#if SIT_ENABLE_STATS
+// ------------------------------------------------------------
+// Interrupt statistics kept per SIT when SIT_ENABLE_STATS is 1.
+// latency is in timer ticks from the update event to handler
+// entry (1us for uSec, 0.5ms for hmSec), duration is in CPU
+// cycles (timer ticks if SIT_STATS_DWT is 0).  hist[0] counts
+// zero values and hist[k] values in [2^(k-1), 2^k), the last
+// bucket also takes everything larger.
+// ------------------------------------------------------------
+struct SIT_StatSeries {
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[SIT_STATS_BUCKETS];
+};
+
+struct SIT_Stats {
+	uint32_t seq;					// odd while the ISR is updating
+	uint32_t count;					// interrupts recorded
+	SIT_StatSeries latency;
+	SIT_StatSeries duration;
+
+	float meanLatency() const { return count ? (float)latency.sum / count : 0.0f; }
+	float meanDuration() const { return count ? (float)duration.sum / count : 0.0f; }
+};
+#endif
+
+#ifndef SIT_ENABLE_TRACE
+#define SIT_ENABLE_TRACE	0		// 1 = record SIT events in a RAM ring (SIT_Trace)
+#endif
+#ifndef SIT_TRACE_EVENTS
+#define SIT_TRACE_EVENTS	256		// trace ring size in events of 8 bytes, a power of 2
+#endif
+
+#if SIT_ENABLE_TRACE
+// ------------------------------------------------------------
+// Event trace kept when SIT_ENABLE_TRACE is 1: the last
+// SIT_TRACE_EVENTS starts, stops, period changes, interrupt
+// enables and disables, overruns and update interrupts (with
+// their duration) of all SITs, in the format described in
+// SparkIntervalTrace.h.  An event costs one atomic add to
+// reserve its slot and two stores.  dump() writes the ring as a
+// binary blob to anything with write(const uint8_t*, size_t),
+// eg. Serial, for the decoder in sim/.
+// ------------------------------------------------------------
+struct SIT_Trace {
+	static_assert((SIT_TRACE_EVENTS & (SIT_TRACE_EVENTS - 1)) == 0, "SIT_TRACE_EVENTS must be a power of 2");
+
+	static SIT_TraceEvent ring[SIT_TRACE_EVENTS];
+	static std::atomic<uint32_t> head;		// events recorded since clear(), wrapping
+	static volatile bool full;				// the ring has been filled once
+	static volatile bool enabled;			// recording, true by default
+
+	static void enable(bool on) { enabled = on; }
+	static void clear(void);
+	template <typename Out>
+	static size_t dump(Out& out);
+};
+
+// ------------------------------------------------------------
+// Writes the header and the events held, oldest first.
+// Recording is paused meanwhile, so the dump is consistent.
+// ------------------------------------------------------------
+template <typename Out>
+size_t SIT_Trace::dump(Out& out)
+{
+	bool was = enabled;
+	enabled = false;
+
+	uint32_t end = head.load();
+	uint32_t count = (full || end >= SIT_TRACE_EVENTS) ? SIT_TRACE_EVENTS : end;
+	SIT_TraceHeader header = { { 'S', 'I', 'T', 'T' }, SIT_TRACE_VERSION,
+#if defined(PLATFORM_ID)
+		PLATFORM_ID,
+#else
+		0,
+#endif
+		sizeof(SIT_TraceEvent), SystemCoreClock, count, end - count };
+
+	size_t n = out.write((const uint8_t*)&header, sizeof(header));
+	for (uint32_t i = end - count; i != end; i++)
+		n += out.write((const uint8_t*)&ring[i & (SIT_TRACE_EVENTS - 1)], sizeof(SIT_TraceEvent));
+	enabled = was;
+	return n;
+}
+#endif
+
+#ifndef SIT_PRIORITY
+#define SIT_PRIORITY			10		// default NVIC preemption priority of a SIT's update interrupt
+#endif
+#ifndef SIT_DEFERRED_PRIORITY
+#define SIT_DEFERRED_PRIORITY	14		// preemption priority deferred callbacks run at
+#endif
+
+// Deferred callbacks run from an IRQ line the device leaves
+// unused, pended in software.  PendSV is not an option as the
+// Photon's RTOS owns it.  On the Core the vector is claimed by
+// defining SIT_DEFERRED_HANDLER, on the Photon it is attached.
+#ifndef SIT_DEFERRED_IRQn
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core: CAN is not used
+#define SIT_DEFERRED_IRQn		CAN1_SCE_IRQn
+#define SIT_DEFERRED_HANDLER	CAN1_SCE_IRQHandler
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon: the STM32F205RG has no FSMC
+#define SIT_DEFERRED_IRQn		FSMC_IRQn
+#endif
+#endif
+
+#ifndef SIT_DELEGATE_SIZE
+#define SIT_DELEGATE_SIZE	(3 * sizeof(void*))		// inline state for member and lambda callbacks
+#endif
+
+// ------------------------------------------------------------
+// Callback stored inline in SIT_CALLBACK.  Holds a plain
+// function, a function taking a context pointer, an object and
+// member function, or a small trivially copyable lambda.  No
+// heap and no virtual dispatch: invoking is always fn(ctx).
+// ------------------------------------------------------------
+class SIT_Delegate {
+  private:
+	void (*fn)(void*);
+	void* ctx;
+	union {
+		void* align;
+		uint8_t buf[SIT_DELEGATE_SIZE];
+	} store;
+
+	template <typename T>
+	struct Member {
+		T* obj;
+		void (T::*method)();
+	};
+
+	static void callPlain(void* f) { ((void (*)())f)(); }
+	static void callNone(void*) {}
+
+	template <typename T>
+	static void callMember(void* m) {
+		Member<T>* b = (Member<T>*)m;
+		(b->obj->*(b->method))();
+	}
+
+	template <typename F>
+	static void callFunctor(void* f) { (*(F*)f)(); }
+
+	// ctx may point at our own store, keep it that way on copies;
+	// constructors zero the store, so copying it all reads no
+	// uninitialised bytes
+	void copyFrom(const SIT_Delegate& other) {
+		fn = other.fn;
+		store = other.store;
+		ctx = (other.ctx == &other.store) ? (void*)&store : other.ctx;
+	}
+
+  public:
+	SIT_Delegate() : fn(callNone), ctx(NULL), store() {}
+
+	SIT_Delegate(void (*isrCallback)()) : fn(callPlain), ctx((void*)isrCallback), store() {
+		if (isrCallback == NULL)
+			fn = callNone;
+	}
+
+	SIT_Delegate(void (*isrCallback)(void*), void* context) : fn(isrCallback), ctx(context), store() {
+		if (isrCallback == NULL)
+			fn = callNone;
+	}
+
+	template <typename T>
+	SIT_Delegate(T* obj, void (T::*method)()) : fn(callMember<T>), ctx(&store), store() {
+		static_assert(sizeof(Member<T>) <= SIT_DELEGATE_SIZE, "member binding does not fit SIT_DELEGATE_SIZE");
+		Member<T> b = {obj, method};
+		new (&store) Member<T>(b);
+	}
+
+	template <typename F, typename = typename std::enable_if<
+		std::is_class<F>::value && !std::is_same<F, SIT_Delegate>::value>::type>
+	SIT_Delegate(const F& callable) : fn(callFunctor<F>), ctx(&store), store() {
+		static_assert(sizeof(F) <= SIT_DELEGATE_SIZE, "lambda captures do not fit SIT_DELEGATE_SIZE");
+		static_assert(std::is_trivially_copyable<F>::value, "lambda captures must be trivially copyable");
+		new (&store) F(callable);
+	}
+
+	SIT_Delegate(const SIT_Delegate& other) { copyFrom(other); }
+	SIT_Delegate& operator=(const SIT_Delegate& other) { copyFrom(other); return *this; }
+
+	void operator()() const { fn(ctx); }
+	bool isSet() const { return fn != callNone; }
+};
+
+// ------------------------------------------------------------
+// Deferred callback state of one SIT.  In deferred mode the
+// update ISR only stamps the DWT cycle counter, counts the post
+// and pends SIT_DEFERRED_IRQn; that IRQ calls the callback once
+// for all posts since its last run.  batch is the number of
+// posts the running callback covers and batchStamp the stamp of
+// the latest of them; coalesced counts posts merged away.
+// ------------------------------------------------------------
+struct SIT_Deferred {
+	SIT_Delegate callback;
+	volatile uint32_t posted;
+	volatile uint32_t stamp;
+	uint32_t taken;
+	uint32_t batch;
+	uint32_t batchStamp;
+	uint32_t coalesced;
+	volatile bool active;
+};
+
+// ------------------------------------------------------------
+// Overrun accounting of one SIT.  A callback overruns when the
+// next update event arrives before it returns; the update events
+// that get no callback of their own are counted in missed.
+// elapsed is the number of update events the running callback
+// stands for: 1, or more for the late call after an overrun
+// under SIT_OVERRUN_CATCHUP.  tripped is set when the
+// SIT_OVERRUN_DISABLE policy has turned the interrupt off.
+// ------------------------------------------------------------
+struct SIT_Overrun {
+	uint8_t policy;
+	volatile bool tripped;
+	volatile uint32_t elapsed;
+	uint32_t limit;
+	uint32_t strikes;				// overruns since the interrupt was enabled
+	volatile uint32_t overruns;
+	volatile uint32_t missed;
+};
+
+#ifndef SIT_LOAD_AVERAGE
+#define SIT_LOAD_AVERAGE	4		// callback time is averaged over about 2^n calls
+#endif
+#ifndef SIT_LOAD_DECAY
+#define SIT_LOAD_DECAY		8		// worst callback time decays by 1/2^n per call
+#endif
+
+// ------------------------------------------------------------
+// CPU load of one SIT.  With SIT_ENABLE_LOAD each callback is
+// timed with the DWT cycle counter; average is a moving average
+// of those times scaled by 2^SIT_LOAD_AVERAGE and worst the
+// longest, decaying so one slow call is forgotten after some
+// hundreds of calls.  Without it both stay 0.
+// period is the SIT's period in CPU cycles, 0 for one-shots.
+// ------------------------------------------------------------
+struct SIT_Load {
+	uint64_t period;
+	volatile uint32_t average;
+	volatile uint32_t worst;
+};
+
+// ------------------------------------------------------------
+// Long-term accuracy of a beginFrequency() timer.  counts is
+// the total of timer counts elapsed over periods update events;
+// errorCounts is counts minus the exact ideal, always within
+// (-1, 0] counts, so the average period has no drift.
+// ------------------------------------------------------------
+struct SIT_FractionalStats {
+	uint64_t periods;
+	uint64_t counts;
+	double errorCounts;
+	double errorNs;
+	uint32_t countNs;		// duration of one timer count, rounded
+};
+
 class IntervalTimer {
+	friend class IntervalPattern;
+	friend class SampledADC;
+	friend class IntervalCapture;
+	friend class IntervalToggle;
+	friend class IntervalCompare;
+	friend class SIT_Transaction;
+	friend class SIT_Group;
+
   private:
 	typedef void (*ISRcallback)();
     enum {TIMER_OFF, TIMER_SIT};
 #if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
     static const uint8_t NUM_SIT = 3;
 #elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
-    static const uint8_t NUM_SIT = 5;
+    static const uint8_t NUM_SIT = 13;
 #endif
 
-	bool sysIntSetupDone = false;
-
 	// Timer ClockDivision = DIV4
 	const uint16_t SIT_PRESCALERu = (uint16_t)(SYSCORECLOCK / 1000000UL) - 1;	//To get TIM counter clock = 1MHz
 	const uint16_t SIT_PRESCALERm = (uint16_t)(SYSCORECLOCK / 2000UL) - 1;	//To get TIM counter clock = 2KHz
     const uint16_t MAX_PERIOD = UINT16_MAX;		// 1-65535 us
 
-    static bool SIT_used[NUM_SIT];
-    bool allocate_SIT(intPeriod Period, bool scale, TIMid id);
-    void start_SIT(intPeriod Period, bool scale);
+    const uint64_t MIN_PERIOD_NS = 1000;		// shortest period accepted by beginNs/beginHz
+
+    static std::atomic<uint32_t> SIT_used;		// bit n set while SIT n is allocated
+    static std::atomic<uint32_t> SIT_dmaUsed;	// DMA channels and streams reserved (see claimDMA_SIT)
+    static std::atomic<bool> SIT_attached;		// system interrupt hooks attached
+    bool allocate_SIT(intPeriod Period, uint16_t prescaler, TIMid id);
+    static bool pwmConflict_SIT(uint8_t id);
+    static uint8_t pinTimer_SIT(uint16_t pin);
+    static void connect_SIT(uint16_t pin, PinMode mode);
+    static void attach_SIT(void);
+    void start_SIT(intPeriod Period, uint16_t prescaler);
     void stop_SIT();
+    void reload_SIT(intPeriod newPeriod, uint16_t prescaler);
+    void shadow_SIT(intPeriod newPeriod, uint16_t prescaler);
+    void fixedPeriod_SIT(intPeriod newPeriod, uint16_t prescaler);
+    SIT_Solution solve_SIT(uint64_t ns);
+    static uint16_t trigger_SIT(uint8_t master, uint8_t slave);
+    void route_SIT(bool defer);
+    static void post_SIT(void* state);
     bool status;
+    bool preload;				// period changes wait for the next update event
+    bool deferred;				// callbacks run from SIT_DEFERRED_IRQn
+    uint8_t priority;			// NVIC preemption priority of the update interrupt
+    SIT_OverrunPolicy overrunPolicy;
+    uint32_t overrunLimit;
     uint8_t SIT_id;
- 	ISRcallback myISRcallback;
+    uint64_t periodClocks;		// achieved period in timer clock cycles
+    uint32_t budgetNs;			// declared callback time, for admission
+    static float SIT_loadCeiling;
+    bool admit_SIT(uint64_t ns);
+    uint32_t costNs_SIT(void);
+    static uint64_t periodNs_SIT(intPeriod Period, bool scale) {
+		return ((uint64_t)Period + 1) * ((scale == hmSec) ? 500000UL : 1000UL);
+    }
+ 	SIT_Delegate myISRcallback;
+
+	// Fractional frequency mode: each period is whole or whole + 1
+	// counts, chosen by a phase accumulator stepping rem / den
+	struct {
+		bool active;
+		TIM_TypeDef* TIMx;
+		SIT_Delegate callback;
+		uint32_t divider;			// PSC + 1
+		uint32_t whole;
+		uint64_t rem;
+		uint64_t den;
+		volatile uint64_t acc;
+		volatile uint64_t periods;
+		volatile uint64_t counts;
+		uint32_t freqNum;
+		uint32_t freqDen;
+	} frac;
+
+	uint32_t fractionalStep(void);
+	void fractionalTick(void);
+
+	// One-shot mode: the timer runs in one-pulse mode (OPM), stopping
+	// itself at the update event, and is re-armed by register writes
+	struct {
+		bool active;
+		TIM_TypeDef* TIMx;
+		uint32_t ticksPerUs;		// timer clocks per microsecond
+		uint32_t maxReload;
+	} once;
+
+	bool prepareOnce(const SIT_Delegate& isrCallback, TIMid id);
+	bool armOnce(const SIT_Delegate& isrCallback, uint32_t delay);
+
+    uint16_t prescaler_SIT(bool scale) {
+		return (scale == hmSec) ? SIT_PRESCALERm : SIT_PRESCALERu;
+    }
+    uint16_t prescaler_SIT(bool scale, TIMid id) {
+		uint16_t prescaler = prescaler_SIT(scale);
+		rescale_SIT(id, prescaler);
+		return prescaler;
+    }
+    static bool rescale_SIT(uint8_t id, uint16_t& prescaler);
+    intPeriod maxPeriod_SIT(TIMid id) {
+		return (id < NUM_SIT) ? (intPeriod)maxReload_SIT(id) : MAX_PERIOD;
+    }
 
-    bool beginCycles(void (*isrCallback)(), intPeriod Period, bool scale, TIMid id);
+    bool beginCycles(const SIT_Delegate& isrCallback, intPeriod Period, uint16_t prescaler, TIMid id, bool oneShot = false);
+    void take_SIT(IntervalTimer& other);
 
   public:
     IntervalTimer() {
 	status = TIMER_OFF;
-
-	for (int i=0; i < NUM_SIT; i++)		//Set all SIT slots to unused
-		SIT_used[i] = false;
+	preload = false;
+	deferred = false;
+	priority = SIT_PRIORITY;
+	overrunPolicy = SIT_OVERRUN_CATCHUP;
+	overrunLimit = 1;
+	periodClocks = 0;
+	budgetNs = 0;
+	frac.active = false;
+	once.active = false;
 
 	// Attach timer interrupt handlers
 #if !defined(PLATFORM_ID)							//Core v0.3.4
         Wiring_TIM2_Interrupt_Handler = Wiring_TIM2_Interrupt_Handler_override;
         Wiring_TIM3_Interrupt_Handler = Wiring_TIM3_Interrupt_Handler_override;
         Wiring_TIM4_Interrupt_Handler = Wiring_TIM4_Interrupt_Handler_override;
-
-#elif defined(STM32F10X_MD)							//Core
-	if (!sysIntSetupDone) {
-		sysIntSetupDone = true;
-		if (!attachSystemInterrupt(SysInterrupt_TIM2_Update, Wiring_TIM2_Interrupt_Handler_override)) ;	//error
-		if (!attachSystemInterrupt(SysInterrupt_TIM3_Update, Wiring_TIM3_Interrupt_Handler_override)) ;	//error
-		if (!attachSystemInterrupt(SysInterrupt_TIM4_Update, Wiring_TIM4_Interrupt_Handler_override)) ;	//error
-	}
-#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
-	if (!sysIntSetupDone) {
-		sysIntSetupDone = true;
-		if (!attachSystemInterrupt(SysInterrupt_TIM3_Update, Wiring_TIM3_Interrupt_Handler_override)) ;	//error
-		if (!attachSystemInterrupt(SysInterrupt_TIM4_Update, Wiring_TIM4_Interrupt_Handler_override)) ;	//error
-		if (!attachSystemInterrupt(SysInterrupt_TIM5_Update, Wiring_TIM5_Interrupt_Handler_override)) ;	//error
-		if (!attachSystemInterrupt(SysInterrupt_TIM6_Update, Wiring_TIM6_Interrupt_Handler_override));	//error
-		if (!attachSystemInterrupt(SysInterrupt_TIM7_Update, Wiring_TIM7_Interrupt_Handler_override));	//error
-	}
+#else
+	if (!SIT_attached.exchange(true))
+		attach_SIT();
 #endif
 
     }
 
+    IntervalTimer(IntervalTimer&& other) noexcept;
+    IntervalTimer& operator=(IntervalTimer&& other) noexcept;
+    IntervalTimer(const IntervalTimer&) = delete;
+    IntervalTimer& operator=(const IntervalTimer&) = delete;
+
     ~IntervalTimer() { end(); }
 
-    bool begin(void (*isrCallback)(), intPeriod Period, bool scale) {
-		if (Period < 10 || Period > MAX_PERIOD)
+    bool begin(const SIT_Delegate& isrCallback, intPeriod Period, bool scale) {
+		if (Period < 10 || Period > MAX_PERIOD || !admit_SIT(periodNs_SIT(Period, scale)))
 			return false;
-		return beginCycles(isrCallback, Period, scale, AUTO);
+		return beginCycles(isrCallback, Period, prescaler_SIT(scale), AUTO);
     }
 
-    bool begin(void (*isrCallback)(), intPeriod Period, bool scale, TIMid id) {
-		if (Period < 10 || Period > MAX_PERIOD)
+    bool begin(const SIT_Delegate& isrCallback, intPeriod Period, bool scale, TIMid id) {
+		if (Period < 10 || Period > maxPeriod_SIT(id) || !admit_SIT(periodNs_SIT(Period, scale)))
 			return false;
-		return beginCycles(isrCallback, Period, scale, id);
+		return beginCycles(isrCallback, Period, prescaler_SIT(scale, id), id);
+    }
+
+    // the priority is only kept if the SIT starts
+    bool begin(const SIT_Delegate& isrCallback, intPeriod Period, bool scale, TIMid id, uint8_t preempt) {
+		uint8_t previous = priority;
+		priority_SIT(preempt);
+		if (begin(isrCallback, Period, scale, id))
+			return true;
+		priority = previous;
+		return false;
+    }
+
+    bool begin(void (*isrCallback)(void*), void* context, intPeriod Period, bool scale, TIMid id = AUTO) {
+		return begin(SIT_Delegate(isrCallback, context), Period, scale, id);
     }
 
+    template <typename T>
+    bool begin(T* obj, void (T::*method)(), intPeriod Period, bool scale, TIMid id = AUTO) {
+		return begin(SIT_Delegate(obj, method), Period, scale, id);
+    }
+
+    template <typename Rep, typename Ratio>
+    bool begin(const SIT_Delegate& isrCallback, std::chrono::duration<Rep, Ratio> period, TIMid id = AUTO) {
+		return beginNs(isrCallback, std::chrono::duration_cast<std::chrono::nanoseconds>(period).count(), id);
+    }
+
+    bool beginNs(const SIT_Delegate& isrCallback, uint64_t ns, TIMid id = AUTO);
+    bool beginHz(const SIT_Delegate& isrCallback, double hz, TIMid id = AUTO);
+    bool beginFrequency(const SIT_Delegate& isrCallback, uint32_t num, uint32_t den = 1, TIMid id = AUTO);
+    bool fractionalStats(SIT_FractionalStats& stats);
+
+    bool fireOnce(const SIT_Delegate& isrCallback, uint32_t delay, TIMid id = AUTO);
+    bool fireAt(const SIT_Delegate& isrCallback, uint32_t deadline, TIMid id = AUTO);
+    bool cancel_SIT(void);
+
+    bool beginChained(const SIT_Delegate& isrCallback, IntervalTimer& source, uint32_t count, TIMid id = AUTO);
+
     void end();
 	void interrupt_SIT(action ACT);
 	void resetPeriod_SIT(intPeriod newPeriod, bool scale);
+	bool resetPeriodNs_SIT(uint64_t ns);
+	bool resetPeriodHz_SIT(double hz);
+	void preload_SIT(bool enable);
+	void priority_SIT(uint8_t preempt);
+	void deferred_SIT(bool enable);
+	uint32_t batch_SIT(void);
+	uint32_t batchStamp_SIT(void);
+	uint32_t coalesced_SIT(void);
+	void overrunPolicy_SIT(SIT_OverrunPolicy policy, uint32_t limit = 1);
+	uint32_t elapsed_SIT(void);
+	uint32_t overruns_SIT(void);
+	uint32_t missed_SIT(void);
+	bool tripped_SIT(void);
+	void budget_SIT(uint32_t ns) { budgetNs = ns; }
+	uint32_t callbackNs_SIT(bool worst = false);
+	float load_SIT(bool worst = false);
+	static float utilization_SIT(bool worst = false);
+	static void loadCeiling_SIT(float ceiling) { SIT_loadCeiling = ceiling; }
+	static float loadCeiling_SIT(void) { return SIT_loadCeiling; }
+
+	template <typename Rep, typename Ratio>
+	bool resetPeriod_SIT(std::chrono::duration<Rep, Ratio> period) {
+		return resetPeriodNs_SIT(std::chrono::duration_cast<std::chrono::nanoseconds>(period).count());
+	}
+
+	uint64_t period_SIT(void);
 	int8_t isAllocated_SIT(void);
+	TIM_TypeDef* timer_SIT(void);
+
+    static SIT_Delegate SIT_CALLBACK[NUM_SIT];
+    static SIT_Deferred SIT_deferred[NUM_SIT];
+    static SIT_Overrun SIT_overrun[NUM_SIT];
+    static SIT_Load SIT_load[NUM_SIT];
+    static void bottomHalf_SIT(void);
+#if SIT_ENABLE_STATS
+    static SIT_Stats SIT_stats[NUM_SIT];
+    bool stats(SIT_Stats& snapshot);
+    void resetStats(void);
+#endif
+    static bool claim_SIT(uint8_t id);
+    static void release_SIT(uint8_t id);
+    static bool used_SIT(uint8_t id);
+    static bool claimDMA_SIT(uint8_t dma, uint8_t number);
+    static void releaseDMA_SIT(uint8_t dma, uint8_t number);
+    static bool usedDMA_SIT(uint8_t dma, uint8_t number);
+    static bool sharedIrq_SIT(uint8_t id);
+    static uint32_t clock_SIT(uint8_t id);
+    static uint32_t maxReload_SIT(uint8_t id);
+};
+
+// ------------------------------------------------------------
+// Stages new periods for several running SITs and applies them
+// together in one short critical section.  Staging does the
+// checks and PSC/ARR solving up front; commit() only writes the
+// preload registers, so each timer finishes its current period
+// and switches at its own next update event, with no restart
+// and no extra callback.  Committed timers are left in preload
+// mode (see IntervalTimer::preload_SIT).
+// ------------------------------------------------------------
+class SIT_Transaction {
+  public:
+	SIT_Transaction() : count(0) {}
 
-    static ISRcallback SIT_CALLBACK[NUM_SIT];
+	bool resetPeriod_SIT(IntervalTimer& timer, intPeriod newPeriod, bool scale);
+	bool resetPeriodNs_SIT(IntervalTimer& timer, uint64_t ns);
+	bool resetPeriodHz_SIT(IntervalTimer& timer, double hz);
+
+	template <typename Rep, typename Ratio>
+	bool resetPeriod_SIT(IntervalTimer& timer, std::chrono::duration<Rep, Ratio> period) {
+		return resetPeriodNs_SIT(timer, std::chrono::duration_cast<std::chrono::nanoseconds>(period).count());
+	}
+
+	bool commit(void);
+	void clear(void) { count = 0; }
+	uint8_t size(void) const { return count; }
+
+  private:
+	struct Entry {
+		IntervalTimer* timer;
+		intPeriod period;
+		uint16_t prescaler;
+		uint64_t ns;			// for admission at commit
+	};
+
+	Entry entries[IntervalTimer::NUM_SIT];
+	uint8_t count;
+
+	bool stage(IntervalTimer& timer, intPeriod period, uint16_t prescaler, uint64_t ns);
+	bool admit(void);
 };
 
+// ------------------------------------------------------------
+// Restarts several running SITs on the same timer clock edge.
+// One member, able to reach all others through the timers'
+// internal trigger inputs, becomes the master: the others wait
+// in trigger slave mode and its counter enable (TRGO) starts
+// them all.  Each member may lag the group by a phase offset,
+// applied by presetting its counter.  Slaves start a fixed one
+// or two timer clocks after the master, the trigger
+// resynchronisation delay, and stay in slave mode until end().
+// ------------------------------------------------------------
+class SIT_Group {
+  public:
+	SIT_Group() : count(0) {}
 
-#ifdef __cplusplus
-}
-#endif
+	bool add(IntervalTimer& timer, uint64_t offsetNs = 0);
+	bool start(void);
+	void clear(void) { count = 0; }
+	uint8_t size(void) const { return count; }
+
+  private:
+	struct Member {
+		IntervalTimer* timer;
+		uint64_t offsetNs;
+	};
+
+	Member members[IntervalTimer::NUM_SIT];
+	uint8_t count;
+};
 
 #endif
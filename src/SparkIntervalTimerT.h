@@ -0,0 +1,227 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __INTERVALTIMERT_H__
+#define __INTERVALTIMERT_H__
+
+#include "SparkIntervalTimer.h"
+
+// ------------------------------------------------------------
+// Compile-time description of each SIT: TIM register block,
+// IRQ channel, the APB bus it sits on with its clock enable bit
+// and timer clock, and how to hook (and restore) the update
+// interrupt handler for the platform.  Where the IRQ serves no
+// other SIT (DIRECT) the handler owns the vector itself
+// (attachInterruptDirect), skipping the HAL's IRQ handler and
+// system interrupt table; TIMER1/TIMER10 and TIMER8/TIMER13
+// share their update IRQ, so those stay on the system
+// interrupt, which the HAL dispatches to both.
+// ------------------------------------------------------------
+template <TIMid ID> struct SIT_traits;
+
+#if !defined(PLATFORM_ID)							//Core v0.3.4
+#define SIT_TRAITS(ID, TIMn, IRQ, BUS, RCCMASK, HOOK, SYSIRQ, OVERRIDE, DIRECT)	\
+template <> struct SIT_traits<ID> {										\
+	static TIM_TypeDef* TIMx() { return TIMn; }							\
+	static const IRQn_Type irq = IRQ;									\
+	static const uint32_t rcc = RCCMASK;								\
+	static const uint32_t clock = (BUS == 2) ? SYSCORECLOCK2 : SYSCORECLOCK;	\
+	static void enable() { RCC->APB##BUS##ENR |= RCCMASK; }				\
+	static void attach(void (*handler)(void)) { HOOK = handler; }		\
+	static void restore() { HOOK = OVERRIDE; }							\
+};
+#else												//Core and Photon
+#define SIT_TRAITS(ID, TIMn, IRQ, BUS, RCCMASK, HOOK, SYSIRQ, OVERRIDE, DIRECT)	\
+template <> struct SIT_traits<ID> {										\
+	static TIM_TypeDef* TIMx() { return TIMn; }							\
+	static const IRQn_Type irq = IRQ;									\
+	static const uint32_t rcc = RCCMASK;								\
+	static const uint32_t clock = (BUS == 2) ? SYSCORECLOCK2 : SYSCORECLOCK;	\
+	static void enable() { RCC->APB##BUS##ENR |= RCCMASK; }				\
+	static void attach(void (*handler)(void)) {							\
+		if (DIRECT) {													\
+			attachInterruptDirect(IRQ, handler, false);					\
+			return;														\
+		}																\
+		detachSystemInterrupt(SYSIRQ);									\
+		attachSystemInterrupt(SYSIRQ, handler);							\
+	}																	\
+	static void restore() {												\
+		if (DIRECT) {													\
+			detachInterruptDirect(IRQ, false);							\
+			return;														\
+		}																\
+		detachSystemInterrupt(SYSIRQ);									\
+		attachSystemInterrupt(SYSIRQ, OVERRIDE);						\
+	}																	\
+};
+#endif
+
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+SIT_TRAITS(TIMER2, TIM2, TIM2_IRQn, 1, RCC_APB1Periph_TIM2, Wiring_TIM2_Interrupt_Handler, SysInterrupt_TIM2_Update, Wiring_TIM2_Interrupt_Handler_override, 1)
+SIT_TRAITS(TIMER3, TIM3, TIM3_IRQn, 1, RCC_APB1Periph_TIM3, Wiring_TIM3_Interrupt_Handler, SysInterrupt_TIM3_Update, Wiring_TIM3_Interrupt_Handler_override, 1)
+SIT_TRAITS(TIMER4, TIM4, TIM4_IRQn, 1, RCC_APB1Periph_TIM4, Wiring_TIM4_Interrupt_Handler, SysInterrupt_TIM4_Update, Wiring_TIM4_Interrupt_Handler_override, 1)
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+SIT_TRAITS(TIMER3, TIM3, TIM3_IRQn, 1, RCC_APB1Periph_TIM3, Wiring_TIM3_Interrupt_Handler, SysInterrupt_TIM3_Update, Wiring_TIM3_Interrupt_Handler_override, 1)
+SIT_TRAITS(TIMER4, TIM4, TIM4_IRQn, 1, RCC_APB1Periph_TIM4, Wiring_TIM4_Interrupt_Handler, SysInterrupt_TIM4_Update, Wiring_TIM4_Interrupt_Handler_override, 1)
+SIT_TRAITS(TIMER5, TIM5, TIM5_IRQn, 1, RCC_APB1Periph_TIM5, Wiring_TIM5_Interrupt_Handler, SysInterrupt_TIM5_Update, Wiring_TIM5_Interrupt_Handler_override, 1)
+SIT_TRAITS(TIMER6, TIM6, TIM6_DAC_IRQn, 1, RCC_APB1Periph_TIM6, Wiring_TIM6_Interrupt_Handler, SysInterrupt_TIM6_Update, Wiring_TIM6_Interrupt_Handler_override, 1)
+SIT_TRAITS(TIMER7, TIM7, TIM7_IRQn, 1, RCC_APB1Periph_TIM7, Wiring_TIM7_Interrupt_Handler, SysInterrupt_TIM7_Update, Wiring_TIM7_Interrupt_Handler_override, 1)
+SIT_TRAITS(TIMER1, TIM1, TIM1_UP_TIM10_IRQn, 2, RCC_APB2Periph_TIM1, Wiring_TIM1_Interrupt_Handler, SysInterrupt_TIM1_Update, Wiring_TIM1_Interrupt_Handler_override, 0)
+SIT_TRAITS(TIMER8, TIM8, TIM8_UP_TIM13_IRQn, 2, RCC_APB2Periph_TIM8, Wiring_TIM8_Interrupt_Handler, SysInterrupt_TIM8_Update, Wiring_TIM8_Interrupt_Handler_override, 0)
+SIT_TRAITS(TIMER9, TIM9, TIM1_BRK_TIM9_IRQn, 2, RCC_APB2Periph_TIM9, Wiring_TIM9_Interrupt_Handler, SysInterrupt_TIM9_Update, Wiring_TIM9_Interrupt_Handler_override, 1)
+SIT_TRAITS(TIMER10, TIM10, TIM1_UP_TIM10_IRQn, 2, RCC_APB2Periph_TIM10, Wiring_TIM10_Interrupt_Handler, SysInterrupt_TIM10_Update, Wiring_TIM10_Interrupt_Handler_override, 0)
+SIT_TRAITS(TIMER11, TIM11, TIM1_TRG_COM_TIM11_IRQn, 2, RCC_APB2Periph_TIM11, Wiring_TIM11_Interrupt_Handler, SysInterrupt_TIM11_Update, Wiring_TIM11_Interrupt_Handler_override, 1)
+SIT_TRAITS(TIMER12, TIM12, TIM8_BRK_TIM12_IRQn, 1, RCC_APB1Periph_TIM12, Wiring_TIM12_Interrupt_Handler, SysInterrupt_TIM12_Update, Wiring_TIM12_Interrupt_Handler_override, 1)
+SIT_TRAITS(TIMER13, TIM13, TIM8_UP_TIM13_IRQn, 1, RCC_APB1Periph_TIM13, Wiring_TIM13_Interrupt_Handler, SysInterrupt_TIM13_Update, Wiring_TIM13_Interrupt_Handler_override, 0)
+SIT_TRAITS(TIMER14, TIM14, TIM8_TRG_COM_TIM14_IRQn, 1, RCC_APB1Periph_TIM14, Wiring_TIM14_Interrupt_Handler, SysInterrupt_TIM14_Update, Wiring_TIM14_Interrupt_Handler_override, 1)
+#endif
+
+#undef SIT_TRAITS
+
+
+// ------------------------------------------------------------
+// IntervalTimer with its timer and callback fixed at compile
+// time.  The update ISR, bound to the IRQ vector where the line
+// is not shared, is a direct SR test and clear followed by a
+// call the compiler can inline, and the control methods
+// reduce to plain register writes with no SIT_id dispatch.
+// The SIT slot is reserved in the shared pool while running,
+// so IntervalTimerT and IntervalTimer objects can be mixed.
+//
+//   void sample(void);
+//   IntervalTimerT<TIMER4, sample> sampler;
+//   sampler.begin(10, uSec);
+// ------------------------------------------------------------
+template <TIMid ID, void (*CALLBACK)(void)>
+class IntervalTimerT {
+  private:
+	typedef SIT_traits<ID> SIT;
+
+	static const uint16_t SIT_PRESCALERu = (uint16_t)(SIT::clock / 1000000UL) - 1;	//To get TIM counter clock = 1MHz
+	static const uint16_t SIT_PRESCALERm = (uint16_t)(SIT::clock / 2000UL) - 1;		//To get TIM counter clock = 2KHz
+	static const intPeriod MAX_PERIOD = UINT16_MAX;
+
+	bool status;
+	uint8_t priority;			// NVIC preemption priority of the update interrupt
+
+	static uint16_t prescaler(bool scale) {
+		return (scale == hmSec) ? SIT_PRESCALERm : SIT_PRESCALERu;
+	}
+
+	void start_SIT(intPeriod Period, bool scale) {
+		TIM_TypeDef* TIMx = SIT::TIMx();
+
+		SIT::enable();
+		TIMx->CR1 = 0;
+		TIMx->PSC = prescaler(scale);
+		TIMx->ARR = Period;
+		TIMx->EGR = TIM_EGR_UG;				// latch PSC, then drop the resulting flag
+		TIMx->SR = (uint16_t)~TIM_SR_UIF;
+		TIMx->DIER = TIM_DIER_UIE;
+		NVIC_SetPriority(SIT::irq, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), priority, 1));
+		NVIC_EnableIRQ(SIT::irq);
+		TIMx->CR1 = TIM_CR1_CEN;
+	}
+
+	void stop_SIT() {
+		TIM_TypeDef* TIMx = SIT::TIMx();
+
+		TIMx->CR1 = 0;
+		TIMx->DIER = 0;
+		TIMx->SR = 0;
+		if (!IntervalTimer::sharedIrq_SIT(ID))
+			NVIC_DisableIRQ(SIT::irq);
+	}
+
+  public:
+	IntervalTimerT() : status(false), priority(SIT_PRIORITY) {}
+	~IntervalTimerT() { end(); }
+	IntervalTimerT(const IntervalTimerT&) = delete;
+	IntervalTimerT& operator=(const IntervalTimerT&) = delete;
+
+	static void isr(void) {
+		TIM_TypeDef* TIMx = SIT::TIMx();
+
+		if (TIMx->SR & TIM_SR_UIF) {
+			TIMx->SR = (uint16_t)~TIM_SR_UIF;
+			CALLBACK();
+		}
+	}
+
+	bool begin(intPeriod Period, bool scale) {
+		if (Period < 10 || Period > MAX_PERIOD)
+			return false;
+		if (status)
+			stop_SIT();
+		else if (IntervalTimer::claim_SIT(ID))
+			SIT::attach(isr);
+		else
+			return false;
+		status = true;
+		start_SIT(Period, scale);
+		return true;
+	}
+
+	void end() {
+		if (!status)
+			return;
+		stop_SIT();
+		SIT::restore();
+		IntervalTimer::release_SIT(ID);
+		status = false;
+	}
+
+	void interrupt_SIT(action ACT) {
+		TIM_TypeDef* TIMx = SIT::TIMx();
+
+		if (ACT == INT_ENABLE) {
+			TIMx->DIER = TIM_DIER_UIE;
+			NVIC_SetPriority(SIT::irq, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), priority, 1));
+			NVIC_EnableIRQ(SIT::irq);
+		}
+		else if (IntervalTimer::sharedIrq_SIT(ID))
+			TIMx->DIER = 0;				// the line serves another SIT too
+		else
+			NVIC_DisableIRQ(SIT::irq);
+	}
+
+	void resetPeriod_SIT(intPeriod newPeriod, bool scale) {
+		TIM_TypeDef* TIMx = SIT::TIMx();
+
+		TIMx->ARR = newPeriod;
+		TIMx->PSC = prescaler(scale);
+		TIMx->EGR = TIM_EGR_UG;
+		TIMx->SR = (uint16_t)~TIM_SR_UIF;
+	}
+
+	// as IntervalTimer::priority_SIT(): 0 (most urgent) to 15, taking
+	// effect at the next begin() or interrupt_SIT(INT_ENABLE)
+	void priority_SIT(uint8_t preempt) {
+		priority = (preempt > 15) ? 15 : preempt;
+	}
+
+	int8_t isAllocated_SIT(void) {
+		return status ? (int8_t)ID : -1;
+	}
+};
+
+#endif
@@ -0,0 +1,149 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include "SparkIntervalToggle.h"
+
+// ------------------------------------------------------------
+// Returns true if pin can be used by IntervalToggle
+// ------------------------------------------------------------
+bool IntervalToggle::canToggle(uint16_t pin) {
+	return IntervalTimer::pinTimer_SIT(pin) < IntervalTimer::NUM_SIT;
+}
+
+
+// ------------------------------------------------------------
+// Starts a square wave of hz on pin, as close as the timer's
+// prescaler and reload allow (see frequency()).  The highest
+// frequency is a quarter of the timer clock.  Fails if the pin
+// is not on a pool timer, or its timer is in use by a SIT or by
+// analogWrite on another of its pins.
+// ------------------------------------------------------------
+bool IntervalToggle::begin(uint16_t pin, double hz) {
+	uint8_t id = IntervalTimer::pinTimer_SIT(pin);
+
+	end();
+	if (id >= IntervalTimer::NUM_SIT || !(hz > 0))
+		return false;
+	return start(pin, id, SIT_Solver::clocksFromHz(2 * hz, IntervalTimer::clock_SIT(id)));
+}
+
+
+// ------------------------------------------------------------
+// As begin(), with the wave's full period in nanoseconds
+// ------------------------------------------------------------
+bool IntervalToggle::beginNs(uint16_t pin, uint64_t periodNs) {
+	uint8_t id = IntervalTimer::pinTimer_SIT(pin);
+
+	end();
+	if (id >= IntervalTimer::NUM_SIT)
+		return false;
+	return start(pin, id, (SIT_Solver::clocksFromNs(periodNs, IntervalTimer::clock_SIT(id)) + 1) / 2);
+}
+
+
+// ------------------------------------------------------------
+// Runs the pin's timer with a period of half a cycle and its
+// channel in toggle mode.  Compare is at 0, so each edge comes
+// with an update event; the update interrupt is left disabled.
+// ------------------------------------------------------------
+bool IntervalToggle::start(uint16_t pin, uint8_t id, uint64_t halfClocks) {
+	SIT_Solution sol = SIT_Solver::solve(halfClocks, IntervalTimer::maxReload_SIT(id));
+
+	// toggling needs at least two counts per half cycle
+	if (!sol.valid() || sol.reload < 1 || IntervalTimer::pwmConflict_SIT(id))
+		return false;
+	if (!hwTimer.beginCycles(SIT_Delegate(), (intPeriod)sol.reload, (uint16_t)sol.prescaler, (TIMid)id))
+		return false;
+	TIMx = hwTimer.timer_SIT();
+	TIM_Cmd(TIMx, DISABLE);
+	TIM_ITConfig(TIMx, TIM_IT_Update, DISABLE);
+	TIM_ClearITPendingBit(TIMx, TIM_IT_Update);
+	outputPin = pin;
+	achieved = (double)IntervalTimer::clock_SIT(id) / (2.0 * sol.clocks);
+
+	IntervalTimer::connect_SIT(pin, AF_OUTPUT_PUSHPULL);
+
+	TIM_OCInitTypeDef ocInitStructure;
+	TIM_OCStructInit(&ocInitStructure);
+	ocInitStructure.TIM_OCMode = TIM_OCMode_Toggle;
+	ocInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+	ocInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
+	ocInitStructure.TIM_Pulse = 0;
+#if !defined(PLATFORM_ID)							//Core v0.3.4
+	uint16_t timerCh = PIN_MAP[pin].timer_ch;
+#else
+	uint16_t timerCh = HAL_Pin_Map()[pin].timer_ch;
+#endif
+	switch (timerCh) {
+	case TIM_Channel_1:
+		TIM_OC1Init(TIMx, &ocInitStructure);
+		break;
+	case TIM_Channel_2:
+		TIM_OC2Init(TIMx, &ocInitStructure);
+		break;
+	case TIM_Channel_3:
+		TIM_OC3Init(TIMx, &ocInitStructure);
+		break;
+	case TIM_Channel_4:
+		TIM_OC4Init(TIMx, &ocInitStructure);
+		break;
+	}
+#if defined(STM32F2XX) && defined(PLATFORM_ID)		//Photon
+	// TIMER1 and TIMER8 outputs are gated by MOE
+	if (TIMx == TIM1 || TIMx == TIM8)
+		TIM_CtrlPWMOutputs(TIMx, ENABLE);
+#endif
+
+	TIMx->CNT = 0;
+	TIM_Cmd(TIMx, ENABLE);
+	return true;
+}
+
+
+// ------------------------------------------------------------
+// Runs callback every cycles output cycles, from a second SIT
+// (allocated from the pool, or the specified id) counting the
+// output timer's update events.  Call after begin(); a new
+// begin() or end() stops it.  As with begin(), the callback
+// also runs once when started.
+// ------------------------------------------------------------
+bool IntervalToggle::onCycles(const SIT_Delegate& callback, uint32_t cycles, TIMid id) {
+	if (TIMx == NULL || cycles < 1 || cycles > UINT32_MAX / 2)
+		return false;
+	return cycleTimer.beginChained(callback, hwTimer, 2 * cycles, id);
+}
+
+
+// ------------------------------------------------------------
+// Stops the wave and the cycle callback, releases the SITs and
+// leaves the pin a low output
+// ------------------------------------------------------------
+void IntervalToggle::end(void) {
+	if (TIMx == NULL)
+		return;
+
+	cycleTimer.end();
+	hwTimer.end();
+	TIMx = NULL;
+	achieved = 0;
+	pinMode(outputPin, OUTPUT);
+	digitalWrite(outputPin, LOW);
+}
@@ -0,0 +1,70 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __INTERVALTOGGLE_H__
+#define __INTERVALTOGGLE_H__
+
+#include "SparkIntervalTimer.h"
+
+// ------------------------------------------------------------
+// Drives a square wave on a timer pin with no interrupts.  The
+// pin's channel runs in output compare toggle mode, so the
+// hardware flips the pin once per counter period and the CPU is
+// not involved per edge.  An optional callback every N cycles
+// comes from a second SIT counting the first one's update
+// events (see IntervalTimer::beginChained), again without an
+// interrupt per edge.
+//
+// The timer is taken from the SIT pool.  Pins are those of the
+// pin/timer tables in README section 1 on a pool timer:
+//   Core:   D0, D1 (TIMER4), A0, A1 (TIMER2), A4-A7 (TIMER3)
+//   Photon: D0, D1 (TIMER4), D2, D3, A4, A5 (TIMER3), A7 (TIMER5),
+//           RX, TX (TIMER1)
+// Other pins of the same timer keep their analogWrite settings
+// but not their duty cycle, so a timer already used by
+// analogWrite is refused.
+// ------------------------------------------------------------
+class IntervalToggle {
+  private:
+	IntervalTimer hwTimer;
+	IntervalTimer cycleTimer;	// counts hwTimer's updates for onCycles()
+	TIM_TypeDef* TIMx;
+	uint16_t outputPin;
+	double achieved;			// output frequency in Hz
+
+	bool start(uint16_t pin, uint8_t id, uint64_t halfClocks);
+
+  public:
+	IntervalToggle() : TIMx(NULL), outputPin(0), achieved(0) {}
+	~IntervalToggle() { end(); }
+
+	bool begin(uint16_t pin, double hz);
+	bool beginNs(uint16_t pin, uint64_t periodNs);
+	bool onCycles(const SIT_Delegate& callback, uint32_t cycles, TIMid id = AUTO);
+	void end(void);
+
+	double frequency(void) { return achieved; }
+	bool isActive(void) { return TIMx != NULL; }
+
+	static bool canToggle(uint16_t pin);
+};
+
+#endif
@@ -0,0 +1,78 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __INTERVALTRACE_H__
+#define __INTERVALTRACE_H__
+
+#include <stdint.h>
+
+// ------------------------------------------------------------
+// Binary format of the SIT event trace (see SIT_ENABLE_TRACE in
+// SparkIntervalTimer.h).  A dump is one SIT_TraceHeader followed
+// by count SIT_TraceEvents, oldest first, all little endian.
+// There are no Particle dependencies, so host tools such as the
+// decoder in sim/ read the format from this header.
+// ------------------------------------------------------------
+#define SIT_TRACE_VERSION	1
+
+enum SIT_TraceType {
+	SIT_TRACE_START,		// value: period in microseconds
+	SIT_TRACE_STOP,
+	SIT_TRACE_PERIOD,		// value: new period in microseconds
+	SIT_TRACE_ENABLE,		// interrupt_SIT(INT_ENABLE)
+	SIT_TRACE_DISABLE,		// value: 1 if tripped by SIT_OVERRUN_DISABLE
+	SIT_TRACE_UPDATE,		// update ISR; value: its duration in CPU cycles
+	SIT_TRACE_DEFERRED,		// deferred callback; value: its duration in CPU cycles
+	SIT_TRACE_OVERRUN		// value: update events passed during the callback
+};
+
+// ------------------------------------------------------------
+// One event: stamp is the DWT cycle count (CPU cycles, wrapping
+// at 2^32) when it began, info packs the type (4 bits), SIT id
+// (4 bits) and a 24 bit value, saturated at SIT_TRACE_MAX_VALUE
+// ------------------------------------------------------------
+#define SIT_TRACE_MAX_VALUE	0xFFFFFFUL
+
+struct SIT_TraceEvent {
+	uint32_t stamp;
+	uint32_t info;
+
+	static uint32_t pack(uint8_t type, uint8_t id, uint32_t value) {
+		if (value > SIT_TRACE_MAX_VALUE)
+			value = SIT_TRACE_MAX_VALUE;
+		return ((uint32_t)type << 28) | ((uint32_t)(id & 0x0F) << 24) | value;
+	}
+	uint8_t type() const { return info >> 28; }
+	uint8_t id() const { return (info >> 24) & 0x0F; }
+	uint32_t value() const { return info & SIT_TRACE_MAX_VALUE; }
+};
+
+struct SIT_TraceHeader {
+	char magic[4];			// "SITT"
+	uint8_t version;		// SIT_TRACE_VERSION
+	uint8_t platform;		// PLATFORM_ID, 0 for the Core; names the SIT ids
+	uint16_t eventSize;		// sizeof(SIT_TraceEvent)
+	uint32_t clock;			// stamp ticks per second (SystemCoreClock)
+	uint32_t count;			// events following the header
+	uint32_t lost;			// older events overwritten before the dump
+};
+
+#endif
@@ -0,0 +1,357 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include "SparkSampledADC.h"
+
+// ADC1 trigger of each SIT and the compare channel producing it
+// (0 = TRGO on update).  Triggers are ADC_ExternalTrigConv_*.
+struct SIT_ADCTrigger {
+	uint32_t trigger;
+	uint8_t channel;
+	bool valid;
+};
+
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+static const SIT_ADCTrigger SIT_ADC_TRIGGER[] = {
+	{ ADC_ExternalTrigConv_T2_CC2, 2, true },			// TIM2
+	{ ADC_ExternalTrigConv_T3_TRGO, 0, true },			// TIM3
+	{ ADC_ExternalTrigConv_T4_CC4, 4, true },			// TIM4
+};
+const uint32_t SIT_ADC_CONVERSION_NS = 1700;		// 7.5 + 12.5 cycles at 12MHz
+#define SIT_ADC_DMA				DMA1_Channel1
+const uint8_t SIT_ADC_DMA_UNIT = 1, SIT_ADC_DMA_NUMBER = 1;
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+static const SIT_ADCTrigger SIT_ADC_TRIGGER[] = {
+	{ ADC_ExternalTrigConv_T3_TRGO, 0, true },			// TIM3
+	{ ADC_ExternalTrigConv_T4_CC4, 4, true },			// TIM4
+	{ ADC_ExternalTrigConv_T5_CC1, 1, true },			// TIM5
+	{ 0, 0, false },									// TIM6 (DAC trigger only)
+	{ 0, 0, false },									// TIM7 (DAC trigger only)
+	{ ADC_ExternalTrigConv_T1_CC1, 1, true },			// TIM1
+	{ ADC_ExternalTrigConv_T8_TRGO, 0, true },			// TIM8
+	{ 0, 0, false },									// TIM9-14 (no ADC trigger)
+	{ 0, 0, false },
+	{ 0, 0, false },
+	{ 0, 0, false },
+	{ 0, 0, false },
+	{ 0, 0, false },
+};
+const uint32_t SIT_ADC_CONVERSION_NS = 1000;		// 15 + 12 cycles at 30MHz
+#define SIT_ADC_DMA				DMA2_Stream0
+const uint8_t SIT_ADC_DMA_UNIT = 2, SIT_ADC_DMA_NUMBER = 0;
+#endif
+
+
+// ------------------------------------------------------------
+// Starts converting count pins (analog inputs, sampled in the
+// given order) every Period + 1 counts of the timebase (uSec or
+// hmSec, as for IntervalTimer::begin).  Results are interleaved
+// by pin in buf; len must be a multiple of 2 * count, and buf must
+// stay valid until end().  Each period must leave time for count
+// conversions (about 1.7us each on the Core and 1us on the Photon).
+// ------------------------------------------------------------
+bool SampledADC::begin(const uint16_t* pins, uint8_t count, uint16_t* buf, uint16_t len, intPeriod Period, bool scale, TIMid id) {
+	if (Period < 1 || Period > hwTimer.maxPeriod_SIT(id))
+		return false;
+	return start(pins, count, buf, len, Period, hwTimer.prescaler_SIT(scale, id), id);
+}
+
+bool SampledADC::beginNs(const uint16_t* pins, uint8_t count, uint16_t* buf, uint16_t len, uint64_t ns, TIMid id) {
+	uint8_t sit = (id < IntervalTimer::NUM_SIT) ? id : 0;
+	SIT_Solution sol = SIT_Solver::solveNs(ns, IntervalTimer::clock_SIT(sit),
+		(id < IntervalTimer::NUM_SIT) ? IntervalTimer::maxReload_SIT(id) : UINT16_MAX);
+	if (!sol.valid())
+		return false;
+	return start(pins, count, buf, len, sol.reload, sol.prescaler, id);
+}
+
+bool SampledADC::beginHz(const uint16_t* pins, uint8_t count, uint16_t* buf, uint16_t len, double hz, TIMid id) {
+	uint8_t sit = (id < IntervalTimer::NUM_SIT) ? id : 0;
+	SIT_Solution sol = SIT_Solver::solveHz(hz, IntervalTimer::clock_SIT(sit),
+		(id < IntervalTimer::NUM_SIT) ? IntervalTimer::maxReload_SIT(id) : UINT16_MAX);
+	if (!sol.valid())
+		return false;
+	return start(pins, count, buf, len, sol.reload, sol.prescaler, id);
+}
+
+
+// ------------------------------------------------------------
+// Returns true if SIT id can trigger ADC1
+// ------------------------------------------------------------
+bool SampledADC::canTrigger(uint8_t id) {
+	return id < IntervalTimer::NUM_SIT && SIT_ADC_TRIGGER[id].valid;
+}
+
+
+// ------------------------------------------------------------
+// Allocates a SIT able to trigger the ADC (the specified one, or
+// the first free one for AUTO), swaps its update interrupt for a
+// trigger output and starts the ADC and its DMA.  Fails if the
+// DMA channel or stream is reserved by another driver.
+// ------------------------------------------------------------
+bool SampledADC::start(const uint16_t* pins, uint8_t count, uint16_t* buf, uint16_t len, intPeriod Period, uint16_t prescaler, TIMid id) {
+
+	end();
+	if (pins == NULL || buf == NULL || count < 1 || count > SIT_ADC_MAX_CHANNELS)
+		return false;
+	if (len < 2 * count || len % (2 * count) != 0)
+		return false;
+
+	// with AUTO, prescaler is for SYSCORECLOCK and is scaled to the SIT picked
+	uint8_t base = (id < IntervalTimer::NUM_SIT) ? id : 0;
+	uint64_t clocks = ((uint64_t)Period + 1) * ((uint32_t)prescaler + 1);
+	if (clocks < SIT_Solver::clocksFromNs((uint64_t)count * SIT_ADC_CONVERSION_NS, IntervalTimer::clock_SIT(base)))
+		return false;
+
+	if (!IntervalTimer::claimDMA_SIT(SIT_ADC_DMA_UNIT, SIT_ADC_DMA_NUMBER))
+		return false;
+	bool allocated = false;
+	for (uint8_t sit = 0; sit < IntervalTimer::NUM_SIT && !allocated; sit++) {
+		uint16_t scaled = prescaler;
+		if ((id < IntervalTimer::NUM_SIT && sit != id) || !canTrigger(sit) || IntervalTimer::used_SIT(sit))
+			continue;
+		if (id >= IntervalTimer::NUM_SIT && !IntervalTimer::rescale_SIT(sit, scaled))
+			continue;
+		allocated = hwTimer.beginCycles(SIT_Delegate(), Period, scaled, (TIMid)sit);
+	}
+	if (!allocated) {
+		IntervalTimer::releaseDMA_SIT(SIT_ADC_DMA_UNIT, SIT_ADC_DMA_NUMBER);
+		return false;
+	}
+
+	// no update interrupts, the timer only triggers conversions
+	TIMx = hwTimer.timer_SIT();
+	TIM_Cmd(TIMx, DISABLE);
+	TIM_ITConfig(TIMx, TIM_IT_Update, DISABLE);
+	TIM_ClearITPendingBit(TIMx, TIM_IT_Update);
+
+	const SIT_ADCTrigger& trig = SIT_ADC_TRIGGER[hwTimer.SIT_id];
+	if (trig.channel == 0)
+		TIM_SelectOutputTrigger(TIMx, TIM_TRGOSource_Update);
+	else {
+		// PWM1 output rises at each update; the ADC triggers on that edge
+		TIM_OCInitTypeDef ocInitStructure;
+		TIM_OCStructInit(&ocInitStructure);
+		ocInitStructure.TIM_OCMode = TIM_OCMode_PWM1;
+		ocInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+		ocInitStructure.TIM_Pulse = Period / 2 + 1;
+		ocInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
+		switch (trig.channel) {
+		case 1: TIM_OC1Init(TIMx, &ocInitStructure); break;
+		case 2: TIM_OC2Init(TIMx, &ocInitStructure); break;
+		case 4: TIM_OC4Init(TIMx, &ocInitStructure); break;
+		}
+	}
+
+	buffer = buf;
+	length = len;
+	ready = NULL;
+	blocks = 0;
+	missed = 0;
+
+	if (!startADC(pins, count, trig.trigger)) {
+		end();
+		return false;
+	}
+
+	TIMx->CNT = 0;
+	TIM_Cmd(TIMx, ENABLE);
+	return true;
+}
+
+
+// ------------------------------------------------------------
+// Configures ADC1 for an externally triggered scan of the pins
+// and its DMA for circular transfers into buffer
+// ------------------------------------------------------------
+bool SampledADC::startADC(const uint16_t* pins, uint8_t count, uint32_t trigger) {
+
+	uint8_t adcChannel[SIT_ADC_MAX_CHANNELS];
+	for (uint8_t i = 0; i < count; i++) {
+#if !defined(PLATFORM_ID)							//Core v0.3.4
+		adcChannel[i] = PIN_MAP[pins[i]].adc_channel;
+#else
+		adcChannel[i] = HAL_Pin_Map()[pins[i]].adc_channel;
+#endif
+		if (adcChannel[i] == NONE)
+			return false;
+		pinMode(pins[i], AN_INPUT);
+	}
+
+	ADC_InitTypeDef adcInitStructure;
+	DMA_InitTypeDef dmaInitStructure;
+
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	RCC_ADCCLKConfig(RCC_PCLK2_Div6);
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1, ENABLE);
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+	DMA_DeInit(SIT_ADC_DMA);
+	dmaInitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&ADC1->DR;
+	dmaInitStructure.DMA_MemoryBaseAddr = (uint32_t)(uintptr_t)buffer;
+	dmaInitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+	dmaInitStructure.DMA_BufferSize = length;
+	dmaInitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	dmaInitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	dmaInitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+	dmaInitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+	dmaInitStructure.DMA_Mode = DMA_Mode_Circular;
+	dmaInitStructure.DMA_Priority = DMA_Priority_High;
+	dmaInitStructure.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(SIT_ADC_DMA, &dmaInitStructure);
+	DMA_ClearFlag(DMA1_FLAG_GL1);
+	DMA_Cmd(SIT_ADC_DMA, ENABLE);
+
+	ADC_DeInit(ADC1);
+	adcInitStructure.ADC_Mode = ADC_Mode_Independent;
+	adcInitStructure.ADC_ScanConvMode = (count > 1) ? ENABLE : DISABLE;
+	adcInitStructure.ADC_ContinuousConvMode = DISABLE;
+	adcInitStructure.ADC_ExternalTrigConv = trigger;
+	adcInitStructure.ADC_DataAlign = ADC_DataAlign_Right;
+	adcInitStructure.ADC_NbrOfChannel = count;
+	ADC_Init(ADC1, &adcInitStructure);
+	for (uint8_t i = 0; i < count; i++)
+		ADC_RegularChannelConfig(ADC1, adcChannel[i], i + 1, ADC_SampleTime_7Cycles5);
+
+	ADC_DMACmd(ADC1, ENABLE);
+	ADC_Cmd(ADC1, ENABLE);
+	ADC_ResetCalibration(ADC1);
+	while (ADC_GetResetCalibrationStatus(ADC1)) ;
+	ADC_StartCalibration(ADC1);
+	while (ADC_GetCalibrationStatus(ADC1)) ;
+	ADC_ExternalTrigConvCmd(ADC1, ENABLE);
+
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	ADC_CommonInitTypeDef commonInitStructure;
+
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1, ENABLE);
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+
+	DMA_Cmd(SIT_ADC_DMA, DISABLE);
+	DMA_DeInit(SIT_ADC_DMA);
+	dmaInitStructure.DMA_Channel = DMA_Channel_0;
+	dmaInitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&ADC1->DR;
+	dmaInitStructure.DMA_Memory0BaseAddr = (uint32_t)(uintptr_t)buffer;
+	dmaInitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+	dmaInitStructure.DMA_BufferSize = length;
+	dmaInitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	dmaInitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	dmaInitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+	dmaInitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+	dmaInitStructure.DMA_Mode = DMA_Mode_Circular;
+	dmaInitStructure.DMA_Priority = DMA_Priority_High;
+	dmaInitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+	dmaInitStructure.DMA_FIFOThreshold = DMA_FIFOThreshold_HalfFull;
+	dmaInitStructure.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+	dmaInitStructure.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+	DMA_Init(SIT_ADC_DMA, &dmaInitStructure);
+	DMA_ClearFlag(SIT_ADC_DMA, DMA_FLAG_HTIF0 | DMA_FLAG_TCIF0 | DMA_FLAG_TEIF0 | DMA_FLAG_DMEIF0 | DMA_FLAG_FEIF0);
+	DMA_Cmd(SIT_ADC_DMA, ENABLE);
+
+	ADC_DeInit();
+	commonInitStructure.ADC_Mode = ADC_Mode_Independent;
+	commonInitStructure.ADC_Prescaler = ADC_Prescaler_Div2;
+	commonInitStructure.ADC_DMAAccessMode = ADC_DMAAccessMode_Disabled;
+	commonInitStructure.ADC_TwoSamplingDelay = ADC_TwoSamplingDelay_5Cycles;
+	ADC_CommonInit(&commonInitStructure);
+
+	adcInitStructure.ADC_Resolution = ADC_Resolution_12b;
+	adcInitStructure.ADC_ScanConvMode = (count > 1) ? ENABLE : DISABLE;
+	adcInitStructure.ADC_ContinuousConvMode = DISABLE;
+	adcInitStructure.ADC_ExternalTrigConvEdge = ADC_ExternalTrigConvEdge_Rising;
+	adcInitStructure.ADC_ExternalTrigConv = trigger;
+	adcInitStructure.ADC_DataAlign = ADC_DataAlign_Right;
+	adcInitStructure.ADC_NbrOfConversion = count;
+	ADC_Init(ADC1, &adcInitStructure);
+	for (uint8_t i = 0; i < count; i++)
+		ADC_RegularChannelConfig(ADC1, adcChannel[i], i + 1, ADC_SampleTime_15Cycles);
+
+	ADC_DMARequestAfterLastTransferCmd(ADC1, ENABLE);
+	ADC_DMACmd(ADC1, ENABLE);
+	ADC_Cmd(ADC1, ENABLE);
+#endif
+	return true;
+}
+
+
+// ------------------------------------------------------------
+// Stops the timer, the ADC and its DMA, and releases the SIT
+// ------------------------------------------------------------
+void SampledADC::end(void) {
+	if (TIMx == NULL)
+		return;
+
+	hwTimer.end();
+	TIMx = NULL;
+	ADC_Cmd(ADC1, DISABLE);
+	ADC_DMACmd(ADC1, DISABLE);
+	DMA_Cmd(SIT_ADC_DMA, DISABLE);
+	IntervalTimer::releaseDMA_SIT(SIT_ADC_DMA_UNIT, SIT_ADC_DMA_NUMBER);
+}
+
+
+// ------------------------------------------------------------
+// Call from loop() at least twice per buffer period.  If a block
+// (half of the buffer) has filled since the last call, points
+// block() at it, runs the block callback and returns 1, else
+// returns 0.  If both halves filled, the older block has already
+// been overwritten: an overrun is counted and only the newest
+// complete block is reported.
+// ------------------------------------------------------------
+uint8_t SampledADC::service(void) {
+	if (TIMx == NULL)
+		return 0;
+
+#if defined(STM32F10X_MD) || !defined(PLATFORM_ID)		//Core
+	uint32_t flags = DMA1->ISR & (DMA_ISR_HTIF1 | DMA_ISR_TCIF1);
+	const uint32_t HALF = DMA_ISR_HTIF1, BOTH = DMA_ISR_HTIF1 | DMA_ISR_TCIF1;
+	DMA1->IFCR = flags;
+#elif defined(STM32F2XX) && defined(PLATFORM_ID)	//Photon
+	uint32_t flags = DMA2->LISR & (DMA_LISR_HTIF0 | DMA_LISR_TCIF0);
+	const uint32_t HALF = DMA_LISR_HTIF0, BOTH = DMA_LISR_HTIF0 | DMA_LISR_TCIF0;
+	DMA2->LIFCR = flags;
+#endif
+	if (flags == 0)
+		return 0;
+
+	bool firstHalf;
+	if (flags == BOTH) {
+		missed++;
+		firstHalf = position() >= length / 2;
+	}
+	else
+		firstHalf = (flags == HALF);
+
+	ready = firstHalf ? buffer : buffer + length / 2;
+	blocks++;
+	if (blockCallback.isSet()) blockCallback();
+	return 1;
+}
+
+
+// ------------------------------------------------------------
+// Index in the buffer of the next sample to be stored
+// ------------------------------------------------------------
+uint16_t SampledADC::position(void) {
+	if (TIMx == NULL)
+		return 0;
+	return length - DMA_GetCurrDataCounter(SIT_ADC_DMA);
+}
@@ -0,0 +1,81 @@
+/* Copyright (c) 2014 Paul Kourany, based on work by Dianel Gilbert
+
+Copyright (c) 2013 Daniel Gilbert, loglow@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in the
+Software without restriction, including without limitation the rights to use, copy,
+modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the
+following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef __SAMPLEDADC_H__
+#define __SAMPLEDADC_H__
+
+#include "SparkIntervalTimer.h"
+
+#define SIT_ADC_MAX_CHANNELS	16		// length of the ADC regular sequence
+
+// ------------------------------------------------------------
+// Converts a sequence of analog pins on every period of a SIT.
+// The timer's TRGO (update) or compare output starts ADC1 directly
+// and DMA stores the results in a circular buffer, so there is no
+// interrupt per sample and the jitter is that of the timer clock.
+// Each half of the buffer is a block of whole scans; service(),
+// polled from loop(), runs the block callback as each one fills.
+//
+// Timers able to trigger ADC1:
+//   Core:   TIMER2 (CC2), TIMER3 (TRGO), TIMER4 (CC4)
+//   Photon: TIMER3 (TRGO), TIMER4 (CC4), TIMER5 (CC1), TIMER1 (CC1),
+//           TIMER8 (TRGO)
+// ADC1's DMA (Core: DMA1 channel 1, Photon: DMA2 stream 0) is
+// reserved while sampling, so only one SampledADC runs at a time.
+// ------------------------------------------------------------
+class SampledADC {
+  private:
+	IntervalTimer hwTimer;
+	TIM_TypeDef* TIMx;
+	uint16_t* buffer;
+	uint16_t length;
+	const uint16_t* ready;		// last block handed to the callback
+	SIT_Delegate blockCallback;
+	uint32_t blocks;
+	uint32_t missed;
+
+	bool start(const uint16_t* pins, uint8_t count, uint16_t* buf, uint16_t len, intPeriod Period, uint16_t prescaler, TIMid id);
+	bool startADC(const uint16_t* pins, uint8_t count, uint32_t trigger);
+
+  public:
+	SampledADC() : TIMx(NULL), buffer(NULL), length(0), ready(NULL), blocks(0), missed(0) {}
+	~SampledADC() { end(); }
+
+	bool begin(const uint16_t* pins, uint8_t count, uint16_t* buf, uint16_t len, intPeriod Period, bool scale, TIMid id = AUTO);
+	bool beginNs(const uint16_t* pins, uint8_t count, uint16_t* buf, uint16_t len, uint64_t ns, TIMid id = AUTO);
+	bool beginHz(const uint16_t* pins, uint8_t count, uint16_t* buf, uint16_t len, double hz, TIMid id = AUTO);
+	void end(void);
+
+	void onBlock(const SIT_Delegate& callback) { blockCallback = callback; }
+
+	uint8_t service(void);
+	const uint16_t* block(void) { return ready; }
+	uint16_t blockLength(void) { return length / 2; }
+	uint16_t position(void);
+	uint32_t serviced(void) { return blocks; }
+	uint32_t overruns(void) { return missed; }
+	bool isActive(void) { return TIMx != NULL; }
+	uint64_t period_SIT(void) { return hwTimer.period_SIT(); }
+
+	static bool canTrigger(uint8_t id);
+};
+
+#endif